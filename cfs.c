@@ -1,928 +1,6787 @@
-#include "cfs.h"
-
-#include <stdlib.h>
-#include <string.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <stdio.h>
-#include <assert.h>
-#include <ctype.h>
-
-
-#define DIR_SEP '/'
-
-#if defined(linux)
-#define PLAT_DIR_SEP '/'
-#elif defined(WIN32)
-#define PLAT_DIR_SEP '\\'
-#else
-#define PLAT_DIR_SEP '/'
-#endif
-
-typedef struct cfs_fs_handler {
-    cfs_fs_impl* impl;
-    const char** exts;
-    void* userdata;
-    struct cfs_fs_handler* next;
-} cfs_fs_handler;
-
-typedef struct cfs_mount_path {
-    cfs_fs_handle* handle;
-    struct cfs_mount_path* next;
-} cfs_mount_path;
-
-static int cfs_err;
-static cfs_fs_handler* handlers;
-static cfs_mount_path* mount_path;
-
-static char* cfs_strdup(const char* str);
-static char* cfs_strnstr(char* haystack, char* needle, size_t len);
-
-static cfs_fs_handler* find_handler(const char* filename) {
-    cfs_fs_handler* cur = handlers;
-    if(cur == NULL)
-        return NULL;
-	const char* extn;
-	size_t len;
-	cfs_path_extension(filename, &extn, &len);
-	if(len == 0) {
-		extn = "";
-		len = 1;
-	}
-	printf("%.*s\n", len, extn);
-    do {
-        const char** ext = cur->exts;
-        while(*ext != NULL) {
-            if(strncmp(extn, *ext, len) == 0) {
-                // Found handler
-                return cur;
-            }
-            ext++;
-        }
-        cur = cur->next;
-    } while(cur->next);
-    return NULL;
-}
-
-static char* cfs_strdup(const char* str) {
-    size_t len = strlen(str);
-    char* dup = cfs_malloc(sizeof(char) * (len + 1));
-    dup[len] = '\0';
-    memcpy(dup, str, len);
-    return dup;
-}
-
-static const char* err = "";
-const char* cfs_getstrerr(int errnum) {
-    switch(errnum) {
-    case CFS_ERRNOMEM:
-        err = "Out of Memory";
-        break;
-    case CFS_ERRNOHANDLER:
-        err = "No mount handler for filetype";
-        break;
-	case CFS_ERRPATH:
-		err = "Unexpected path error";
-		break;
-	default:
-		err = "Unknown error";
-		break;
-    }
-    return err;
-}
-
-
-int cfs_fs_impl_register(cfs_fs_impl* impl, const char** extensions, void* userdata) {
-    cfs_fs_handler* handler = handlers;
-    if(handler != NULL) {
-        while(handler->next) {
-            handler = handler->next;
-        }
-    }
-    cfs_fs_handler* h = cfs_malloc(sizeof(cfs_fs_handler));
-    if(h == NULL)
-        return CFS_ERRNOMEM;
-    h->impl = impl;
-    h->exts = extensions;
-    h->userdata = userdata;
-    h->next = NULL;
-	if(handlers != NULL) {
-		handler = h;
-	} else {
-		handlers = h;
-	}
-	return 0;
-}
-
-int cfs_fs_mount(const char* src, const char* mount) {
-    cfs_fs_handler* handler = find_handler(src);
-    if(handler == NULL) {
-        return CFS_ERRNOHANDLER;
-    }
-    cfs_fs_handle* handle = cfs_malloc(sizeof(cfs_fs_handle));
-    handle->handler = handler;
-    handle->src = cfs_strdup(src);
-    handle->mount = cfs_strdup(mount);
-    cfs_mount_path* mnt = cfs_malloc(sizeof(cfs_mount_path));
-    mnt->handle = handle;
-    mnt->next = NULL;
-	cfs_mount_path* mp = mount_path;
-    if(mp != NULL) {
-        while(mp->next) {
-            mp = mp->next;
-		}
-		mp->next = mnt;
-    } else {
-		mount_path = mnt;
-	}
-    return 0;
-}
-
-cfs_file_handle* cfs_file_open(const char* filename, const char* mode) {
-	cfs_file_handle* file = NULL;
-	cfs_mount_path* mp = mount_path;
-	char* base = cfs_strdup(filename);
-	size_t len;
-	cfs_path_dirname(filename, &len);
-	if(len == 0) {
-		printf("NO dirname\n");
-		return NULL;
-	}
-	base[len] = '\0';
-	printf("file: %s, base: %s\n", filename, base);
-
-	while(mp) {
-		if(cfs_path_get_intersection(base, mp->handle->mount) != 0) {
-			file = mp->handle->handler->impl->open_fn(mp->handle, filename, mode);
-			if(file != NULL) {
-				break;
-			}
-		}
-		mp = mp->next;
-	}
-	cfs_free(base);
-	return file;
-}
-
-long int cfs_file_read(cfs_file_handle* file, void* buffer, long int sz) {
-    return 0;
-}
-
-
-
-/*
- * Path handling functions mostly taken from cwalk https://github.com/likle/cwalk
- *  and modified the API for platform and non platform specific versions.
- *
- */
-
-#if defined(WIN32) || defined(_WIN32) ||                                       \
-  defined(__WIN32) && !defined(__CYGWIN__)
-static enum cfs_path_style path_style = CFS_PATH_WINDOWS;
-#else
-static enum cfs_path_style path_style = CFS_PATH_UNIX;
-#endif
-
-static const char* seperators[] = {
-	"\\/",
-	"/"
-};
-
-static bool cfs_path_get_first_segment_without_root(cfs_path_style style, const char* path, const char* segments, cfs_path *segment);
-static bool cfs_path_get_first_segment_impl(cfs_path_style style, const char *path, cfs_path *segment);
-static bool cfs_path_get_last_segment_impl(cfs_path_style style, const char* path, cfs_path* segment);
-static bool cfs_path_get_next_segment_impl(cfs_path_style style, cfs_path* segment);
-static bool cfs_path_get_previous_segment_impl(cfs_path_style style, cfs_path* segment);
-
-static size_t cfs_path_normalize_impl(cfs_path_style style, const char* path, char* buffer, size_t buffer_size);
-
-static void cfs_path_basename_impl(cfs_path_style style, const char* path, const char** basename, size_t* length);
-static void cfs_path_dirname_impl(cfs_path_style style, const char* path, size_t* length);
-
-static bool cfs_path_extension_impl(cfs_path_style style, const char* path, const char** extension, size_t* length);
-
-
-
-static const char* cfs_path_find_next_stop(cfs_path_style style, const char* c);
-
-void cfs_path_basename(const char* path, const char** basename, size_t* length) {
-	cfs_path_basename_impl(CFS_PATH_UNIX, path, basename, length);
-}
-
-void cfs_path_dirname(const char *path, size_t *length) {
-	cfs_path_dirname_impl(CFS_PATH_UNIX, path, length);
-}
-
-void cfs_plat_path_basename(const char* path, const char** basename, size_t* length) {
-	cfs_path_basename_impl(path_style, path, basename, length);
-}
-
-void cfs_plat_path_dirname(const char *path, size_t *length) {
-	cfs_path_dirname_impl(path_style, path, length);
-}
-
-static void cfs_path_basename_impl(cfs_path_style style, const char* path, const char** basename, size_t* length) {
-	cfs_path segment;
-	if(!cfs_path_get_last_segment_impl(style, path, &segment)) {
-		*basename = NULL;
-		*length = 0;
-		return;
-	}
-	*basename = segment.begin;
-	*length = segment.size;
-}
-
-static void cfs_path_dirname_impl(cfs_path_style style, const char* path, size_t* length) {
-	cfs_path segment;
-	if(!cfs_path_get_last_segment_impl(style, path, &segment)) {
-		*length = 0;
-		return;
-	}
-	*length = (size_t)(segment.begin - path);
-}
-
-static bool cfs_path_extension_impl(cfs_path_style style, const char* path, const char** extension, size_t* length) {
-	cfs_path segment;
-	const char* c;
-
-	if(!cfs_path_get_last_segment_impl(style, path, &segment)) {
-		return false;
-	}
-
-	for(c = segment.end; c >= segment.begin; --c) {
-		if(*c == '.') {
-			*extension = c;
-			*length = (size_t)(segment.end - c);
-			return true;
-		}
-	}
-	return false;
-}
-
-bool cfs_path_extension(const char *path, const char **extension, size_t *length) {
-	return cfs_path_extension_impl(CFS_PATH_UNIX, path, extension, length);
-}
-
-bool cfs_plat_path_extension(const char *path, const char **extension, size_t *length) {
-	return cfs_path_extension_impl(path_style, path, extension, length);
-}
-
-bool cfs_path_has_extension(const char *path) {
-	const char* extension;
-	size_t length;
-
-	return cfs_path_extension_impl(CFS_PATH_UNIX, path, &extension, &length);
-}
-
-bool cfs_plat_path_has_extension(const char *path) {
-	const char* extension;
-	size_t length;
-
-	return cfs_path_extension_impl(path_style, path, &extension, &length);
-}
-
-bool cfs_path_is_sep(cfs_path_style style, const char* str) {
-	const char* c;
-	c = seperators[style];
-	while(*c) {
-		if(*c == *str) { return true; }
-		++c;
-	}
-	return false;
-}
-
-size_t cfs_path_normalize(const char *path, char *buffer, size_t buffer_size) {
-	return cfs_path_normalize_impl(CFS_PATH_UNIX, path, buffer, buffer_size);
-}
-
-size_t cfs_plat_path_normalize(const char *path, char *buffer, size_t buffer_size) {
-	return cfs_path_normalize_impl(path_style, path, buffer, buffer_size);
-}
-
-
-static void cfs_path_get_root_windows(const char* path, size_t* length) {
-	const char *c;
-	bool is_device_path;
-
-	// We can not determine the root if this is an empty string. So we set the
-	// root to NULL and the length to zero and cancel the whole thing.
-  	c = path;
-  	*length = 0;
-  	if (!*c) {
-    	return;
-	}
-
-  	// Now we have to verify whether this is a windows network path (UNC), which
-  	// we will consider our root.
-  	if (cfs_path_is_sep(CFS_PATH_WINDOWS, c)) {
-  	  ++c;
-	}
-    // Check whether the path starts with a single back slash, which means this
-    // is not a network path - just a normal path starting with a backslash.
-    if (!cfs_path_is_sep(CFS_PATH_WINDOWS, c)) {
-      // Okay, this is not a network path but we still use the backslash as a
-      // root.
-      ++(*length);
-      return;
-    }
-
-    // A device path is a path which starts with "\\." or "\\?". A device path
-    // can be a UNC path as well, in which case it will take up one more
-    // segment. So, this is a network or device path. Skip the previous
-    // separator. Now we need to determine whether this is a device path. We
-    // might advance one character here if the server name starts with a '?' or
-    // a '.', but that's fine since we will search for a separator afterwards
-    // anyway.
-    ++c;
-    is_device_path = (*c == '?' || *c == '.') && cfs_path_is_sep(CFS_PATH_WINDOWS, ++c);
-    if (is_device_path) {
-      // That's a device path, and the root must be either "\\.\" or "\\?\"
-      // which is 4 characters long. (at least that's how Windows
-      // GetFullPathName behaves.)
-      *length = 4;
-      return;
-    }
-
-    // We will grab anything up to the next stop. The next stop might be a '\0'
-    // or another separator. That will be the server name.
-    c = cfs_path_find_next_stop(CFS_PATH_WINDOWS, c);
-
-    // If this is a separator and not the end of a string we wil have to include
-    // it. However, if this is a '\0' we must not skip it.
-    while (cfs_path_is_sep(CFS_PATH_WINDOWS, c)) {
-      ++c;
-    }
-
-    // We are now skipping the shared folder name, which will end after the
-    // next stop.
-    c = cfs_path_find_next_stop(CFS_PATH_WINDOWS, c);
-
-    // Then there might be a separator at the end. We will include that as well,
-    // it will mark the path as absolute.
-    if (cfs_path_is_sep(CFS_PATH_WINDOWS, c)) {
-      ++c;
-    }
-
-    // Finally, calculate the size of the root.
-    *length = (size_t)(c - path);
-    return;
-}
-
-static const char* cfs_path_find_next_stop(cfs_path_style style, const char* c) {
-	while(*c != '\0' && !cfs_path_is_sep(style, c)) {
-		++c;
-	}
-	return c;
-}
-
-static void cfs_path_get_root_unix(const char* path, size_t* length) {
-	if(cfs_path_is_sep(CFS_PATH_UNIX, path)) {
-		*length = 1;
-	} else {
-		*length = 0;
-	}
-}
-
-
-void cfs_path_get_root(cfs_path_style style, const char *path, size_t *length) {
-	switch(style) {
-		case CFS_PATH_WINDOWS:
-			cfs_path_get_root_windows(path, length);
-		break;
-		case CFS_PATH_UNIX:
-			cfs_path_get_root_unix(path, length);
-		break;
-	}
-}
-
-
-bool cfs_path_get_first_segment(const char *path, cfs_path *segment) {
-	return cfs_path_get_first_segment_impl(CFS_PATH_UNIX, path, segment);
-}
-
-bool cfs_plat_path_get_first_segment(const char* path, cfs_path* segment) {
-	return cfs_path_get_first_segment_impl(path_style, path, segment);
-}
-
-static bool cfs_path_get_first_segment_impl(cfs_path_style style, const char* path, cfs_path* segment) {
-	size_t length;
-	const char* segments;
-	cfs_path_get_root(style, path, &length);
-	segments = path + length;
-
-	return cfs_path_get_first_segment_without_root(style, path, segments, segment);
-}
-static bool cfs_path_get_first_segment_without_root(cfs_path_style style, const char* path, const char* segments, cfs_path *segment) {
-	segment->path = path;
-	segment->segments = segments;
-	segment->begin = segments;
-	segment->end = segments;
-	segment->size = 0;
-
-	if(*segments == '\0') {
-		return false;
-	}
-
-	while(cfs_path_is_sep(style, segments)) {
-		++segments;
-		if(*segments == '\0') {
-			return false;
-		}
-	}
-
-	segment->begin = segments;
-	segments = cfs_path_find_next_stop(style, segments);
-
-	segment->size = (size_t)(segments - segment->begin);
-	segment->end = segments;
-	return true;
-}
-
-static bool cfs_path_get_last_segment_impl(cfs_path_style style, const char* path, cfs_path* segment) {
-	if(!cfs_path_get_first_segment_impl(style, path, segment)) {
-		return false;
-	}
-
-	while(cfs_path_get_next_segment_impl(style, segment)) {}
-
-	return true;
-}
-
-bool cfs_path_get_last_segment(const char *path, cfs_path *segment) {
-	return cfs_path_get_last_segment_impl(CFS_PATH_UNIX, path, segment);
-}
-
-bool cfs_plat_path_get_last_segment(const char* path, cfs_path* segment) {
-	return cfs_path_get_last_segment_impl(path_style, path, segment);
-}
-
-static bool cfs_path_get_next_segment_impl(cfs_path_style style, cfs_path* segment) {
-	const char* c;
-	c = segment->begin + segment->size;
-	if(*c == '\0') {
-		return false;
-	}
-
-	assert(cfs_path_is_sep(style, c));
-	do {
-		++c;
-	} while(cfs_path_is_sep(style, c));
-	
-	if(*c == '\0')
-		return false;
-
-	segment->begin = c;
-	c = cfs_path_find_next_stop(style, c);
-	segment->end = c;
-	segment->size = (size_t)(c - segment->begin);
-
-	return true;
-}
-
-bool cfs_path_get_next_segment(cfs_path *segment) {
-	return cfs_path_get_next_segment_impl(CFS_PATH_UNIX, segment);
-}
-
-bool cfs_plat_path_get_next_segment(cfs_path *segment) {
-	return cfs_path_get_next_segment_impl(path_style, segment);
-}
-
-static const char* cfs_path_find_previous_stop(cfs_path_style style, const char* begin, const char* c) {
-	while (c > begin && !cfs_path_is_sep(style, c)) {
-		--c;
-	}
-
-	if(cfs_path_is_sep(style, c)) {
-		return c + 1;
-	} else {
-		return c;
-	}
-
-}
-
-static bool cfs_path_get_previous_segment_impl(cfs_path_style style, cfs_path* segment) {
-	const char* c;
-
-	c = segment->begin;
-	if(c <= segment->segments) {
-		return false;
-	}
-
-	do {
-		--c;
-		if(c < segment->segments) {
-			return false;
-		}
-	} while(cfs_path_is_sep(style, c));
-
-	segment->end = c + 1;
-	segment->begin = cfs_path_find_previous_stop(style, segment->segments, c);
-	segment->size = (size_t)(segment->end - segment->begin);
-
-	return true;
-}
-
-
-
-typedef struct cfs_segment_joined {
-	cfs_path segment;
-	const char** paths;
-	size_t path_index;
-} cfs_segment_joined;
-
-static bool cfs_path_string_equal(cfs_path_style style, const char* first, const char* second, size_t first_size, size_t second_size) {
-	if(first_size != second_size) {
-		return false;
-	}
-
-	if(style == CFS_PATH_UNIX) {
-		return strncmp(first, second, first_size) == 0;
-	}
-
-	while(*first && *second && first_size > 0) {
-		if(tolower(*first++) != tolower(*second++)) {
-			return false;
-		}
-		--first_size;
-	}
-	return true;
-}
-
-static bool cfs_path_get_first_segment_joined(cfs_path_style style, const char** paths, cfs_segment_joined* sj) {
-	bool result;
-
-	sj->path_index = 0;
-	sj->paths = paths;
-	result = false;
-  	while (paths[sj->path_index] != NULL &&
-         (result = cfs_path_get_first_segment_impl(style, paths[sj->path_index],
-            &sj->segment)) == false) {
-    ++sj->path_index;
-  }
-
-  return result;
-}
-
-static bool cfs_path_is_root_absolute(cfs_path_style style, const char* path, size_t length) {
-	if(length == 0) {
-		return false;
-	}
-
-	return cfs_path_is_sep(style, &path[length -1]);
-}
-
-static enum cfs_path_segment_type cfs_path_get_segment_type(const cfs_path* segment) {
-	if(strncmp(segment->begin, ".", segment->size) == 0) {
-		return CFS_PATH_CURRENT;
-	} else if(strncmp(segment->begin, "..", segment->size) == 0) {
-		return CFS_PATH_BACK;
-	}
-	return CFS_PATH_NORMAL;
-}
-
-static bool cfs_path_get_last_segment_without_root(cfs_path_style style, const char* path, cfs_path* segment) {
-	if(!cfs_path_get_first_segment_without_root(style, path, path, segment)) {
-		return false;
-	}
-
-	while(cfs_path_get_next_segment_impl(style, segment)) {}
-
-	return true;
-}
-
-
-
-static bool cfs_path_get_previous_segment_joined(cfs_path_style style, cfs_segment_joined* sj) {
-	bool result;
-
-	if(*sj->paths == NULL) {
-		return false;
-	} else if(cfs_path_get_previous_segment_impl(style, &sj->segment)) {
-		return true;
-	}
-
-
-	result = false;
-	do {
-		// We are done once we reached index 0. In that case there are no more
-		// segments left.
-    
-		if (sj->path_index == 0) {
-			break;
-		}
-
-    	// There is another path which we have to inspect. So we decrease the path
-		// index.
-	    --sj->path_index;
-		
-    	// If this is the first path we will have to consider that this path might
-    	// include a root, otherwise we just treat is as a segment.
-    	if (sj->path_index == 0) {
-      		result = cfs_path_get_last_segment_impl(style, sj->paths[sj->path_index],
-        	&sj->segment);
-    	} else {
-      		result = cfs_path_get_last_segment_without_root(style, sj->paths[sj->path_index],
-        	&sj->segment);
-    	}
-	} while (!result);
-
-	return result;	
-}
-
-
-
-static bool cfs_path_segment_back_will_be_removed(cfs_path_style style, cfs_segment_joined* sj) {
-	enum cfs_path_segment_type type;
-	int counter;
-	
-	counter = 0;
-
-	while(cfs_path_get_previous_segment_joined(style, sj)) {
-		type = cfs_path_get_segment_type(&sj->segment);
-		if(type == CFS_PATH_NORMAL) {
-			++counter;
-			if(counter > 0) {
-				return true;
-			}
-		} else if (type == CFS_PATH_BACK) {
-			--counter;
-		}
-	}
-
-	return false;
-}
-
-static bool cfs_path_get_next_segment_joined(cfs_path_style style, cfs_segment_joined *sj) {
-	bool result;
-
-	if(sj->paths[sj->path_index] == NULL) {
-		return false;
-	} else if(cfs_path_get_next_segment_impl(style, &sj->segment)) {
-		return true;
-	}
-
-	result = false;
-	do {
-		++sj->path_index;
-
-		if(sj->paths[sj->path_index] == NULL) {
-			break;
-		}
-
-		result = cfs_path_get_first_segment_without_root(style, sj->paths[sj->path_index], sj->paths[sj->path_index], &sj->segment);
-	} while(!result);
-
-	return result;
-}
-
-static bool cfs_path_segment_normal_will_be_removed(cfs_path_style style, cfs_segment_joined* sj) {
-	enum cfs_path_segment_type type;
-	int counter;
-
-	counter = 0;
-
-	while(cfs_path_get_next_segment_joined(style, sj)) {
-		type = cfs_path_get_segment_type(&sj->segment);
-		if(type == CFS_PATH_NORMAL) {
-			++counter;
-		} else if(type == CFS_PATH_BACK) {
-			--counter;
-			if(counter < 0) {
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
-
-
-static bool cfs_path_segment_will_be_removed(cfs_path_style style, const cfs_segment_joined* sj, bool absolute) {
-	enum cfs_path_segment_type type;
-	cfs_segment_joined sjc;
-	
-	sjc = *sj;
-
-	type = cfs_path_get_segment_type(&sj->segment);
-	if(type == CFS_PATH_CURRENT || (type == CFS_PATH_BACK && absolute)) {
-		return true;
-	} else if(type == CFS_PATH_BACK) {
-		return cfs_path_segment_back_will_be_removed(style, &sjc);
-	} else {
-		return cfs_path_segment_normal_will_be_removed(style, &sjc);
-	}
-}
-
-static bool cfs_path_segment_joined_skip_invisible(cfs_path_style style, cfs_segment_joined* sj, bool absolute) {
-	while(cfs_path_segment_will_be_removed(style, sj, absolute)) {
-		if(!cfs_path_get_next_segment_joined(style, sj)) {
-			return false;
-		}
-	}
-
-	return true;
-}
-
-static size_t cfs_path_get_intersection_impl(cfs_path_style style, const char* path_base, const char* path_other) {
-	bool absolute;
-	size_t base_root_length, other_root_length;
-	const char *end;
-	const char *paths_base[2], *paths_other[2];
-	cfs_segment_joined base, other;
-	
-  	// We first compare the two roots. We just return zero if they are not equal.
-  	// This will also happen to return zero if the paths are mixed relative and
-  	// absolute.
-	cfs_path_get_root(style, path_base, &base_root_length);
-	cfs_path_get_root(style, path_other, &other_root_length);
-	if (!cfs_path_string_equal(style, path_base, path_other, base_root_length, other_root_length)) {
-		return 0;
-	}
-
- 	// Configure our paths. We just have a single path in here for now.
- 	paths_base[0] = path_base;
-  	paths_base[1] = NULL;
-  	paths_other[0] = path_other;
-  	paths_other[1] = NULL;
-
-  	// So we get the first segment of both paths. If one of those paths don't have
-  	// any segment, we will return 0.
-  	if (!cfs_path_get_first_segment_joined(style, paths_base, &base) ||
-    	  !cfs_path_get_first_segment_joined(style, paths_other, &other)) {
-    	return base_root_length;
-  	}
-
-  	// We now determine whether the path is absolute or not. This is required
-  	// because if will ignore removed segments, and this behaves differently if
-  	// the path is absolute. However, we only need to check the base path because
-  	// we are guaranteed that both paths are either relative or absolute.
-  	absolute = cfs_path_is_root_absolute(style, path_base, base_root_length);
-
-  	// We must keep track of the end of the previous segment. Initially, this is
-  	// set to the beginning of the path. This means that 0 is returned if the
- 	// first segment is not equal.
-  	end = path_base + base_root_length;
-
-  	// Now we loop over both segments until one of them reaches the end or their
-  	// contents are not equal.
-  	do {
-    	// We skip all segments which will be removed in each path, since we want to
-    	// know about the true path.
-    	if (!cfs_path_segment_joined_skip_invisible(style, &base, absolute) ||
-        	!cfs_path_segment_joined_skip_invisible(style, &other, absolute)) {
-      		break;
-    	}
-
-    	if (!cfs_path_string_equal(style, base.segment.begin, other.segment.begin,
-          	base.segment.size, other.segment.size)) {
-      		// So the content of those two segments are not equal. We will return the
-      		// size up to the beginning.
-      		return (size_t)(end - path_base);
-    	}
-
-    	// Remember the end of the previous segment before we go to the next one.
-    	end = base.segment.end;
-  	} while (cfs_path_get_next_segment_joined(style, &base) &&
-			 cfs_path_get_next_segment_joined(style, &other));
-
-  	// Now we calculate the length up to the last point where our paths pointed to
-  	// the same place.
-  	return (size_t)(end - path_base);
-}
-
-size_t cfs_path_get_intersection(const char *path_base, const char *path_other) {
-	return cfs_path_get_intersection_impl(CFS_PATH_UNIX, path_base, path_other);
-}
-
-size_t cfs_plat_path_get_intersection(const char *path_base, const char *path_other) {
-	return cfs_path_get_intersection_impl(path_style, path_base, path_other);
-}
-
-static size_t cfs_path_output_sized(char* buffer, size_t buffer_size, size_t position, const char* str, size_t length) {
-  size_t amount_written;
-
-  // First we determine the amount which we can write to the buffer. There are
-  // three cases. In the first case we have enough to store the whole string in
-  // it. In the second one we can only store a part of it, and in the third we
-  // have no space left.
-  if (buffer_size > position + length) {
-    amount_written = length;
-  } else if (buffer_size > position) {
-    amount_written = buffer_size - position;
-  } else {
-    amount_written = 0;
-  }
-
-  // If we actually want to write out something we will do that here. We will
-  // always append a '\0', this way we are guaranteed to have a valid string at
-  // all times.
-  if (amount_written > 0) {
-    memmove(&buffer[position], str, amount_written);
-  }
-
-  // Return the theoretical length which would have been written when everything
-  // would have fit in the buffer.
-  return length;
-}
-
-static void cfs_path_terminate_output(char* buffer, size_t buffer_size, size_t position) {
-	if(buffer_size > 0) {
-		if(position >= buffer_size) {
-			buffer[buffer_size - 1] = '\0'; 
-		} else {
-			buffer[position] = '\0';
-		}
-	}
-}
-
-static size_t cfs_path_output_separator(cfs_path_style style, char* buffer, size_t buffer_size, size_t position) {
-	return cfs_path_output_sized(buffer, buffer_size, position, seperators[style], 1);
-}
-
-static size_t cfs_path_output_current(char* buffer, size_t buffer_size, size_t position) {
-	return cfs_path_output_sized(buffer, buffer_size, position, ".", 1);
-}
-
-static size_t cfs_path_join_and_normalize_multiple(cfs_path_style style, const char** paths, char* buffer, size_t buffer_size) {
-	size_t pos;
-	bool absolute, has_segment_output;
-	cfs_segment_joined sj;
-
-	cfs_path_get_root(style, paths[0], &pos);
-	
-	absolute = cfs_path_is_root_absolute(style, paths[0], pos);
-
-	cfs_path_output_sized(buffer, buffer_size, 0, paths[0], pos);
-
-	if(!cfs_path_get_first_segment_joined(style, paths, &sj)) {
-		goto done;
-	}
-
-	has_segment_output = false;
-
-	do {
-		if(cfs_path_segment_will_be_removed(style, &sj, absolute)) {
-			continue;
-		}
-
-		if(has_segment_output) {
-			pos += cfs_path_output_separator(style, buffer, buffer_size, pos);
-		}
-
-		has_segment_output = true;
-		
-		pos += cfs_path_output_sized(buffer, buffer_size, pos, sj.segment.begin, sj.segment.size);
-	} while(cfs_path_get_next_segment_joined(style, &sj));
-
-	if(!has_segment_output && pos == 0) {
-		assert(absolute == false);
-		pos += cfs_path_output_current(buffer, buffer_size, pos);
-	}
-
-done:
-	cfs_path_terminate_output(buffer, buffer_size, pos);
-
-	return pos;
-}
-
-static size_t cfs_path_normalize_impl(cfs_path_style style, const char* path, char* buffer, size_t buffer_size) {
-	const char* paths[2];
-
-	paths[0] = path;
-	paths[1] = NULL;
-
-	return cfs_path_join_and_normalize_multiple(style, paths, buffer, buffer_size);
-}
-
-
-static size_t cfs_path_get_absolute_impl(cfs_path_style style, const char* base, const char* path, char* buffer, size_t buffer_size) {
-	size_t i;
-	const char* paths[4];
-
-	if(cfs_path_is_absolute(base)) {
-		i = 0;
-	} else if(style == CFS_PATH_WINDOWS) {
-		paths[0] = "\\";
-		i = 1;
-	} else {
-		paths[0] = "/";
-		i = 1;
-	}
-
-  	if (cfs_path_is_absolute(path)) {
-    // If the submitted path is not relative the base path becomes irrelevant.
-    // We will only normalize the submitted path instead.
-    paths[i++] = path;
-    paths[i] = NULL;
-  } else {
-    // Otherwise we append the relative path to the base path and normalize it.
-    // The result will be a new absolute path.
-    paths[i++] = base;
-    paths[i++] = path;
-    paths[i] = NULL;
-  }
-
-  // Finally join everything together and normalize it.
-  return cfs_path_join_and_normalize_multiple(style, paths, buffer, buffer_size);
-
-}
+#include "cfs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <assert.h>
+#include <ctype.h>
+
+#ifdef CFS_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#if defined(__linux__) && defined(CFS_POSIX) && !defined(CFS_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CFS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+
+#define DIR_SEP '/'
+
+#if defined(linux)
+#define PLAT_DIR_SEP '/'
+#elif defined(WIN32)
+#define PLAT_DIR_SEP '\\'
+#else
+#define PLAT_DIR_SEP '/'
+#endif
+
+typedef struct cfs_fs_handler {
+    cfs_fs_impl* impl;
+    const char** exts;
+    void* userdata;
+    int priority;
+    struct cfs_fs_handler* next;
+} cfs_fs_handler;
+
+/*
+    Entry of the extension -> handler map. Extensions are stored case folded and
+    without their leading dot.
+*/
+typedef struct cfs_fs_extension {
+	cfs_fs_handler* handler;
+	size_t size;
+	uint32_t hash;
+	char name[];
+} cfs_fs_extension;
+
+/*
+    A normalized path segment. Segments are interned, so two segments with the
+    same name in the mount points of one mount table are always the same object
+    and can be compared by pointer.
+*/
+typedef struct cfs_path_segment {
+	const char* name;
+	size_t size;
+	uint32_t hash;
+	// Held by every mount handle whose mount point contains the segment.
+	unsigned int refs;
+} cfs_path_segment;
+
+/*
+    A mount as the core keeps it. Backends only see the cfs_fs_handle at its
+    start, which converts back by casting.
+*/
+typedef struct cfs_mount_handle {
+	cfs_fs_handle fs;
+	// Interned segments of the mount point, NULL until it is first inserted.
+	const cfs_path_segment** segments;
+	size_t segment_count;
+	// Held by every mount table listing the mount and every open file.
+	unsigned int refs;
+	// Size and modification time in ns of src when it was mounted, or 0.
+	int64_t src_size;
+	int64_t src_mtime;
+} cfs_mount_handle;
+
+static cfs_mount_handle* cfs_mount_handle_of(cfs_fs_handle* fs) {
+	return (cfs_mount_handle*)fs;
+}
+
+#if defined(_MSC_VER)
+#define CFS_THREAD_LOCAL __declspec(thread)
+#else
+#define CFS_THREAD_LOCAL _Thread_local
+#endif
+
+static CFS_THREAD_LOCAL int cfs_err;
+static cfs_fs_handler* handlers;
+static cfs_fs_handler* sniffers;
+static cfs_fs_extension** extensions;
+static size_t extension_count;
+static size_t extension_capacity;
+
+// Serializes everything which changes handlers or mounts. Readers never
+// take it, see the mount tables below.
+#ifdef CFS_POSIX
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cfs_writer_lock(void) {
+	pthread_mutex_lock(&writer_lock);
+}
+
+static void cfs_writer_unlock(void) {
+	pthread_mutex_unlock(&writer_lock);
+}
+#else
+static void cfs_writer_lock(void) {}
+static void cfs_writer_unlock(void) {}
+#endif
+
+static char* cfs_strdup(const char* str);
+static char* cfs_strnstr(char* haystack, char* needle, size_t len);
+
+static uint32_t cfs_hash(const char* str, size_t length) {
+	uint32_t hash = 2166136261u;
+	while(length--) {
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t cfs_path_hash(const char* path, size_t length) {
+	return cfs_hash(path, length);
+}
+
+// Folds an extension into buffer, dropping a leading dot. Returns the folded
+// length or (size_t)-1 if the extension does not fit.
+static size_t cfs_extension_fold(const char* ext, size_t length, char* buffer, size_t buffer_size) {
+	size_t i;
+
+	if(length > 0 && *ext == '.') {
+		ext++;
+		length--;
+	}
+	if(length > buffer_size) {
+		return (size_t)-1;
+	}
+	for(i = 0; i < length; i++) {
+		buffer[i] = (char)tolower((unsigned char)ext[i]);
+	}
+	return length;
+}
+
+static cfs_fs_extension* cfs_extension_find(const char* name, size_t size, uint32_t hash) {
+	size_t mask, i;
+	cfs_fs_extension* ext;
+
+	if(extension_capacity == 0) {
+		return NULL;
+	}
+	mask = extension_capacity - 1;
+	for(i = hash & mask; (ext = extensions[i]) != NULL; i = (i + 1) & mask) {
+		if(ext->hash == hash && ext->size == size && memcmp(ext->name, name, size) == 0) {
+			return ext;
+		}
+	}
+	return NULL;
+}
+
+static int cfs_extension_insert(cfs_fs_handler* handler, const char* name, size_t size) {
+	uint32_t hash = cfs_hash(name, size);
+	cfs_fs_extension* ext;
+	size_t mask, i;
+
+	// The first handler registered for an extension keeps it.
+	if(cfs_extension_find(name, size, hash) != NULL) {
+		return 0;
+	}
+
+	if((extension_count + 1) * 2 > extension_capacity) {
+		size_t capacity = extension_capacity ? extension_capacity * 2 : 16;
+		cfs_fs_extension** table = cfs_malloc(sizeof(cfs_fs_extension*) * capacity);
+		if(table == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		memset(table, 0, sizeof(cfs_fs_extension*) * capacity);
+		for(i = 0; i < extension_capacity; i++) {
+			if(extensions[i] != NULL) {
+				size_t j = extensions[i]->hash & (capacity - 1);
+				while(table[j] != NULL) {
+					j = (j + 1) & (capacity - 1);
+				}
+				table[j] = extensions[i];
+			}
+		}
+		cfs_free(extensions);
+		extensions = table;
+		extension_capacity = capacity;
+	}
+
+	ext = cfs_malloc(sizeof(cfs_fs_extension) + size);
+	if(ext == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	ext->handler = handler;
+	ext->size = size;
+	ext->hash = hash;
+	memcpy(ext->name, name, size);
+
+	mask = extension_capacity - 1;
+	for(i = hash & mask; extensions[i] != NULL; i = (i + 1) & mask) {}
+	extensions[i] = ext;
+	extension_count++;
+	return 0;
+}
+
+// Drops every extension of handler. The rest are placed again starting
+// after an empty slot, so each probe sequence stays unbroken.
+static void cfs_extension_remove(const cfs_fs_handler* handler) {
+	cfs_fs_extension* ext;
+	size_t mask, start, i, j, k;
+
+	for(i = 0; i < extension_capacity; i++) {
+		if(extensions[i] != NULL && extensions[i]->handler == handler) {
+			cfs_free(extensions[i]);
+			extensions[i] = NULL;
+			extension_count--;
+		}
+	}
+	mask = extension_capacity - 1;
+	for(start = 0; start < extension_capacity && extensions[start] != NULL; start++) {}
+	for(k = 1; k <= extension_capacity; k++) {
+		i = (start + k) & mask;
+		if((ext = extensions[i]) != NULL) {
+			extensions[i] = NULL;
+			for(j = ext->hash & mask; extensions[j] != NULL; j = (j + 1) & mask) {}
+			extensions[j] = ext;
+		}
+	}
+}
+
+/*
+    Picks the handler for a mount source. The extension map is consulted first,
+    an empty extension standing for sources without one (e.g. directories).
+    If no extension matches the content sniffers are asked in priority order.
+*/
+static cfs_fs_handler* find_handler(const char* filename) {
+	char folded[32];
+	const char* extn;
+	size_t len;
+	cfs_fs_extension* ext;
+	cfs_fs_handler* cur;
+
+	if(!cfs_path_extension(filename, &extn, &len)) {
+		extn = "";
+		len = 0;
+	}
+	len = cfs_extension_fold(extn, len, folded, sizeof(folded));
+	if(len != (size_t)-1) {
+		ext = cfs_extension_find(folded, len, cfs_hash(folded, len));
+		if(ext != NULL) {
+			return ext->handler;
+		}
+	}
+
+	for(cur = sniffers; cur != NULL; cur = cur->next) {
+		if(cur->impl->sniff_fn(filename, cur->userdata)) {
+			return cur;
+		}
+	}
+	return NULL;
+}
+
+static char* cfs_strdup(const char* str) {
+    size_t len = strlen(str);
+    char* dup = cfs_malloc(sizeof(char) * (len + 1));
+    if(dup == NULL)
+        return NULL;
+    dup[len] = '\0';
+    memcpy(dup, str, len);
+    return dup;
+}
+
+int cfs_geterr(void) {
+	return cfs_err;
+}
+
+static const char* err = "";
+const char* cfs_getstrerr(int errnum) {
+    switch(errnum) {
+    case CFS_ERRNOMEM:
+        err = "Out of Memory";
+        break;
+    case CFS_ERRNOHANDLER:
+        err = "No mount handler for filetype";
+        break;
+	case CFS_ERRPATH:
+		err = "Unexpected path error";
+		break;
+	case CFS_ERRNAMETOOLONG:
+		err = "Path too long";
+		break;
+	case CFS_ERRIO:
+		err = "I/O error";
+		break;
+	case CFS_ERRBUSY:
+		err = "Too many requests in flight";
+		break;
+	case CFS_ERRNOENT:
+		err = "No such file";
+		break;
+	default:
+		err = "Unknown error";
+		break;
+    }
+    return err;
+}
+
+
+int cfs_fs_impl_register(cfs_fs_impl* impl, const char** exts, void* userdata) {
+	char folded[32];
+	const char** ext;
+	size_t len;
+	int err;
+
+	cfs_writer_lock();
+    cfs_fs_handler* handler = handlers;
+    if(handler != NULL) {
+        while(handler->next) {
+            handler = handler->next;
+        }
+    }
+    cfs_fs_handler* h = cfs_malloc(sizeof(cfs_fs_handler));
+    if(h == NULL) {
+		cfs_writer_unlock();
+        return CFS_ERRNOMEM;
+	}
+    h->impl = impl;
+    h->exts = exts;
+    h->userdata = userdata;
+	h->priority = 0;
+    h->next = NULL;
+
+	// Nothing refers to the handler until all of its extensions are in.
+	for(ext = exts; *ext != NULL; ext++) {
+		len = cfs_extension_fold(*ext, strlen(*ext), folded, sizeof(folded));
+		if(len == (size_t)-1) {
+			continue;
+		}
+		if((err = cfs_extension_insert(h, folded, len)) < 0) {
+			cfs_extension_remove(h);
+			cfs_free(h);
+			cfs_writer_unlock();
+			return err;
+		}
+	}
+	if(handlers != NULL) {
+		handler->next = h;
+	} else {
+		handlers = h;
+	}
+	cfs_writer_unlock();
+	return 0;
+}
+
+int cfs_fs_impl_register_sniffer(cfs_fs_impl* impl, int priority, void* userdata) {
+	cfs_fs_handler** cur;
+
+	if(impl->sniff_fn == NULL) {
+		return CFS_ERRNOHANDLER;
+	}
+    cfs_fs_handler* h = cfs_malloc(sizeof(cfs_fs_handler));
+    if(h == NULL)
+        return CFS_ERRNOMEM;
+    h->impl = impl;
+    h->exts = NULL;
+    h->userdata = userdata;
+	h->priority = priority;
+
+	// Keep the list sorted by priority, equal priorities in registration order.
+	cfs_writer_lock();
+	cur = &sniffers;
+	while(*cur != NULL && (*cur)->priority <= priority) {
+		cur = &(*cur)->next;
+	}
+	h->next = *cur;
+	*cur = h;
+	cfs_writer_unlock();
+	return 0;
+}
+
+/*
+ * Mount tables.
+ *
+ * Mount points are stored in a trie keyed by normalized path segment. Every
+ * node keeps the mounts that apply to it - its own and those of all of its
+ * ancestors - in priority (mount) order, so resolving a virtual path is a
+ * single walk over its directory segments regardless of how many mounts
+ * exist.
+ *
+ * The trie, the mount list and the segment table form a cfs_mount_table
+ * which is never changed once published. Mounting and unmounting build a new
+ * table under the writer lock and swap it in, readers just load the current
+ * one. Each thread announces the epoch it started reading in, a replaced
+ * table is freed once no thread reads in its epoch or an earlier one. So
+ * opening files takes no lock and scales with the number of threads, while
+ * mounts may happen at any time.
+ */
+
+typedef struct cfs_mount_node {
+	const cfs_path_segment* segment;
+	struct cfs_mount_node** children;
+	size_t child_count;
+	size_t child_capacity;
+	cfs_fs_handle** mounts;
+	size_t mount_count;
+	size_t mount_capacity;
+} cfs_mount_node;
+
+typedef struct cfs_mount_table {
+	cfs_mount_node root;
+	cfs_fs_handle** mounts;
+	size_t mount_count;
+	// Open addressed set of the interned segments of all mount points.
+	const cfs_path_segment** interned;
+	size_t interned_count;
+	size_t interned_capacity;
+	// In indexed mode, the merged index and the number of mounts it does not
+	// cover because their backend has no index_fn.
+	struct cfs_index* index;
+	size_t unindexed;
+	// Tables are numbered in the order they are built, starting at 1.
+	uint64_t generation;
+	uint64_t retired;
+	struct cfs_mount_table* next;
+} cfs_mount_table;
+
+// Pool size classes are powers of two from 64 bytes to 64 KiB.
+#define CFS_POOL_MIN_SHIFT 6
+#define CFS_POOL_CLASSES 11
+
+typedef struct cfs_thread {
+	// Epoch the thread reads in, 0 while it does not read.
+	uint64_t epoch;
+	unsigned int depth;
+	int in_use;
+	// Resolution cache of cfs_file_open and metadata cache of
+	// cfs_file_stat, allocated on first use.
+	struct cfs_resolve_slot* cache;
+	struct cfs_stat_slot* stats;
+	// Free blocks of cfs_pool_alloc, one list per size class.
+	struct cfs_pool_block* pool[CFS_POOL_CLASSES];
+	size_t pool_count[CFS_POOL_CLASSES];
+	struct cfs_thread* next;
+} cfs_thread;
+
+static cfs_mount_table* mount_table;
+static cfs_mount_table* retired_tables;
+static uint64_t mount_epoch = 1;
+static uint64_t mount_generation;
+static cfs_thread* threads;
+static CFS_THREAD_LOCAL cfs_thread* thread_self;
+
+#ifdef CFS_POSIX
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+// Hands the record of an exiting thread to the next new one.
+static void cfs_thread_exit(void* arg) {
+	cfs_thread* thread = arg;
+
+	__atomic_store_n(&thread->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void cfs_thread_key_init(void) {
+	pthread_key_create(&thread_key, cfs_thread_exit);
+}
+#endif
+
+static void cfs_read_end(void) {
+	cfs_thread* thread = thread_self;
+
+	if(--thread->depth == 0) {
+		__atomic_store_n(&thread->epoch, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static cfs_thread* cfs_thread_get(void) {
+	cfs_thread* thread;
+
+	if(thread_self != NULL) {
+		return thread_self;
+	}
+	for(thread = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+		int expected = 0;
+		if(__atomic_compare_exchange_n(&thread->in_use, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+	if(thread == NULL) {
+		thread = cfs_malloc(sizeof(cfs_thread));
+		if(thread == NULL) {
+			return NULL;
+		}
+		thread->epoch = 0;
+		thread->depth = 0;
+		thread->in_use = 1;
+		thread->cache = NULL;
+		thread->stats = NULL;
+		memset(thread->pool, 0, sizeof(thread->pool));
+		memset(thread->pool_count, 0, sizeof(thread->pool_count));
+		thread->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+		while(!__atomic_compare_exchange_n(&threads, &thread->next, thread, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+	}
+#ifdef CFS_POSIX
+	pthread_once(&thread_once, cfs_thread_key_init);
+	pthread_setspecific(thread_key, thread);
+#endif
+	thread_self = thread;
+	return thread;
+}
+
+// Starts reading the current mount table, which stays valid until the
+// matching cfs_read_end. Calls nest. Returns NULL with cfs_err set, and
+// without a matching cfs_read_end, if there is no memory for the thread
+// record or nothing was ever mounted.
+static const cfs_mount_table* cfs_read_begin(void) {
+	cfs_thread* thread = cfs_thread_get();
+	const cfs_mount_table* table;
+
+	if(thread == NULL) {
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	if(thread->depth++ == 0) {
+		__atomic_store_n(&thread->epoch, __atomic_load_n(&mount_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+	}
+	table = __atomic_load_n(&mount_table, __ATOMIC_SEQ_CST);
+	if(table == NULL) {
+		cfs_read_end();
+		cfs_err = CFS_ERRNOENT;
+	}
+	return table;
+}
+
+typedef struct cfs_pool_block {
+	struct cfs_pool_block* next;
+} cfs_pool_block;
+
+// Returns CFS_POOL_CLASSES for sizes the pool does not serve.
+static int cfs_pool_class(size_t size) {
+	int class = 0;
+
+	while(class < CFS_POOL_CLASSES && ((size_t)1 << (CFS_POOL_MIN_SHIFT + class)) < size) {
+		class++;
+	}
+	return class;
+}
+
+void* cfs_pool_alloc(size_t size) {
+	int class = cfs_pool_class(size);
+	cfs_thread* thread;
+	cfs_pool_block* block;
+
+	if(class == CFS_POOL_CLASSES) {
+		return cfs_malloc(size);
+	}
+	thread = cfs_thread_get();
+	if(thread != NULL && (block = thread->pool[class]) != NULL) {
+		thread->pool[class] = block->next;
+		thread->pool_count[class]--;
+		return block;
+	}
+	// Always the whole class, the block may be kept on free.
+	return cfs_malloc((size_t)1 << (CFS_POOL_MIN_SHIFT + class));
+}
+
+void cfs_pool_free(void* ptr, size_t size) {
+	int class = cfs_pool_class(size);
+	cfs_thread* thread;
+	cfs_pool_block* block = ptr;
+
+	if(ptr == NULL) {
+		return;
+	}
+	if(class < CFS_POOL_CLASSES && (thread = cfs_thread_get()) != NULL &&
+	   thread->pool_count[class] < (CFS_POOL_CACHE_SIZE >> (CFS_POOL_MIN_SHIFT + class))) {
+		block->next = thread->pool[class];
+		thread->pool[class] = block;
+		thread->pool_count[class]++;
+		return;
+	}
+	cfs_free(ptr);
+}
+
+static void cfs_fs_handle_retain(cfs_fs_handle* fs) {
+	__atomic_add_fetch(&cfs_mount_handle_of(fs)->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void cfs_segment_release(const cfs_path_segment* segment) {
+	cfs_path_segment* seg = (cfs_path_segment*)segment;
+
+	if(__atomic_sub_fetch(&seg->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		cfs_free(seg);
+	}
+}
+
+static void cfs_mount_release_segments(cfs_fs_handle* fs) {
+	cfs_mount_handle* mount = cfs_mount_handle_of(fs);
+	size_t i;
+
+	for(i = 0; i < mount->segment_count; i++) {
+		cfs_segment_release(mount->segments[i]);
+	}
+	cfs_free((void*)mount->segments);
+	mount->segments = NULL;
+	mount->segment_count = 0;
+}
+
+// Drops a reference, the last one unmounts the source.
+static void cfs_fs_handle_release(cfs_fs_handle* fs) {
+	if(__atomic_sub_fetch(&cfs_mount_handle_of(fs)->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+		return;
+	}
+	if(fs->handler->impl->unmount_fn != NULL) {
+		fs->handler->impl->unmount_fn(fs);
+	}
+	cfs_mount_release_segments(fs);
+	cfs_free((void*)fs->src);
+	cfs_free((void*)fs->mount);
+	cfs_free(fs);
+}
+
+/*
+ * Segment interning. Every segment of a mount point is stored exactly once so
+ * the trie can compare keys by pointer. Each table interns the segments of
+ * its own mounts only, carrying over the objects of the mounts it keeps.
+ * Segments are counted by the handles using them and freed with the last
+ * one, which a replaced table releases only once it is reclaimed, so a
+ * segment outlives every table that can still reach it.
+ */
+
+static const cfs_path_segment* cfs_intern_find(const cfs_mount_table* table, const char* name, size_t size, uint32_t hash) {
+	size_t mask, i;
+	const cfs_path_segment* seg;
+
+	if(table == NULL || table->interned_capacity == 0) {
+		return NULL;
+	}
+	mask = table->interned_capacity - 1;
+	for(i = hash & mask; (seg = table->interned[i]) != NULL; i = (i + 1) & mask) {
+		if(seg->hash == hash && seg->size == size && memcmp(seg->name, name, size) == 0) {
+			return seg;
+		}
+	}
+	return NULL;
+}
+
+static int cfs_intern_place(cfs_mount_table* table, const cfs_path_segment* seg) {
+	size_t mask, i;
+
+	if((table->interned_count + 1) * 2 > table->interned_capacity) {
+		size_t capacity = table->interned_capacity ? table->interned_capacity * 2 : 64;
+		const cfs_path_segment** interned = cfs_malloc(sizeof(cfs_path_segment*) * capacity);
+		if(interned == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		memset(interned, 0, sizeof(cfs_path_segment*) * capacity);
+		for(i = 0; i < table->interned_capacity; i++) {
+			if(table->interned[i] != NULL) {
+				size_t j = table->interned[i]->hash & (capacity - 1);
+				while(interned[j] != NULL) {
+					j = (j + 1) & (capacity - 1);
+				}
+				interned[j] = table->interned[i];
+			}
+		}
+		cfs_free(table->interned);
+		table->interned = interned;
+		table->interned_capacity = capacity;
+	}
+
+	mask = table->interned_capacity - 1;
+	for(i = seg->hash & mask; table->interned[i] != NULL; i = (i + 1) & mask) {}
+	table->interned[i] = seg;
+	table->interned_count++;
+	return 0;
+}
+
+static const cfs_path_segment* cfs_intern(cfs_mount_table* table, const char* name, size_t size, uint32_t hash) {
+	const cfs_path_segment* found;
+	cfs_path_segment* seg;
+
+	if((found = cfs_intern_find(table, name, size, hash)) != NULL) {
+		return found;
+	}
+
+	// The name is stored inline, directly behind the segment record.
+	seg = cfs_malloc(sizeof(cfs_path_segment) + size + 1);
+	if(seg == NULL) {
+		return NULL;
+	}
+	memcpy((char*)(seg + 1), name, size);
+	((char*)(seg + 1))[size] = '\0';
+	seg->name = (const char*)(seg + 1);
+	seg->size = size;
+	seg->hash = hash;
+	seg->refs = 0;
+
+	if(cfs_intern_place(table, seg) < 0) {
+		cfs_free(seg);
+		return NULL;
+	}
+	return seg;
+}
+
+static cfs_mount_node* cfs_mount_node_find_child(const cfs_mount_node* node, const cfs_path_segment* segment) {
+	size_t mask, i;
+	cfs_mount_node* child;
+
+	if(node->child_capacity == 0) {
+		return NULL;
+	}
+	mask = node->child_capacity - 1;
+	for(i = segment->hash & mask; (child = node->children[i]) != NULL; i = (i + 1) & mask) {
+		if(child->segment == segment) {
+			return child;
+		}
+	}
+	return NULL;
+}
+
+static void cfs_mount_node_place_child(cfs_mount_node** children, size_t capacity, cfs_mount_node* child) {
+	size_t mask = capacity - 1;
+	size_t i = child->segment->hash & mask;
+	while(children[i] != NULL) {
+		i = (i + 1) & mask;
+	}
+	children[i] = child;
+}
+
+static int cfs_mount_node_add_mount(cfs_mount_node* node, cfs_fs_handle* fs) {
+	if(node->mount_count == node->mount_capacity) {
+		size_t capacity = node->mount_capacity ? node->mount_capacity * 2 : 4;
+		cfs_fs_handle** mounts = cfs_realloc(node->mounts, sizeof(cfs_fs_handle*) * capacity);
+		if(mounts == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		node->mounts = mounts;
+		node->mount_capacity = capacity;
+	}
+	node->mounts[node->mount_count++] = fs;
+	return 0;
+}
+
+static cfs_mount_node* cfs_mount_node_add_child(cfs_mount_node* node, const cfs_path_segment* segment) {
+	cfs_mount_node* child;
+	size_t i;
+
+	// Keep the load factor of the child table at or below one half.
+	if((node->child_count + 1) * 2 > node->child_capacity) {
+		size_t capacity = node->child_capacity ? node->child_capacity * 2 : 4;
+		cfs_mount_node** children = cfs_malloc(sizeof(cfs_mount_node*) * capacity);
+		if(children == NULL) {
+			return NULL;
+		}
+		memset(children, 0, sizeof(cfs_mount_node*) * capacity);
+		for(i = 0; i < node->child_capacity; i++) {
+			if(node->children[i] != NULL) {
+				cfs_mount_node_place_child(children, capacity, node->children[i]);
+			}
+		}
+		cfs_free(node->children);
+		node->children = children;
+		node->child_capacity = capacity;
+	}
+
+	child = cfs_malloc(sizeof(cfs_mount_node));
+	if(child == NULL) {
+		return NULL;
+	}
+	memset(child, 0, sizeof(cfs_mount_node));
+	child->segment = segment;
+
+	// A new node inherits every mount which applies to its parent.
+	for(i = 0; i < node->mount_count; i++) {
+		if(cfs_mount_node_add_mount(child, node->mounts[i]) < 0) {
+			cfs_free(child->mounts);
+			cfs_free(child);
+			return NULL;
+		}
+	}
+
+	cfs_mount_node_place_child(node->children, node->child_capacity, child);
+	node->child_count++;
+	return child;
+}
+
+static int cfs_mount_node_add_mount_recursive(cfs_mount_node* node, cfs_fs_handle* fs) {
+	size_t i;
+	int err;
+
+	if((err = cfs_mount_node_add_mount(node, fs)) < 0) {
+		return err;
+	}
+	for(i = 0; i < node->child_capacity; i++) {
+		if(node->children[i] != NULL && (err = cfs_mount_node_add_mount_recursive(node->children[i], fs)) < 0) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+// Offset of the path relative to fs inside the normalized absolute path of
+// one of its files. Every mount found for a path is a prefix of it segment
+// for segment, so this is all stripping the mount point takes.
+static size_t cfs_mount_relative(const cfs_fs_handle* fs) {
+	return fs->mount_length > 1 ? fs->mount_length + 1 : 1;
+}
+
+/*
+ * Merged index. In indexed mode every mount table refers to an index of all
+ * files of its mounts with index_fn, keyed by virtual path, so opening a file
+ * takes a single probe. Mounting a source adds its files to the index of the
+ * current table, which the new table then shares; readers of the old table
+ * may come across them, but only take records of mounts their own table
+ * lists at the recorded position. A path keeps the record of the first mount
+ * which has it, the one a walk over the mounts would find. Records are never
+ * removed, unmounting builds a new index. Records and replaced slot arrays
+ * are only freed with the index, so readers never touch freed memory. An
+ * index loaded from a snapshot keeps the snapshot mapped and searches its
+ * frozen records, which refer to mounts by position only, before its own.
+ */
+
+typedef struct cfs_index_record {
+	cfs_fs_handle* fs;
+	// Position of fs in the mounts of the table the record was added for.
+	size_t position;
+	long int id;
+	uint32_t hash;
+	size_t length;
+	char path[];
+} cfs_index_record;
+
+// Record of a snapshot, 8 byte aligned. Slots hold their offset in the file.
+typedef struct cfs_snapshot_record {
+	uint64_t position;
+	int64_t id;
+	uint32_t hash;
+	uint32_t length;
+	char path[];
+} cfs_snapshot_record;
+
+typedef struct cfs_index_slots {
+	size_t mask;
+	// The arrays this one replaced.
+	struct cfs_index_slots* next;
+	cfs_index_record* slots[];
+} cfs_index_slots;
+
+typedef struct cfs_index_chunk {
+	struct cfs_index_chunk* next;
+	size_t used;
+	size_t size;
+	char data[];
+} cfs_index_chunk;
+
+typedef struct cfs_index {
+	cfs_index_slots* slots;
+	size_t count;
+	cfs_index_chunk* chunks;
+	// Every mount with records, each holding a reference.
+	cfs_fs_handle** mounts;
+	size_t mount_count;
+	size_t mount_capacity;
+	// Tables sharing the index. Tables are only built and freed by writers.
+	unsigned int refs;
+	// The mapped snapshot and its slots, the first frozen_count mounts are
+	// those its records refer to.
+	const unsigned char* frozen;
+	size_t frozen_size;
+	const uint64_t* frozen_slots;
+	uint64_t frozen_mask;
+	size_t frozen_count;
+} cfs_index;
+
+typedef struct cfs_index_context {
+	cfs_index* index;
+	const cfs_mount_table* table;
+	cfs_fs_handle* fs;
+	size_t position;
+	size_t prefix;
+	char path[CFS_PATH_MAX];
+} cfs_index_context;
+
+static bool mount_indexed;
+
+static cfs_index_slots* cfs_index_slots_create(size_t capacity) {
+	cfs_index_slots* slots = cfs_malloc(sizeof(cfs_index_slots) + sizeof(cfs_index_record*) * capacity);
+
+	if(slots != NULL) {
+		memset(slots->slots, 0, sizeof(cfs_index_record*) * capacity);
+		slots->mask = capacity - 1;
+		slots->next = NULL;
+	}
+	return slots;
+}
+
+static cfs_index* cfs_index_create(void) {
+	cfs_index* index = cfs_malloc(sizeof(cfs_index));
+
+	if(index == NULL) {
+		return NULL;
+	}
+	memset(index, 0, sizeof(cfs_index));
+	index->refs = 1;
+	index->slots = cfs_index_slots_create(1024);
+	if(index->slots == NULL) {
+		cfs_free(index);
+		return NULL;
+	}
+	return index;
+}
+
+static void cfs_index_release(cfs_index* index) {
+	cfs_index_slots* slots;
+	cfs_index_chunk* chunk;
+	size_t i;
+
+	if(--index->refs != 0) {
+		return;
+	}
+	while((slots = index->slots) != NULL) {
+		index->slots = slots->next;
+		cfs_free(slots);
+	}
+	while((chunk = index->chunks) != NULL) {
+		index->chunks = chunk->next;
+		cfs_free(chunk);
+	}
+	for(i = 0; i < index->mount_count; i++) {
+		cfs_fs_handle_release(index->mounts[i]);
+	}
+	cfs_free(index->mounts);
+#ifdef CFS_POSIX
+	if(index->frozen != NULL) {
+		munmap((void*)index->frozen, index->frozen_size);
+	}
+#endif
+	cfs_free(index);
+}
+
+static bool cfs_index_valid(const cfs_mount_table* table, const cfs_index_record* record) {
+	return record->position < table->mount_count && table->mounts[record->position] == record->fs;
+}
+
+// The frozen record at offset, NULL if the slot is empty. The snapshot is
+// only trusted as far as its records lie inside the file.
+static const cfs_snapshot_record* cfs_index_frozen_record(const cfs_index* index, uint64_t offset) {
+	const cfs_snapshot_record* record;
+
+	if(offset == 0 || offset % 8 != 0 || offset > index->frozen_size - sizeof(cfs_snapshot_record)) {
+		return NULL;
+	}
+	record = (const cfs_snapshot_record*)(index->frozen + offset);
+	return record->length < index->frozen_size - offset - sizeof(cfs_snapshot_record) ? record : NULL;
+}
+
+static bool cfs_index_frozen_valid(const cfs_mount_table* table, const cfs_snapshot_record* record) {
+	return record->position < table->index->frozen_count && record->position < table->mount_count &&
+		table->mounts[record->position] == table->index->mounts[record->position];
+}
+
+// Finds the frozen record of path if it is valid for table.
+static const cfs_snapshot_record* cfs_index_find_frozen(const cfs_mount_table* table, const char* path, size_t length, uint32_t hash) {
+	const cfs_index* index = table->index;
+	const cfs_snapshot_record* record;
+	uint64_t i, n;
+
+	if(index->frozen == NULL) {
+		return NULL;
+	}
+	for(i = hash & index->frozen_mask, n = 0; n <= index->frozen_mask; i = (i + 1) & index->frozen_mask, n++) {
+		if((record = cfs_index_frozen_record(index, index->frozen_slots[i])) == NULL) {
+			return NULL;
+		}
+		if(record->hash == hash && record->length == length && memcmp(record->path, path, length) == 0) {
+			return cfs_index_frozen_valid(table, record) ? record : NULL;
+		}
+	}
+	return NULL;
+}
+
+// Finds the mount of a normalized absolute path for table and the id to open
+// it by, NULL if no indexed mount has it.
+static cfs_fs_handle* cfs_index_find(const cfs_mount_table* table, const char* path, size_t length, long int* id) {
+	const cfs_index_slots* slots = __atomic_load_n(&table->index->slots, __ATOMIC_ACQUIRE);
+	const cfs_index_record* record;
+	const cfs_snapshot_record* frozen;
+	uint32_t hash = cfs_hash(path, length);
+	size_t i;
+
+	if((frozen = cfs_index_find_frozen(table, path, length, hash)) != NULL) {
+		*id = (long int)frozen->id;
+		return table->mounts[frozen->position];
+	}
+	for(i = hash & slots->mask; (record = __atomic_load_n(&slots->slots[i], __ATOMIC_ACQUIRE)) != NULL; i = (i + 1) & slots->mask) {
+		if(record->hash == hash && record->length == length && memcmp(record->path, path, length) == 0) {
+			if(!cfs_index_valid(table, record)) {
+				return NULL;
+			}
+			*id = record->id;
+			return record->fs;
+		}
+	}
+	return NULL;
+}
+
+// Doubles the slot array once it is half full. The old one stays readable.
+static int cfs_index_grow(cfs_index* index) {
+	cfs_index_slots* old = index->slots;
+	cfs_index_slots* slots;
+	cfs_index_record* record;
+	size_t i, j;
+
+	if((index->count + 1) * 2 <= old->mask + 1) {
+		return 0;
+	}
+	slots = cfs_index_slots_create((old->mask + 1) * 2);
+	if(slots == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	for(i = 0; i <= old->mask; i++) {
+		if((record = old->slots[i]) != NULL) {
+			for(j = record->hash & slots->mask; slots->slots[j] != NULL; j = (j + 1) & slots->mask) {}
+			slots->slots[j] = record;
+		}
+	}
+	slots->next = old;
+	__atomic_store_n(&index->slots, slots, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static cfs_index_record* cfs_index_allocate(cfs_index* index, size_t size) {
+	cfs_index_chunk* chunk = index->chunks;
+	size_t capacity;
+	void* p;
+
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	if(chunk == NULL || chunk->size - chunk->used < size) {
+		capacity = size > 65536 ? size : 65536;
+		chunk = cfs_malloc(sizeof(cfs_index_chunk) + capacity);
+		if(chunk == NULL) {
+			return NULL;
+		}
+		chunk->next = index->chunks;
+		chunk->used = 0;
+		chunk->size = capacity;
+		index->chunks = chunk;
+	}
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+	return p;
+}
+
+// The cfs_fs_impl_index_entry index_fn reports to.
+static int cfs_index_add(void* context, const char* name, size_t length, long int id) {
+	cfs_index_context* ctx = context;
+	cfs_index* index = ctx->index;
+	cfs_index_record* record;
+	cfs_index_record* found;
+	cfs_index_slots* slots;
+	uint32_t hash;
+	size_t i;
+
+	// Paths which do not fit can not be opened anyway.
+	if(ctx->prefix + length >= sizeof(ctx->path)) {
+		return 0;
+	}
+	memcpy(ctx->path + ctx->prefix, name, length);
+	length += ctx->prefix;
+	hash = cfs_hash(ctx->path, length);
+	if(cfs_index_find_frozen(ctx->table, ctx->path, length, hash) != NULL) {
+		return 0;
+	}
+	if(cfs_index_grow(index) < 0) {
+		return CFS_ERRNOMEM;
+	}
+
+	slots = index->slots;
+	for(i = hash & slots->mask; (found = slots->slots[i]) != NULL; i = (i + 1) & slots->mask) {
+		if(found->hash == hash && found->length == length && memcmp(found->path, ctx->path, length) == 0) {
+			// Earlier mounts take precedence. Records of mounts which are
+			// gone, or never made it, are replaced.
+			if(cfs_index_valid(ctx->table, found)) {
+				return 0;
+			}
+			break;
+		}
+	}
+
+	record = cfs_index_allocate(index, sizeof(cfs_index_record) + length + 1);
+	if(record == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	record->fs = ctx->fs;
+	record->position = ctx->position;
+	record->id = id;
+	record->hash = hash;
+	record->length = length;
+	memcpy(record->path, ctx->path, length);
+	record->path[length] = '\0';
+	if(found == NULL) {
+		index->count++;
+	}
+	__atomic_store_n(&slots->slots[i], record, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// Adds the files of the mount at position in table to index.
+static int cfs_index_add_mount(cfs_index* index, const cfs_mount_table* table, size_t position) {
+	cfs_index_context ctx;
+	cfs_fs_handle** mounts;
+	cfs_fs_handle* fs = table->mounts[position];
+
+	if(index->mount_count == index->mount_capacity) {
+		size_t capacity = index->mount_capacity ? index->mount_capacity * 2 : 16;
+		mounts = cfs_realloc(index->mounts, sizeof(cfs_fs_handle*) * capacity);
+		if(mounts == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		index->mounts = mounts;
+		index->mount_capacity = capacity;
+	}
+	index->mounts[index->mount_count++] = fs;
+	cfs_fs_handle_retain(fs);
+
+	ctx.index = index;
+	ctx.table = table;
+	ctx.fs = fs;
+	ctx.position = position;
+	// Virtual paths of the mount's files are its point, a separator and the
+	// path relative to it.
+	ctx.prefix = cfs_mount_relative(fs);
+	memcpy(ctx.path, fs->mount, fs->mount_length);
+	ctx.path[ctx.prefix - 1] = '/';
+	return fs->handler->impl->index_fn(fs, cfs_index_add, &ctx) < 0 ? CFS_ERRNOMEM : 0;
+}
+
+// Gives table its index. Mounting appends the added mounts to the index of
+// current, anything else builds a new one.
+static int cfs_mount_table_index(cfs_mount_table* table, const cfs_mount_table* current, size_t added, const cfs_fs_handle* remove) {
+	size_t i;
+
+	if(current != NULL && current->index != NULL && added > 0 && remove == NULL) {
+		table->index = current->index;
+		table->index->refs++;
+		for(i = table->mount_count - added; i < table->mount_count; i++) {
+			if(table->mounts[i]->handler->impl->index_fn != NULL && cfs_index_add_mount(table->index, table, i) < 0) {
+				break;
+			}
+		}
+		if(i == table->mount_count) {
+			return 0;
+		}
+		cfs_index_release(table->index);
+	}
+
+	table->index = cfs_index_create();
+	if(table->index == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	for(i = 0; i < table->mount_count; i++) {
+		if(table->mounts[i]->handler->impl->index_fn != NULL && cfs_index_add_mount(table->index, table, i) < 0) {
+			return CFS_ERRNOMEM;
+		}
+	}
+	return 0;
+}
+
+static void cfs_mount_node_free(cfs_mount_node* node) {
+	size_t i;
+
+	for(i = 0; i < node->child_capacity; i++) {
+		if(node->children[i] != NULL) {
+			cfs_mount_node_free(node->children[i]);
+			cfs_free(node->children[i]);
+		}
+	}
+	cfs_free(node->children);
+	cfs_free(node->mounts);
+}
+
+static void cfs_mount_table_free(cfs_mount_table* table) {
+	size_t i;
+
+	cfs_mount_node_free(&table->root);
+	if(table->index != NULL) {
+		cfs_index_release(table->index);
+	}
+	for(i = 0; i < table->mount_count; i++) {
+		cfs_fs_handle_release(table->mounts[i]);
+	}
+	cfs_free(table->mounts);
+	cfs_free(table->interned);
+	cfs_free(table);
+}
+
+// Walks the first length bytes of a normalized absolute path down the trie
+// and returns the deepest node reached. A segment which was never interned
+// can not be part of any mount point, which ends the walk early. complete,
+// if given, is set if the walk got to the end.
+static const cfs_mount_node* cfs_mount_lookup(const cfs_mount_table* table, const char* path, size_t length, bool* complete) {
+	static const cfs_mount_node empty;
+	const cfs_mount_node* node;
+	const cfs_mount_node* child;
+	const cfs_path_segment* key;
+	cfs_path segment;
+	bool found = true;
+
+	if(table == NULL) {
+		if(complete != NULL) {
+			*complete = false;
+		}
+		return &empty;
+	}
+	node = &table->root;
+	if(cfs_path_get_first_segment(path, &segment)) {
+		do {
+			if(segment.end > path + length) {
+				break;
+			}
+			key = cfs_intern_find(table, segment.begin, segment.size, cfs_hash(segment.begin, segment.size));
+			if(key == NULL || (child = cfs_mount_node_find_child(node, key)) == NULL) {
+				found = false;
+				break;
+			}
+			node = child;
+		} while(cfs_path_get_next_segment(&segment));
+	}
+	if(complete != NULL) {
+		*complete = found;
+	}
+	return node;
+}
+
+// Splits the normalized mount point of handle into segments interned in
+// table. A handle interned before brings its segments along.
+static int cfs_mount_intern_segments(cfs_mount_table* table, cfs_fs_handle* handle) {
+	cfs_mount_handle* mount = cfs_mount_handle_of(handle);
+	const cfs_path_segment** segments;
+	cfs_path segment;
+	size_t count = 0;
+
+	if(mount->segments != NULL) {
+		for(count = 0; count < mount->segment_count; count++) {
+			const cfs_path_segment* seg = mount->segments[count];
+			if(cfs_intern_find(table, seg->name, seg->size, seg->hash) == NULL && cfs_intern_place(table, seg) < 0) {
+				return CFS_ERRNOMEM;
+			}
+		}
+		return 0;
+	}
+	if(!cfs_path_get_first_segment(handle->mount, &segment)) {
+		return 0;
+	}
+	do {
+		count++;
+	} while(cfs_path_get_next_segment(&segment));
+
+	segments = cfs_malloc(sizeof(cfs_path_segment*) * count);
+	if(segments == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	mount->segments = segments;
+	mount->segment_count = count = 0;
+	cfs_path_get_first_segment(handle->mount, &segment);
+	do {
+		segments[count] = cfs_intern(table, segment.begin, segment.size, cfs_hash(segment.begin, segment.size));
+		if(segments[count] == NULL) {
+			cfs_mount_release_segments(handle);
+			return CFS_ERRNOMEM;
+		}
+		__atomic_add_fetch(&((cfs_path_segment*)segments[count])->refs, 1, __ATOMIC_RELAXED);
+		mount->segment_count = ++count;
+	} while(cfs_path_get_next_segment(&segment));
+	return 0;
+}
+
+static int cfs_mount_table_insert(cfs_mount_table* table, cfs_fs_handle* fs) {
+	cfs_mount_handle* mount = cfs_mount_handle_of(fs);
+	cfs_mount_node* node;
+	cfs_mount_node* child;
+	size_t i;
+
+	if(cfs_mount_intern_segments(table, fs) < 0) {
+		return CFS_ERRNOMEM;
+	}
+	node = &table->root;
+	for(i = 0; i < mount->segment_count; i++) {
+		child = cfs_mount_node_find_child(node, mount->segments[i]);
+		if(child == NULL) {
+			child = cfs_mount_node_add_child(node, mount->segments[i]);
+			if(child == NULL) {
+				return CFS_ERRNOMEM;
+			}
+		}
+		node = child;
+	}
+	if(cfs_mount_node_add_mount_recursive(node, fs) < 0) {
+		return CFS_ERRNOMEM;
+	}
+	table->mounts[table->mount_count++] = fs;
+	cfs_fs_handle_retain(fs);
+	return 0;
+}
+
+// Builds the successor of the current table with the add_count mounts of add
+// mounted last and without remove. Only the segments of its mounts are
+// interned into it, so those of remove are dropped with the last table
+// using them. index, if given, is taken over as the index of the table.
+static cfs_mount_table* cfs_mount_table_build(const cfs_mount_table* current, cfs_fs_handle** add, size_t add_count, const cfs_fs_handle* remove, cfs_index* index) {
+	cfs_mount_table* table;
+	size_t count, i;
+
+	count = (current != NULL ? current->mount_count : 0) + add_count;
+	table = cfs_malloc(sizeof(cfs_mount_table));
+	if(table == NULL) {
+		if(index != NULL) {
+			cfs_index_release(index);
+		}
+		return NULL;
+	}
+	memset(table, 0, sizeof(cfs_mount_table));
+	table->index = index;
+	table->generation = ++mount_generation;
+	table->mounts = cfs_malloc(sizeof(cfs_fs_handle*) * (count > 0 ? count : 1));
+	if(table->mounts == NULL) {
+		cfs_mount_table_free(table);
+		return NULL;
+	}
+
+	// Kept mounts go first, so added ones share their segments.
+	for(i = 0; current != NULL && i < current->mount_count; i++) {
+		if(current->mounts[i] != remove && cfs_mount_table_insert(table, current->mounts[i]) < 0) {
+			cfs_mount_table_free(table);
+			return NULL;
+		}
+	}
+	for(i = 0; i < add_count; i++) {
+		if(cfs_mount_table_insert(table, add[i]) < 0) {
+			cfs_mount_table_free(table);
+			return NULL;
+		}
+	}
+
+	for(i = 0; i < table->mount_count; i++) {
+		if(table->mounts[i]->handler->impl->index_fn == NULL) {
+			table->unindexed++;
+		}
+	}
+	if(index == NULL && mount_indexed && cfs_mount_table_index(table, current, add_count, remove) < 0) {
+		cfs_mount_table_free(table);
+		return NULL;
+	}
+	return table;
+}
+
+// Publishes table and frees every replaced table no thread can still read.
+static void cfs_mount_table_publish(cfs_mount_table* table) {
+	cfs_mount_table* old;
+	cfs_mount_table** link;
+	cfs_thread* thread;
+	uint64_t oldest, epoch;
+
+	old = __atomic_exchange_n(&mount_table, table, __ATOMIC_SEQ_CST);
+	if(old != NULL) {
+		old->retired = __atomic_fetch_add(&mount_epoch, 1, __ATOMIC_SEQ_CST);
+		old->next = retired_tables;
+		retired_tables = old;
+	}
+
+	oldest = UINT64_MAX;
+	for(thread = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+		epoch = __atomic_load_n(&thread->epoch, __ATOMIC_SEQ_CST);
+		if(epoch != 0 && epoch < oldest) {
+			oldest = epoch;
+		}
+	}
+	link = &retired_tables;
+	while(*link != NULL) {
+		old = *link;
+		if(old->retired < oldest) {
+			*link = old->next;
+			cfs_mount_table_free(old);
+		} else {
+			link = &old->next;
+		}
+	}
+}
+
+#ifdef CFS_POSIX
+static int64_t cfs_stat_mtime(const struct stat* st) {
+#if defined(__APPLE__)
+	return (int64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+	return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Size and modification time in ns of src, false if it can not be stat'ed.
+static bool cfs_fs_fingerprint(const char* src, int64_t* size, int64_t* mtime) {
+	struct stat st;
+
+	if(stat(src, &st) < 0) {
+		*size = 0;
+		*mtime = 0;
+		return false;
+	}
+	*size = (int64_t)st.st_size;
+	*mtime = cfs_stat_mtime(&st);
+	return true;
+}
+#endif
+
+// Creates the handle of src at the normalized mount point, not mounted yet.
+// The fingerprint is taken first, so changes made while mounting show.
+static cfs_fs_handle* cfs_fs_handle_create(cfs_fs_handler* handler, const char* src, const char* point) {
+	cfs_mount_handle* mount = cfs_malloc(sizeof(cfs_mount_handle));
+	cfs_fs_handle* handle;
+
+	if(mount == NULL) {
+		return NULL;
+	}
+	memset(mount, 0, sizeof(cfs_mount_handle));
+	handle = &mount->fs;
+	handle->handler = handler;
+	handle->src = cfs_strdup(src);
+	handle->mount = cfs_strdup(point);
+	handle->mount_length = strlen(point);
+	mount->refs = 1;
+	if(handle->src == NULL || handle->mount == NULL) {
+		cfs_free((void*)handle->src);
+		cfs_free((void*)handle->mount);
+		cfs_free(handle);
+		return NULL;
+	}
+#ifdef CFS_POSIX
+	cfs_fs_fingerprint(src, &mount->src_size, &mount->src_mtime);
+#endif
+	return handle;
+}
+
+// Frees a handle whose source failed to mount.
+static void cfs_fs_handle_destroy(cfs_fs_handle* handle) {
+	cfs_free((void*)handle->src);
+	cfs_free((void*)handle->mount);
+	cfs_free(handle);
+}
+
+int cfs_fs_mount(const char* src, const char* mount) {
+	char point[CFS_PATH_MAX];
+	cfs_fs_handler* handler;
+	cfs_fs_handle* handle;
+	cfs_mount_table* table;
+	int err;
+
+	if(cfs_path_get_absolute("/", mount, point, sizeof(point)) >= sizeof(point)) {
+		return CFS_ERRNAMETOOLONG;
+	}
+
+	cfs_writer_lock();
+	handler = find_handler(src);
+	if(handler == NULL) {
+		cfs_writer_unlock();
+		return CFS_ERRNOHANDLER;
+	}
+	handle = cfs_fs_handle_create(handler, src, point);
+	if(handle == NULL) {
+		cfs_writer_unlock();
+		return CFS_ERRNOMEM;
+	}
+	if(handler->impl->mount_fn != NULL && (err = handler->impl->mount_fn(handle)) < 0) {
+		cfs_fs_handle_destroy(handle);
+		cfs_writer_unlock();
+		return err;
+	}
+
+	table = cfs_mount_table_build(mount_table, &handle, 1, NULL, NULL);
+	if(table != NULL) {
+		cfs_mount_table_publish(table);
+	}
+	// The table holds its own reference.
+	cfs_fs_handle_release(handle);
+	cfs_writer_unlock();
+	return table != NULL ? 0 : CFS_ERRNOMEM;
+}
+
+int cfs_fs_unmount(const char* src, const char* mount) {
+	char point[CFS_PATH_MAX];
+	cfs_fs_handle* found;
+	cfs_mount_table* table;
+	size_t i;
+
+	if(cfs_path_get_absolute("/", mount, point, sizeof(point)) >= sizeof(point)) {
+		return CFS_ERRNAMETOOLONG;
+	}
+
+	cfs_writer_lock();
+	found = NULL;
+	for(i = mount_table != NULL ? mount_table->mount_count : 0; i-- > 0;) {
+		cfs_fs_handle* fs = mount_table->mounts[i];
+		if(strcmp(fs->src, src) == 0 && strcmp(fs->mount, point) == 0) {
+			found = fs;
+			break;
+		}
+	}
+	if(found == NULL) {
+		cfs_writer_unlock();
+		return CFS_ERRNOENT;
+	}
+	table = cfs_mount_table_build(mount_table, NULL, 0, found, NULL);
+	if(table == NULL) {
+		cfs_writer_unlock();
+		return CFS_ERRNOMEM;
+	}
+	cfs_mount_table_publish(table);
+	cfs_writer_unlock();
+	return 0;
+}
+
+int cfs_fs_set_indexed(bool indexed) {
+	cfs_mount_table* table = NULL;
+	bool previous;
+
+	cfs_writer_lock();
+	previous = mount_indexed;
+	mount_indexed = indexed;
+	// Rebuild the current table with or without an index.
+	if(mount_table != NULL && previous != indexed) {
+		table = cfs_mount_table_build(mount_table, NULL, 0, NULL, NULL);
+		if(table == NULL) {
+			mount_indexed = previous;
+			cfs_writer_unlock();
+			return CFS_ERRNOMEM;
+		}
+		cfs_mount_table_publish(table);
+	}
+	cfs_writer_unlock();
+	return 0;
+}
+
+#ifdef CFS_POSIX
+/*
+ * Snapshots. A snapshot file starts with a cfs_snapshot_header and one
+ * cfs_snapshot_mount per mount in mount order, followed by the strings and
+ * backend states they refer to. In indexed mode the records of the merged
+ * index come next and then the index itself: its slot mask, its record
+ * count and the slots, each the offset of a record or 0. All references are
+ * offsets from the start of the file and everything is 8 byte aligned, so
+ * the file can be mapped anywhere and the index used in place. The layout is
+ * that of the machine which wrote it, the header rejects any other.
+ */
+
+#define CFS_SNAPSHOT_VERSION 2
+#define CFS_SNAPSHOT_ORDER 0x0102
+
+typedef struct cfs_snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint16_t order;
+	uint16_t long_size;
+	uint64_t size;
+	uint64_t mount_count;
+	// Offset of the index, 0 without one.
+	uint64_t index;
+} cfs_snapshot_header;
+
+typedef struct cfs_snapshot_mount {
+	uint64_t src;
+	uint64_t src_length;
+	uint64_t mount;
+	uint64_t mount_length;
+	// Saved by save_fn, state_size is 0 without.
+	uint64_t state;
+	uint64_t state_size;
+	int64_t src_size;
+	int64_t src_mtime;
+} cfs_snapshot_mount;
+
+typedef struct cfs_snapshot_writer {
+	int fd;
+	// Offset in the file the next byte ends up at.
+	uint64_t offset;
+	size_t used;
+	unsigned char buffer[65536];
+} cfs_snapshot_writer;
+
+static const char cfs_snapshot_magic[8] = "cfssnap";
+
+static int cfs_snapshot_write_at(int fd, const void* data, size_t size, uint64_t offset) {
+	const unsigned char* p = data;
+	ssize_t n;
+
+	while(size > 0) {
+		n = pwrite(fd, p, size, (off_t)offset);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return CFS_ERRIO;
+		}
+		p += n;
+		size -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return 0;
+}
+
+static int cfs_snapshot_flush(cfs_snapshot_writer* writer) {
+	int err = cfs_snapshot_write_at(writer->fd, writer->buffer, writer->used, writer->offset - writer->used);
+
+	writer->used = 0;
+	return err;
+}
+
+// The cfs_fs_impl_output save_fn writes through.
+static int cfs_snapshot_write(void* context, const void* data, size_t size) {
+	cfs_snapshot_writer* writer = context;
+	const unsigned char* p = data;
+	size_t n;
+	int err;
+
+	while(size > 0) {
+		if(writer->used == sizeof(writer->buffer) && (err = cfs_snapshot_flush(writer)) < 0) {
+			return err;
+		}
+		n = sizeof(writer->buffer) - writer->used;
+		n = n < size ? n : size;
+		memcpy(writer->buffer + writer->used, p, n);
+		writer->used += n;
+		writer->offset += n;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+static int cfs_snapshot_align(cfs_snapshot_writer* writer) {
+	static const unsigned char zero[8];
+
+	return cfs_snapshot_write(writer, zero, (size_t)(-writer->offset & 7));
+}
+
+// Writes a record and places it in slots.
+static int cfs_snapshot_save_record(cfs_snapshot_writer* writer, uint64_t* slots, size_t mask, uint64_t position, int64_t id, uint32_t hash, const char* path, size_t length) {
+	cfs_snapshot_record record;
+	size_t i;
+	int err;
+
+	for(i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {}
+	slots[i] = writer->offset;
+	memset(&record, 0, sizeof(record));
+	record.position = position;
+	record.id = id;
+	record.hash = hash;
+	record.length = (uint32_t)length;
+	if((err = cfs_snapshot_write(writer, &record, sizeof(record))) < 0 ||
+	   (err = cfs_snapshot_write(writer, path, length + 1)) < 0) {
+		return err;
+	}
+	return cfs_snapshot_align(writer);
+}
+
+// Writes the records of the index of table which are valid for it and then
+// a new index of them, whose offset is stored in offset. Writers only ever
+// add records for later positions to an index, which are not valid for
+// table, so the records found do not change meanwhile.
+static int cfs_snapshot_save_index(cfs_snapshot_writer* writer, const cfs_mount_table* table, uint64_t* offset) {
+	const cfs_index* index = table->index;
+	const cfs_index_slots* slots = __atomic_load_n(&index->slots, __ATOMIC_ACQUIRE);
+	const cfs_index_record* record;
+	const cfs_snapshot_record* frozen;
+	uint64_t* out;
+	uint64_t head[2];
+	size_t count, capacity, i;
+	int err = 0;
+
+	count = 0;
+	for(i = 0; index->frozen != NULL && i <= index->frozen_mask; i++) {
+		frozen = cfs_index_frozen_record(index, index->frozen_slots[i]);
+		count += frozen != NULL && cfs_index_frozen_valid(table, frozen);
+	}
+	for(i = 0; i <= slots->mask; i++) {
+		record = __atomic_load_n(&slots->slots[i], __ATOMIC_ACQUIRE);
+		count += record != NULL && cfs_index_valid(table, record);
+	}
+	for(capacity = 16; capacity < count * 2; capacity *= 2) {}
+	out = cfs_malloc(sizeof(uint64_t) * capacity);
+	if(out == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	memset(out, 0, sizeof(uint64_t) * capacity);
+
+	for(i = 0; index->frozen != NULL && i <= index->frozen_mask && err == 0; i++) {
+		frozen = cfs_index_frozen_record(index, index->frozen_slots[i]);
+		if(frozen != NULL && cfs_index_frozen_valid(table, frozen)) {
+			err = cfs_snapshot_save_record(writer, out, capacity - 1, frozen->position, frozen->id, frozen->hash, frozen->path, frozen->length);
+		}
+	}
+	for(i = 0; i <= slots->mask && err == 0; i++) {
+		record = __atomic_load_n(&slots->slots[i], __ATOMIC_ACQUIRE);
+		if(record != NULL && cfs_index_valid(table, record)) {
+			err = cfs_snapshot_save_record(writer, out, capacity - 1, record->position, record->id, record->hash, record->path, record->length);
+		}
+	}
+	if(err == 0) {
+		*offset = writer->offset;
+		head[0] = capacity - 1;
+		head[1] = count;
+		if((err = cfs_snapshot_write(writer, head, sizeof(head))) == 0) {
+			err = cfs_snapshot_write(writer, out, sizeof(uint64_t) * capacity);
+		}
+	}
+	cfs_free(out);
+	return err;
+}
+
+int cfs_snapshot_save(const char* filename) {
+	char temporary[CFS_PATH_MAX];
+	cfs_snapshot_header header;
+	cfs_snapshot_mount* mounts;
+	cfs_snapshot_writer* writer;
+	const cfs_mount_table* table;
+	cfs_fs_handle* fs;
+	size_t count, i;
+	int err = 0;
+
+	// Written next to filename and renamed over it, so loading never sees a
+	// partial snapshot.
+	if((size_t)snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", filename, (long)getpid()) >= sizeof(temporary)) {
+		return CFS_ERRNAMETOOLONG;
+	}
+	if((table = cfs_read_begin()) == NULL && cfs_err != CFS_ERRNOENT) {
+		return cfs_err;
+	}
+	count = table != NULL ? table->mount_count : 0;
+	writer = cfs_malloc(sizeof(cfs_snapshot_writer));
+	mounts = cfs_malloc(sizeof(cfs_snapshot_mount) * (count > 0 ? count : 1));
+	if(writer == NULL || mounts == NULL) {
+		err = CFS_ERRNOMEM;
+		goto done;
+	}
+	memset(&header, 0, sizeof(header));
+	memset(mounts, 0, sizeof(cfs_snapshot_mount) * count);
+	writer->fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(writer->fd < 0) {
+		err = CFS_ERRIO;
+		goto done;
+	}
+	// The header and mounts are written last, once their offsets are known.
+	writer->offset = sizeof(cfs_snapshot_header) + sizeof(cfs_snapshot_mount) * count;
+	writer->used = 0;
+
+	for(i = 0; i < count && err == 0; i++) {
+		fs = table->mounts[i];
+		mounts[i].src = writer->offset;
+		mounts[i].src_length = strlen(fs->src);
+		mounts[i].src_size = cfs_mount_handle_of(fs)->src_size;
+		mounts[i].src_mtime = cfs_mount_handle_of(fs)->src_mtime;
+		if((err = cfs_snapshot_write(writer, fs->src, mounts[i].src_length + 1)) < 0) {
+			break;
+		}
+		mounts[i].mount = writer->offset;
+		mounts[i].mount_length = fs->mount_length;
+		if((err = cfs_snapshot_write(writer, fs->mount, fs->mount_length + 1)) < 0 || (err = cfs_snapshot_align(writer)) < 0) {
+			break;
+		}
+		if(fs->handler->impl->save_fn != NULL) {
+			mounts[i].state = writer->offset;
+			if((err = fs->handler->impl->save_fn(fs, cfs_snapshot_write, writer)) < 0) {
+				break;
+			}
+			mounts[i].state_size = writer->offset - mounts[i].state;
+			err = cfs_snapshot_align(writer);
+		}
+	}
+	if(err == 0 && table != NULL && table->index != NULL) {
+		err = cfs_snapshot_save_index(writer, table, &header.index);
+	}
+	if(err == 0) {
+		err = cfs_snapshot_flush(writer);
+	}
+	if(err == 0) {
+		memcpy(header.magic, cfs_snapshot_magic, sizeof(header.magic));
+		header.version = CFS_SNAPSHOT_VERSION;
+		header.order = CFS_SNAPSHOT_ORDER;
+		header.long_size = sizeof(long int);
+		header.size = writer->offset;
+		header.mount_count = count;
+		err = cfs_snapshot_write_at(writer->fd, &header, sizeof(header), 0);
+	}
+	if(err == 0) {
+		err = cfs_snapshot_write_at(writer->fd, mounts, sizeof(cfs_snapshot_mount) * count, sizeof(header));
+	}
+	if(close(writer->fd) < 0 && err == 0) {
+		err = CFS_ERRIO;
+	}
+	if(err == 0 && rename(temporary, filename) < 0) {
+		err = CFS_ERRIO;
+	}
+	if(err < 0) {
+		unlink(temporary);
+	}
+
+done:
+	if(table != NULL) {
+		cfs_read_end();
+	}
+	cfs_free(writer);
+	cfs_free(mounts);
+	return err;
+}
+
+// Whether the terminated string of length bytes at offset lies in the file.
+static bool cfs_snapshot_string(const unsigned char* data, size_t size, uint64_t offset, uint64_t length) {
+	return offset < size && length < size - offset && length < CFS_PATH_MAX && data[offset + length] == '\0';
+}
+
+// An index taking over the mapped snapshot, whose records refer to the count
+// mounts at handles. NULL if the stored index is damaged or without memory.
+static cfs_index* cfs_snapshot_index(const unsigned char* data, size_t size, uint64_t offset, cfs_fs_handle** handles, size_t count) {
+	cfs_index* index;
+	uint64_t mask;
+	size_t i;
+
+	if(offset % 8 != 0 || offset > size - 16) {
+		return NULL;
+	}
+	mask = *(const uint64_t*)(data + offset);
+	if((mask & (mask + 1)) != 0 || mask >= (size - offset - 16) / sizeof(uint64_t)) {
+		return NULL;
+	}
+	index = cfs_index_create();
+	if(index == NULL) {
+		return NULL;
+	}
+	index->mounts = cfs_malloc(sizeof(cfs_fs_handle*) * count);
+	if(index->mounts == NULL) {
+		cfs_index_release(index);
+		return NULL;
+	}
+	for(i = 0; i < count; i++) {
+		index->mounts[i] = handles[i];
+		cfs_fs_handle_retain(handles[i]);
+	}
+	index->mount_count = count;
+	index->mount_capacity = count;
+	index->frozen = data;
+	index->frozen_size = size;
+	index->frozen_slots = (const uint64_t*)(data + offset + 16);
+	index->frozen_mask = mask;
+	index->frozen_count = count;
+	return index;
+}
+
+int cfs_snapshot_load(const char* filename) {
+	const cfs_snapshot_header* header;
+	const cfs_snapshot_mount* saved;
+	const unsigned char* data;
+	cfs_fs_handler* handler;
+	cfs_fs_handle** handles;
+	cfs_fs_handle* handle;
+	cfs_mount_handle* mount;
+	cfs_mount_table* table;
+	cfs_index* index = NULL;
+	char point[CFS_PATH_MAX];
+	struct stat st;
+	size_t size, count, frozen, n, i;
+	bool prefix, restored;
+	int fd, err = 0, mount_err;
+	void* map;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return errno == ENOENT ? CFS_ERRNOENT : CFS_ERRIO;
+	}
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(cfs_snapshot_header)) {
+		close(fd);
+		return CFS_ERRIO;
+	}
+	size = (size_t)st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		return CFS_ERRIO;
+	}
+	data = map;
+	header = map;
+	if(memcmp(header->magic, cfs_snapshot_magic, sizeof(header->magic)) != 0 || header->version != CFS_SNAPSHOT_VERSION ||
+	   header->order != CFS_SNAPSHOT_ORDER || header->long_size != sizeof(long int) || header->size != size ||
+	   header->mount_count > (size - sizeof(cfs_snapshot_header)) / sizeof(cfs_snapshot_mount)) {
+		munmap(map, size);
+		return CFS_ERRIO;
+	}
+	count = (size_t)header->mount_count;
+	saved = (const cfs_snapshot_mount*)(data + sizeof(cfs_snapshot_header));
+	handles = cfs_malloc(sizeof(cfs_fs_handle*) * (count > 0 ? count : 1));
+	if(handles == NULL) {
+		munmap(map, size);
+		return CFS_ERRNOMEM;
+	}
+
+	cfs_writer_lock();
+	// The saved index holds for the mounts up to the first one which is left
+	// out or read again, as long as they end up at the same positions. The
+	// files of the others are added to it as usual.
+	prefix = mount_table == NULL || mount_table->mount_count == 0;
+	frozen = 0;
+	n = 0;
+	for(i = 0; i < count; i++, saved++) {
+		// Mount points are stored normalized, as cfs_fs_mount left them.
+		if(!cfs_snapshot_string(data, size, saved->src, saved->src_length) ||
+		   !cfs_snapshot_string(data, size, saved->mount, saved->mount_length) ||
+		   cfs_path_get_absolute("/", (const char*)data + saved->mount, point, sizeof(point)) >= sizeof(point) ||
+		   strcmp(point, (const char*)data + saved->mount) != 0) {
+			err = err < 0 ? err : CFS_ERRIO;
+			prefix = false;
+			continue;
+		}
+		handler = find_handler((const char*)data + saved->src);
+		if(handler == NULL) {
+			err = err < 0 ? err : CFS_ERRNOHANDLER;
+			prefix = false;
+			continue;
+		}
+		handle = cfs_fs_handle_create(handler, (const char*)data + saved->src, (const char*)data + saved->mount);
+		if(handle == NULL) {
+			err = err < 0 ? err : CFS_ERRNOMEM;
+			prefix = false;
+			continue;
+		}
+		mount = cfs_mount_handle_of(handle);
+		restored = false;
+		if(handler->impl->load_fn != NULL && saved->state_size > 0 && saved->state <= size && saved->state_size <= size - saved->state &&
+		   mount->src_mtime != 0 && mount->src_size == saved->src_size && mount->src_mtime == saved->src_mtime) {
+			restored = handler->impl->load_fn(handle, data + saved->state, (size_t)saved->state_size) == 0;
+		}
+		if(!restored && handler->impl->mount_fn != NULL && (mount_err = handler->impl->mount_fn(handle)) < 0) {
+			cfs_fs_handle_destroy(handle);
+			err = err < 0 ? err : mount_err;
+			prefix = false;
+			continue;
+		}
+		handles[n++] = handle;
+		// Sources read again may report other ids.
+		if(prefix && (restored || handler->impl->index_fn == NULL)) {
+			frozen = n;
+		} else {
+			prefix = false;
+		}
+	}
+
+	if(frozen > 0 && mount_indexed && header->index != 0) {
+		index = cfs_snapshot_index(data, size, header->index, handles, frozen);
+	}
+	if(n > 0) {
+		table = cfs_mount_table_build(mount_table, handles, n, NULL, index);
+		for(i = frozen; table != NULL && index != NULL && i < n; i++) {
+			if(handles[i]->handler->impl->index_fn != NULL && cfs_index_add_mount(table->index, table, i) < 0) {
+				cfs_mount_table_free(table);
+				table = cfs_mount_table_build(mount_table, handles, n, NULL, NULL);
+				break;
+			}
+		}
+		if(table != NULL) {
+			cfs_mount_table_publish(table);
+		} else {
+			err = CFS_ERRNOMEM;
+		}
+	}
+	// The table holds its own references.
+	for(i = 0; i < n; i++) {
+		cfs_fs_handle_release(handles[i]);
+	}
+	cfs_writer_unlock();
+
+	// Otherwise the index owns the mapping now.
+	if(index == NULL) {
+		munmap(map, size);
+	}
+	cfs_free(handles);
+	return err;
+}
+#endif
+
+/*
+ * Buffered files.
+ *
+ * A cfs_file wraps the backend handle with a user space buffer, so parsers
+ * reading a few bytes at a time only reach the backend once per buffer. The
+ * buffer either holds read-ahead of which [begin, end) is still unread, or
+ * pending writes in [0, end), never both. Sequential refills double the
+ * read-ahead window up to the whole buffer, seeking resets it so random
+ * access does not pull in data it never uses. Requests at least as large as
+ * the buffer go straight to the backend.
+ */
+
+#define CFS_FILE_READAHEAD_MIN 4096
+
+enum {
+	CFS_FILE_IDLE,
+	CFS_FILE_READING,
+	CFS_FILE_WRITING
+};
+
+struct cfs_file {
+	cfs_file_handle* handle;
+	char* buffer;
+	size_t buffer_size;
+	size_t begin;
+	size_t end;
+	size_t window;
+	// Offset of the backend, -1 when unknown e.g. in append mode.
+	long int position;
+	int state;
+	// Whole file mapping from cfs_file_map, copied when owns_map is set.
+	const void* map;
+	size_t map_size;
+	bool owns_map;
+	bool owns_buffer;
+	bool append;
+	bool eof;
+	bool error;
+};
+
+static size_t cfs_file_min_window(const cfs_file* file) {
+	return file->buffer_size < CFS_FILE_READAHEAD_MIN ? file->buffer_size : CFS_FILE_READAHEAD_MIN;
+}
+
+// Allocates the buffer on first use. Without memory the file simply stays
+// unbuffered.
+static bool cfs_file_has_buffer(cfs_file* file) {
+	if(file->buffer == NULL && file->buffer_size > 0) {
+		file->buffer = cfs_pool_alloc(file->buffer_size);
+		if(file->buffer == NULL) {
+			file->buffer_size = 0;
+			file->window = 0;
+		}
+	}
+	return file->buffer_size > 0;
+}
+
+static long int cfs_file_backend_read(cfs_file* file, void* buffer, size_t size) {
+	cfs_file_handle* handle = file->handle;
+	long int n;
+
+	n = handle->fs_impl->handler->impl->read_fn(handle->fs_impl, handle, buffer, (long int)size);
+	if(n < 0) {
+		file->error = true;
+		return 0;
+	} else if(n == 0) {
+		file->eof = true;
+	} else if(file->position >= 0) {
+		file->position += n;
+	}
+	return n;
+}
+
+// Moves whenever data reached a backend, which voids the metadata cached by
+// cfs_file_stat. Stats started before see the old value.
+static uint64_t stat_epoch;
+
+static void cfs_file_written(void) {
+	__atomic_add_fetch(&stat_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+static size_t cfs_file_backend_write(cfs_file* file, const char* data, size_t size) {
+	cfs_file_handle* handle = file->handle;
+	size_t written = 0;
+	long int n;
+
+	while(written < size) {
+		n = handle->fs_impl->handler->impl->write_fn(handle->fs_impl, handle, (void*)(data + written), (long int)(size - written));
+		if(n <= 0) {
+			file->error = true;
+			break;
+		}
+		written += (size_t)n;
+	}
+	cfs_file_written();
+	if(file->append) {
+		file->position = -1;
+	} else if(file->position >= 0) {
+		file->position += (long int)written;
+	}
+	return written;
+}
+
+static long int cfs_file_backend_seek(cfs_file* file, long int offset, int whence) {
+	cfs_file_handle* handle = file->handle;
+	long int position;
+
+	// A failed seek is assumed to leave the backend where it was.
+	position = handle->fs_impl->handler->impl->seek_fn(handle->fs_impl, handle, offset, whence);
+	if(position < 0) {
+		return -1;
+	}
+	file->position = position;
+	return position;
+}
+
+// Hands unread read-ahead back to the backend by seeking over it, so its
+// offset matches what the caller has consumed.
+static int cfs_file_drop_read(cfs_file* file) {
+	size_t unread = file->end - file->begin;
+
+	file->begin = 0;
+	file->end = 0;
+	file->state = CFS_FILE_IDLE;
+	if(unread > 0 && cfs_file_backend_seek(file, -(long int)unread, CFS_SEEK_CUR) < 0) {
+		file->error = true;
+		file->position = -1;
+		return -1;
+	}
+	return 0;
+}
+
+int cfs_file_flush(cfs_file* file) {
+	size_t pending;
+
+	if(file->state == CFS_FILE_READING) {
+		return cfs_file_drop_read(file);
+	} else if(file->state == CFS_FILE_WRITING) {
+		pending = file->end;
+		file->end = 0;
+		file->state = CFS_FILE_IDLE;
+		if(cfs_file_backend_write(file, file->buffer, pending) != pending) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+long int cfs_file_read(cfs_file* file, void* buffer, long int sz) {
+	char* out = buffer;
+	size_t size, total, n, want;
+	long int got;
+
+	if(sz <= 0) {
+		return 0;
+	}
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return 0;
+	}
+
+	size = (size_t)sz;
+	total = 0;
+	while(total < size) {
+		if(file->begin < file->end) {
+			n = file->end - file->begin;
+			if(n > size - total) {
+				n = size - total;
+			}
+			memcpy(out + total, file->buffer + file->begin, n);
+			file->begin += n;
+			total += n;
+			continue;
+		}
+
+		file->begin = 0;
+		file->end = 0;
+		file->state = CFS_FILE_IDLE;
+		if(size - total >= file->buffer_size || !cfs_file_has_buffer(file)) {
+			if((got = cfs_file_backend_read(file, out + total, size - total)) == 0) {
+				break;
+			}
+			total += (size_t)got;
+			continue;
+		}
+
+		want = size - total > file->window ? size - total : file->window;
+		if((got = cfs_file_backend_read(file, file->buffer, want)) == 0) {
+			break;
+		}
+		file->end = (size_t)got;
+		file->state = CFS_FILE_READING;
+		if(file->window < file->buffer_size) {
+			file->window = file->window * 2 < file->buffer_size ? file->window * 2 : file->buffer_size;
+		}
+	}
+	return (long int)total;
+}
+
+long int cfs_file_write(cfs_file* file, void* buffer, long int sz) {
+	size_t size;
+
+	if(sz <= 0) {
+		return 0;
+	}
+	if(file->state == CFS_FILE_READING && cfs_file_drop_read(file) < 0) {
+		return 0;
+	}
+
+	size = (size_t)sz;
+	if(file->end + size > file->buffer_size) {
+		if(cfs_file_flush(file) < 0) {
+			return 0;
+		}
+	}
+	if(size >= file->buffer_size || !cfs_file_has_buffer(file)) {
+		return (long int)cfs_file_backend_write(file, buffer, size);
+	}
+
+	memcpy(file->buffer + file->end, buffer, size);
+	file->end += size;
+	file->state = CFS_FILE_WRITING;
+	return sz;
+}
+
+/*
+ * Vectored transfers. Small ones go through the buffer one vector at a time,
+ * which is also all backends without readv_fn/writev_fn get. Large ones hand
+ * the remaining vectors to the backend CFS_IOV_BATCH at a time, a read first
+ * drains the read-ahead and a write sends pending data in the same call.
+ */
+
+#define CFS_IOV_BATCH 64
+
+// Moves the cursor (index, skip) of iov forward by size bytes.
+static void cfs_iov_advance(const cfs_iovec* iov, int count, int* index, size_t* skip, size_t size) {
+	while(*index < count && size >= iov[*index].size - *skip) {
+		size -= iov[*index].size - *skip;
+		*skip = 0;
+		++*index;
+	}
+	if(*index < count) {
+		*skip += size;
+	}
+}
+
+// Fills batch with the vectors remaining after the cursor, returns the count.
+static int cfs_iov_batch(cfs_iovec* batch, int k, const cfs_iovec* iov, int count, int index, size_t skip) {
+	for(; index < count && k < CFS_IOV_BATCH; ++index, skip = 0) {
+		if(iov[index].size > skip) {
+			batch[k].base = (char*)iov[index].base + skip;
+			batch[k].size = iov[index].size - skip;
+			++k;
+		}
+	}
+	return k;
+}
+
+static size_t cfs_iov_remaining(const cfs_iovec* iov, int count, int index, size_t skip) {
+	size_t size = 0;
+
+	for(; index < count; ++index) {
+		size += iov[index].size;
+	}
+	return size - skip;
+}
+
+long int cfs_file_readv(cfs_file* file, const cfs_iovec* iov, int count) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	cfs_iovec batch[CFS_IOV_BATCH];
+	size_t skip, total, n;
+	long int got;
+	int index, k;
+
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return 0;
+	}
+
+	index = 0;
+	skip = 0;
+	total = 0;
+	while(index < count && file->begin < file->end) {
+		n = file->end - file->begin;
+		if(n > iov[index].size - skip) {
+			n = iov[index].size - skip;
+		}
+		memcpy((char*)iov[index].base + skip, file->buffer + file->begin, n);
+		file->begin += n;
+		total += n;
+		cfs_iov_advance(iov, count, &index, &skip, n);
+	}
+
+	if(impl->readv_fn == NULL || cfs_iov_remaining(iov, count, index, skip) < file->buffer_size) {
+		for(; index < count; ++index, skip = 0) {
+			n = (size_t)cfs_file_read(file, (char*)iov[index].base + skip, (long int)(iov[index].size - skip));
+			total += n;
+			if(n < iov[index].size - skip) {
+				break;
+			}
+		}
+		return (long int)total;
+	}
+
+	file->begin = 0;
+	file->end = 0;
+	file->state = CFS_FILE_IDLE;
+	while((k = cfs_iov_batch(batch, 0, iov, count, index, skip)) > 0) {
+		got = impl->readv_fn(handle->fs_impl, handle, batch, k);
+		if(got < 0) {
+			file->error = true;
+			break;
+		} else if(got == 0) {
+			file->eof = true;
+			break;
+		}
+		if(file->position >= 0) {
+			file->position += got;
+		}
+		total += (size_t)got;
+		cfs_iov_advance(iov, count, &index, &skip, (size_t)got);
+	}
+	return (long int)total;
+}
+
+long int cfs_file_writev(cfs_file* file, const cfs_iovec* iov, int count) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	cfs_iovec batch[CFS_IOV_BATCH];
+	size_t skip, total, pending, n;
+	long int got;
+	int index, k;
+
+	if(file->state == CFS_FILE_READING && cfs_file_drop_read(file) < 0) {
+		return 0;
+	}
+
+	if(impl->writev_fn == NULL || file->end + cfs_iov_remaining(iov, count, 0, 0) < file->buffer_size) {
+		total = 0;
+		for(index = 0; index < count; ++index) {
+			n = (size_t)cfs_file_write(file, iov[index].base, (long int)iov[index].size);
+			total += n;
+			if(n < iov[index].size) {
+				break;
+			}
+		}
+		return (long int)total;
+	}
+
+	index = 0;
+	skip = 0;
+	total = 0;
+	pending = 0;
+	for(;;) {
+		k = 0;
+		if(pending < file->end) {
+			batch[k].base = file->buffer + pending;
+			batch[k].size = file->end - pending;
+			++k;
+		}
+		if((k = cfs_iov_batch(batch, k, iov, count, index, skip)) == 0) {
+			break;
+		}
+		got = impl->writev_fn(handle->fs_impl, handle, batch, k);
+		if(got <= 0) {
+			file->error = true;
+			break;
+		}
+		if(file->append) {
+			file->position = -1;
+		} else if(file->position >= 0) {
+			file->position += got;
+		}
+		n = (size_t)got;
+		if(pending < file->end) {
+			size_t flushed = file->end - pending < n ? file->end - pending : n;
+			pending += flushed;
+			n -= flushed;
+		}
+		total += n;
+		cfs_iov_advance(iov, count, &index, &skip, n);
+	}
+	cfs_file_written();
+
+	file->end = 0;
+	file->state = CFS_FILE_IDLE;
+	return (long int)total;
+}
+
+int cfs_file_fseek(cfs_file* file, long int offset, int whence) {
+	long int start, target;
+
+	// Seeks inside the read-ahead only move the read position.
+	if(file->state == CFS_FILE_READING && file->position >= 0 && whence != CFS_SEEK_END) {
+		start = file->position - (long int)file->end;
+		target = whence == CFS_SEEK_SET ? offset : start + (long int)file->begin + offset;
+		if(target >= start && target <= file->position) {
+			file->begin = (size_t)(target - start);
+			file->eof = false;
+			return 0;
+		}
+	}
+
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return -1;
+	} else if(file->state == CFS_FILE_READING && whence == CFS_SEEK_CUR) {
+		offset -= (long int)(file->end - file->begin);
+	}
+	// The read-ahead is only dropped once the backend moved, a failed seek
+	// leaves the file as it was.
+	if(cfs_file_backend_seek(file, offset, whence) < 0) {
+		return -1;
+	}
+	file->begin = 0;
+	file->end = 0;
+	file->state = CFS_FILE_IDLE;
+	file->eof = false;
+	file->window = cfs_file_min_window(file);
+	return 0;
+}
+
+long int cfs_file_ftell(cfs_file* file) {
+	// Where appended data ends up is only known once it was written.
+	if(file->append && file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return -1;
+	}
+	if(file->position < 0 && cfs_file_backend_seek(file, 0, CFS_SEEK_CUR) < 0) {
+		return -1;
+	}
+	if(file->state == CFS_FILE_READING) {
+		return file->position - (long int)(file->end - file->begin);
+	} else if(file->state == CFS_FILE_WRITING) {
+		return file->position + (long int)file->end;
+	}
+	return file->position;
+}
+
+int cfs_file_setbuffer(cfs_file* file, char* buffer, size_t size) {
+	if(cfs_file_flush(file) < 0) {
+		return -1;
+	}
+	if(file->owns_buffer) {
+		cfs_pool_free(file->buffer, file->buffer_size);
+	}
+	file->buffer = size > 0 ? buffer : NULL;
+	file->buffer_size = size;
+	file->owns_buffer = buffer == NULL;
+	file->window = cfs_file_min_window(file);
+	return 0;
+}
+
+int cfs_file_eof(cfs_file* file) {
+	return file->eof;
+}
+
+int cfs_file_error(cfs_file* file) {
+	return file->error;
+}
+
+void cfs_file_clear_error(cfs_file* file) {
+	file->eof = false;
+	file->error = false;
+}
+
+// Reads the whole file into memory for backends which can not map it,
+// leaving the file position where it was.
+static int cfs_file_map_copy(cfs_file* file) {
+	long int position, size;
+	char* data;
+
+	if((position = cfs_file_ftell(file)) < 0 ||
+	   cfs_file_fseek(file, 0, CFS_SEEK_END) < 0 ||
+	   (size = cfs_file_ftell(file)) < 0 ||
+	   cfs_file_fseek(file, 0, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	data = cfs_malloc(size > 0 ? (size_t)size : 1);
+	if(data == NULL) {
+		cfs_file_fseek(file, position, CFS_SEEK_SET);
+		return CFS_ERRNOMEM;
+	}
+	if(cfs_file_read(file, data, size) != size) {
+		cfs_free(data);
+		cfs_file_fseek(file, position, CFS_SEEK_SET);
+		return CFS_ERRIO;
+	}
+	cfs_file_fseek(file, position, CFS_SEEK_SET);
+
+	file->map = data;
+	file->map_size = (size_t)size;
+	file->owns_map = true;
+	return 0;
+}
+
+int cfs_file_map(cfs_file* file, const void** data, size_t* size) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	int err;
+
+	if(file->map == NULL) {
+		// Pending writes have to be visible in the mapping.
+		if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+			return CFS_ERRIO;
+		}
+		if(impl->map_fn != NULL) {
+			if((err = impl->map_fn(handle->fs_impl, handle, &file->map, &file->map_size)) < 0) {
+				return err;
+			}
+			file->owns_map = false;
+		} else if((err = cfs_file_map_copy(file)) < 0) {
+			return err;
+		}
+	}
+	*data = file->map;
+	*size = file->map_size;
+	return 0;
+}
+
+void cfs_file_unmap(cfs_file* file) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+
+	if(file->map == NULL) {
+		return;
+	}
+	if(file->owns_map) {
+		cfs_free((void*)file->map);
+	} else if(impl->unmap_fn != NULL) {
+		impl->unmap_fn(handle->fs_impl, handle, file->map, file->map_size);
+	}
+	file->map = NULL;
+	file->map_size = 0;
+}
+
+long int cfs_file_read_at(cfs_file* file, void* buffer, long int sz, long int offset) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	long int position, n;
+
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return CFS_ERRIO;
+	}
+	if(impl->read_at_fn != NULL) {
+		n = impl->read_at_fn(handle->fs_impl, handle, buffer, sz, offset);
+		return n < 0 ? CFS_ERRIO : n;
+	}
+
+	if((position = cfs_file_ftell(file)) < 0 || cfs_file_fseek(file, offset, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	n = cfs_file_read(file, buffer, sz);
+	if(cfs_file_fseek(file, position, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	return n;
+}
+
+long int cfs_file_write_at(cfs_file* file, const void* buffer, long int sz, long int offset) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	long int position, n;
+
+	// Pending writes go first and read-ahead could be overwritten.
+	if(cfs_file_flush(file) < 0) {
+		return CFS_ERRIO;
+	}
+	if(impl->write_at_fn != NULL) {
+		n = impl->write_at_fn(handle->fs_impl, handle, buffer, sz, offset);
+		cfs_file_written();
+		return n < 0 ? CFS_ERRIO : n;
+	}
+
+	if((position = cfs_file_ftell(file)) < 0 || cfs_file_fseek(file, offset, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	n = cfs_file_write(file, (void*)buffer, sz);
+	if(cfs_file_flush(file) < 0 || cfs_file_fseek(file, position, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	return n;
+}
+
+// Flushes and releases everything file refers to, but not file itself.
+static int cfs_file_release(cfs_file* file) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_handle* fs = handle->fs_impl;
+	cfs_fs_impl* impl = fs->handler->impl;
+	int ret = 0;
+
+	cfs_file_unmap(file);
+	if(file->state == CFS_FILE_WRITING) {
+		ret = cfs_file_flush(file);
+	}
+	if(impl->close_fn != NULL && impl->close_fn(fs, handle) < 0) {
+		ret = -1;
+	}
+	if(file->owns_buffer) {
+		cfs_pool_free(file->buffer, file->buffer_size);
+	}
+	// Open files keep their source mounted.
+	cfs_fs_handle_release(fs);
+	return ret;
+}
+
+int cfs_file_close(cfs_file* file) {
+	int ret = cfs_file_release(file);
+
+	cfs_pool_free(file, sizeof(cfs_file));
+	return ret;
+}
+
+static void cfs_file_init(cfs_file* file, cfs_file_handle* handle, const char* mode) {
+	memset(file, 0, sizeof(cfs_file));
+	file->handle = handle;
+	cfs_fs_handle_retain(handle->fs_impl);
+	file->buffer_size = CFS_FILE_BUFFER_SIZE;
+	file->owns_buffer = true;
+	file->window = cfs_file_min_window(file);
+	file->append = strchr(mode, 'a') != NULL;
+	file->position = file->append ? -1 : 0;
+}
+
+/*
+ * Resolution cache. Every thread remembers, for the last paths it opened for
+ * reading, which mount they were found in or that none has them, so probing
+ * the same path again opens it in the right mount straight away or fails
+ * without asking any backend. A slot is only valid for the mount table it
+ * was filled from and while the cache epoch is unchanged. The epoch moves
+ * whenever a file is opened for writing through cfs, as that may create it,
+ * and on cfs_fs_invalidate.
+ */
+
+#define CFS_RESOLVE_PATH 104
+
+typedef struct cfs_resolve_slot {
+	// 0 while empty.
+	uint64_t generation;
+	uint64_t epoch;
+	// NULL if no mount has the path.
+	cfs_fs_handle* fs;
+	uint32_t hash;
+	uint32_t length;
+	char path[CFS_RESOLVE_PATH];
+} cfs_resolve_slot;
+
+static uint64_t resolve_epoch;
+
+void cfs_fs_invalidate(void) {
+	__atomic_add_fetch(&resolve_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+// Slot of the calling thread's cache for a normalized absolute path, NULL if
+// it can not be cached. hit is set if the slot holds the path for table. The
+// epoch is returned for cfs_resolve_store, taken before any backend is asked
+// so that a file created meanwhile voids what is stored.
+static cfs_resolve_slot* cfs_resolve_find(const cfs_mount_table* table, const char* path, size_t length, uint64_t* epoch, bool* hit) {
+	cfs_thread* thread = thread_self;
+	cfs_resolve_slot* slot;
+	uint32_t hash;
+
+	*hit = false;
+	if(table == NULL || length >= CFS_RESOLVE_PATH) {
+		return NULL;
+	}
+	if(thread->cache == NULL) {
+		thread->cache = cfs_malloc(sizeof(cfs_resolve_slot) * CFS_RESOLVE_CACHE_SIZE);
+		if(thread->cache == NULL) {
+			return NULL;
+		}
+		memset(thread->cache, 0, sizeof(cfs_resolve_slot) * CFS_RESOLVE_CACHE_SIZE);
+	}
+	hash = cfs_hash(path, length);
+	slot = &thread->cache[hash % CFS_RESOLVE_CACHE_SIZE];
+	*epoch = __atomic_load_n(&resolve_epoch, __ATOMIC_SEQ_CST);
+	*hit = slot->generation == table->generation && slot->epoch == *epoch &&
+		slot->hash == hash && slot->length == length && memcmp(slot->path, path, length) == 0;
+	return slot;
+}
+
+static void cfs_resolve_store(cfs_resolve_slot* slot, const cfs_mount_table* table, uint64_t epoch, const char* path, size_t length, cfs_fs_handle* fs) {
+	slot->generation = table->generation;
+	slot->epoch = epoch;
+	slot->fs = fs;
+	slot->hash = cfs_hash(path, length);
+	slot->length = (uint32_t)length;
+	memcpy(slot->path, path, length);
+}
+
+/*
+    Opening a file allocates nothing besides what the backend returns and the
+    cfs_file itself, its buffer is allocated on first use. Only the first open
+    on a thread allocates more: the thread's cfs_thread record, unless one left
+    by an exited thread is reused, and its resolution cache. The path is
+    normalized into a CFS_PATH_MAX stack buffer and the mount trie is walked
+    over that buffer in place; longer paths fail with CFS_ERRNAMETOOLONG.
+    Backends get a view into the same buffer with the mount point stripped.
+*/
+// Opens a normalized absolute path in fs. id is passed on to the backend.
+static cfs_file_handle* cfs_mount_open(cfs_fs_handle* fs, const char* path, size_t length, long int id, const char* mode) {
+	cfs_fs_path relative;
+	size_t offset = cfs_mount_relative(fs);
+
+	relative.name = path + offset;
+	relative.length = length - offset;
+	relative.hash = cfs_hash(relative.name, relative.length);
+	relative.id = id;
+	return fs->handler->impl->open_fn(fs, &relative, mode);
+}
+
+cfs_file* cfs_file_open(const char* filename, const char* mode) {
+	cfs_file_handle* handle = NULL;
+	cfs_file* file;
+	const cfs_mount_table* table;
+	const cfs_mount_node* node;
+	cfs_fs_handle* indexed = NULL;
+	cfs_resolve_slot* slot = NULL;
+	cfs_fs_path relative;
+	char path[CFS_PATH_MAX];
+	size_t length, skip, i;
+	long int id = -1;
+	uint64_t epoch = 0;
+	bool read_only, hit = false;
+	int previous;
+
+	// Resolve against the normalized absolute form so that '.' and '..'
+	// segments can not escape or confuse the mount lookup.
+	length = cfs_path_get_absolute("/", filename, path, sizeof(path));
+	if(length >= sizeof(path)) {
+		cfs_err = CFS_ERRNAMETOOLONG;
+		return NULL;
+	}
+	if((table = cfs_read_begin()) == NULL) {
+		return NULL;
+	}
+	read_only = mode[0] == 'r' && strchr(mode, '+') == NULL;
+	// Built in backends set cfs_err when they fail for another reason than
+	// the file not being there.
+	previous = cfs_err;
+	cfs_err = 0;
+
+	// With every mount indexed the index has the answer.
+	if(table != NULL && table->index != NULL) {
+		indexed = cfs_index_find(table, path, length, &id);
+		if(table->unindexed == 0) {
+			if(indexed != NULL) {
+				handle = cfs_mount_open(indexed, path, length, id, mode);
+			}
+			hit = true;
+		}
+	}
+	if(!hit && read_only) {
+		slot = cfs_resolve_find(table, path, length, &epoch, &hit);
+		if(hit && slot->fs != NULL) {
+			handle = cfs_mount_open(slot->fs, path, length, -1, mode);
+			// Resolve it for real if it vanished since.
+			hit = handle != NULL;
+		}
+	}
+
+	if(!hit) {
+		cfs_path_dirname(path, &i);
+		node = cfs_mount_lookup(table, path, i, NULL);
+
+		// Mounts at the same depth share the relative path.
+		skip = 0;
+		relative.id = -1;
+		for(i = 0; i < node->mount_count; i++) {
+			cfs_fs_handle* fs = node->mounts[i];
+			size_t offset = cfs_mount_relative(fs);
+			// The index knows which indexed mount, if any, has the path.
+			if(fs == indexed) {
+				handle = cfs_mount_open(fs, path, length, id, mode);
+				break;
+			} else if(table->index != NULL && fs->handler->impl->index_fn != NULL) {
+				continue;
+			}
+			if(offset != skip) {
+				skip = offset;
+				relative.name = path + offset;
+				relative.length = length - offset;
+				relative.hash = cfs_hash(relative.name, relative.length);
+			}
+			handle = fs->handler->impl->open_fn(fs, &relative, mode);
+			if(handle != NULL) {
+				break;
+			}
+		}
+		if(slot != NULL) {
+			cfs_resolve_store(slot, table, epoch, path, length, handle != NULL ? handle->fs_impl : NULL);
+		}
+	}
+	if(handle == NULL) {
+		cfs_read_end();
+		if(cfs_err == 0) {
+			cfs_err = CFS_ERRNOENT;
+		}
+		return NULL;
+	}
+	cfs_err = previous;
+	if(!read_only) {
+		cfs_fs_invalidate();
+	}
+
+	file = cfs_pool_alloc(sizeof(cfs_file));
+	if(file == NULL) {
+		if(handle->fs_impl->handler->impl->close_fn != NULL) {
+			handle->fs_impl->handler->impl->close_fn(handle->fs_impl, handle);
+		}
+		cfs_read_end();
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	cfs_file_init(file, handle, mode);
+	cfs_read_end();
+	return file;
+}
+
+/*
+ * Batched loading. All paths are resolved up front, asking backends with
+ * locate_fn where an entry lives without opening it. The entries are then
+ * sorted by mount and by their position inside its source, so every source
+ * is read front to back once instead of seeking back and forth in the order
+ * the caller happened to list the files in. Files are read through a
+ * cfs_file on the stack without a buffer, straight into their output.
+ */
+
+typedef struct cfs_read_entry {
+	size_t index;
+	cfs_fs_handle* fs;
+	cfs_fs_path path;
+	long int order;
+	long int size;
+	bool located;
+} cfs_read_entry;
+
+static int cfs_read_entry_compare(const void* a, const void* b) {
+	const cfs_read_entry* x = a;
+	const cfs_read_entry* y = b;
+
+	if(x->fs != y->fs) {
+		return (uintptr_t)x->fs < (uintptr_t)y->fs ? -1 : 1;
+	} else if(x->order != y->order) {
+		return x->order < y->order ? -1 : 1;
+	}
+	return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Reads all of file into a new allocation, size is its length if known or
+// negative otherwise.
+static int cfs_file_read_all(cfs_file* file, long int size, cfs_read_output* output) {
+	char* data;
+	long int n;
+
+	if(size < 0) {
+		if(cfs_file_fseek(file, 0, CFS_SEEK_END) < 0 ||
+		   (size = cfs_file_ftell(file)) < 0 ||
+		   cfs_file_fseek(file, 0, CFS_SEEK_SET) < 0) {
+			return CFS_ERRIO;
+		}
+	}
+	data = cfs_malloc(size > 0 ? (size_t)size : 1);
+	if(data == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	n = cfs_file_read(file, data, size);
+	if(n < size && cfs_file_error(file)) {
+		cfs_free(data);
+		return CFS_ERRIO;
+	}
+	output->data = data;
+	output->size = (size_t)n;
+	return 0;
+}
+
+static int cfs_read_entry_load(const cfs_read_entry* entry, const char* filename, cfs_read_output* output) {
+	cfs_file_handle* handle;
+	cfs_file file;
+	cfs_file* fallback;
+	int err;
+
+	handle = entry->fs->handler->impl->open_fn(entry->fs, &entry->path, "rb");
+	if(handle == NULL) {
+		// Without locate_fn the mount was only a guess, let the regular
+		// lookup try the others.
+		if(entry->located) {
+			return CFS_ERRIO;
+		}
+		if((fallback = cfs_file_open(filename, "rb")) == NULL) {
+			return CFS_ERRNOENT;
+		}
+		cfs_file_setbuffer(fallback, NULL, 0);
+		err = cfs_file_read_all(fallback, -1, output);
+		cfs_file_close(fallback);
+		return err;
+	}
+
+	cfs_file_init(&file, handle, "rb");
+	file.buffer_size = 0;
+	file.window = 0;
+	err = cfs_file_read_all(&file, entry->size, output);
+	cfs_file_release(&file);
+	return err;
+}
+
+int cfs_file_read_many(const char** paths, cfs_read_output* outputs, size_t n) {
+	cfs_read_entry* entries;
+	cfs_read_entry* entry;
+	const cfs_mount_table* table;
+	const cfs_mount_node* node;
+	cfs_fs_impl_locate locate;
+	char* arena;
+	char* path;
+	size_t total, count, length, dir, offset, i, j;
+	int loaded;
+
+	total = 0;
+	for(i = 0; i < n; i++) {
+		outputs[i].data = NULL;
+		outputs[i].size = 0;
+		outputs[i].error = CFS_ERRNOENT;
+		// The normalized absolute path is at most one byte longer.
+		total += strlen(paths[i]) + 2;
+	}
+	entries = cfs_malloc(sizeof(cfs_read_entry) * (n > 0 ? n : 1));
+	arena = cfs_malloc(total > 0 ? total : 1);
+	if(entries == NULL || arena == NULL) {
+		cfs_free(entries);
+		cfs_free(arena);
+		return CFS_ERRNOMEM;
+	}
+	// The mounts found stay valid while the entries are loaded.
+	if((table = cfs_read_begin()) == NULL) {
+		cfs_free(entries);
+		cfs_free(arena);
+		return cfs_err;
+	}
+
+	count = 0;
+	path = arena;
+	for(i = 0; i < n; i++) {
+		length = cfs_path_get_absolute("/", paths[i], path, (size_t)(arena + total - path));
+		cfs_path_dirname(path, &dir);
+		node = cfs_mount_lookup(table, path, dir, NULL);
+
+		entry = &entries[count];
+		entry->fs = NULL;
+		for(j = 0; j < node->mount_count; j++) {
+			cfs_fs_handle* fs = node->mounts[j];
+			offset = cfs_mount_relative(fs);
+			entry->path.name = path + offset;
+			entry->path.length = length - offset;
+			entry->path.hash = cfs_hash(entry->path.name, entry->path.length);
+			entry->path.id = -1;
+			entry->order = 0;
+			entry->size = -1;
+			locate = fs->handler->impl->locate_fn;
+			if(locate == NULL) {
+				entry->fs = fs;
+				entry->located = false;
+				break;
+			} else if(locate(fs, &entry->path, &entry->order, &entry->size) == 0) {
+				entry->fs = fs;
+				entry->located = true;
+				break;
+			}
+		}
+		if(entry->fs != NULL) {
+			entry->index = i;
+			count++;
+		}
+		path += length + 1;
+	}
+
+	qsort(entries, count, sizeof(cfs_read_entry), cfs_read_entry_compare);
+
+	loaded = 0;
+	for(i = 0; i < count; i++) {
+		entry = &entries[i];
+		outputs[entry->index].error = cfs_read_entry_load(entry, paths[entry->index], &outputs[entry->index]);
+		if(outputs[entry->index].error == 0) {
+			loaded++;
+		}
+	}
+	cfs_read_end();
+
+	cfs_free(entries);
+	cfs_free(arena);
+	return loaded;
+}
+
+
+
+/*
+ * Directories. Opening one collects its entries from every mount that
+ * intersects it: the mount points directly below it first, then every mount
+ * at or above it through enumerate_fn, in mount order. A name is only kept
+ * for the first source to report it, which is the one cfs_file_open resolves
+ * it to. Names are packed into one growing block and deduplicated through an
+ * open addressed table of entry indices, so listing costs a few reallocations
+ * however many entries there are.
+ */
+
+typedef struct cfs_dir_entry {
+	size_t name;
+	size_t length;
+	uint32_t hash;
+	int type;
+} cfs_dir_entry;
+
+struct cfs_dir {
+	char* names;
+	size_t names_size;
+	size_t names_capacity;
+	cfs_dir_entry* entries;
+	size_t entry_count;
+	size_t entry_capacity;
+	// Entry index + 1 per slot, 0 for empty ones.
+	uint32_t* table;
+	size_t table_capacity;
+	size_t next;
+};
+
+static void cfs_dir_place(cfs_dir* dir, size_t index) {
+	size_t mask = dir->table_capacity - 1;
+	size_t i = dir->entries[index].hash & mask;
+
+	while(dir->table[i] != 0) {
+		i = (i + 1) & mask;
+	}
+	dir->table[i] = (uint32_t)(index + 1);
+}
+
+static int cfs_dir_grow(cfs_dir* dir, size_t length) {
+	cfs_dir_entry* entries;
+	size_t capacity, i;
+	char* names;
+
+	if(dir->names_size + length + 1 > dir->names_capacity) {
+		capacity = dir->names_capacity ? dir->names_capacity : 4096;
+		while(capacity < dir->names_size + length + 1) {
+			capacity *= 2;
+		}
+		names = cfs_realloc(dir->names, capacity);
+		if(names == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		dir->names = names;
+		dir->names_capacity = capacity;
+	}
+	if(dir->entry_count == dir->entry_capacity) {
+		capacity = dir->entry_capacity ? dir->entry_capacity * 2 : 64;
+		entries = cfs_realloc(dir->entries, sizeof(cfs_dir_entry) * capacity);
+		if(entries == NULL) {
+			return CFS_ERRNOMEM;
+		}
+		dir->entries = entries;
+		dir->entry_capacity = capacity;
+	}
+	// Keep the load factor of the table at or below one half.
+	if((dir->entry_count + 1) * 2 > dir->table_capacity) {
+		capacity = dir->table_capacity ? dir->table_capacity * 2 : 128;
+		cfs_free(dir->table);
+		dir->table = cfs_malloc(sizeof(uint32_t) * capacity);
+		if(dir->table == NULL) {
+			dir->table_capacity = 0;
+			return CFS_ERRNOMEM;
+		}
+		memset(dir->table, 0, sizeof(uint32_t) * capacity);
+		dir->table_capacity = capacity;
+		for(i = 0; i < dir->entry_count; i++) {
+			cfs_dir_place(dir, i);
+		}
+	}
+	return 0;
+}
+
+// The cfs_fs_impl_entry every enumerate_fn reports to.
+static int cfs_dir_add(void* context, const char* name, size_t length, int type) {
+	cfs_dir* dir = context;
+	const cfs_dir_entry* other;
+	cfs_dir_entry* entry;
+	uint32_t hash;
+	size_t i;
+	int err;
+
+	if(length == 0 || (name[0] == '.' && (length == 1 || (length == 2 && name[1] == '.')))) {
+		return 0;
+	}
+	hash = cfs_hash(name, length);
+	if(dir->table_capacity > 0) {
+		for(i = hash & (dir->table_capacity - 1); dir->table[i] != 0; i = (i + 1) & (dir->table_capacity - 1)) {
+			other = &dir->entries[dir->table[i] - 1];
+			if(other->hash == hash && other->length == length && memcmp(dir->names + other->name, name, length) == 0) {
+				return 0;
+			}
+		}
+	}
+	if((err = cfs_dir_grow(dir, length)) < 0) {
+		return err;
+	}
+
+	entry = &dir->entries[dir->entry_count];
+	entry->name = dir->names_size;
+	entry->length = length;
+	entry->hash = hash;
+	entry->type = type;
+	memcpy(dir->names + dir->names_size, name, length);
+	dir->names[dir->names_size + length] = '\0';
+	dir->names_size += length + 1;
+	cfs_dir_place(dir, dir->entry_count++);
+	return 0;
+}
+
+cfs_dir* cfs_dir_open(const char* filename) {
+	const cfs_mount_table* table;
+	const cfs_mount_node* node;
+	cfs_fs_impl_enumerate enumerate;
+	cfs_fs_path relative;
+	char path[CFS_PATH_MAX];
+	size_t length, offset, i;
+	bool complete, found;
+	cfs_dir* dir;
+	int err = 0;
+
+	length = cfs_path_get_absolute("/", filename, path, sizeof(path));
+	if(length >= sizeof(path)) {
+		cfs_err = CFS_ERRNAMETOOLONG;
+		return NULL;
+	}
+	dir = cfs_malloc(sizeof(cfs_dir));
+	if(dir == NULL) {
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	memset(dir, 0, sizeof(cfs_dir));
+	if((table = cfs_read_begin()) == NULL) {
+		cfs_free(dir);
+		return NULL;
+	}
+	node = cfs_mount_lookup(table, path, length, &complete);
+
+	// Mount points below the directory show up as directories in it.
+	found = false;
+	for(i = 0; complete && err == 0 && i < node->child_capacity; i++) {
+		if(node->children[i] != NULL) {
+			err = cfs_dir_add(dir, node->children[i]->segment->name, node->children[i]->segment->size, CFS_DIRENT_DIRECTORY);
+			found = true;
+		}
+	}
+	for(i = 0; err == 0 && i < node->mount_count; i++) {
+		cfs_fs_handle* fs = node->mounts[i];
+		if((enumerate = fs->handler->impl->enumerate_fn) == NULL) {
+			continue;
+		}
+		// The directory may be the mount point itself.
+		offset = cfs_mount_relative(fs);
+		relative.name = offset < length ? path + offset : path + length;
+		relative.length = offset < length ? length - offset : 0;
+		relative.hash = cfs_hash(relative.name, relative.length);
+		relative.id = -1;
+		err = enumerate(fs, &relative, cfs_dir_add, dir);
+		if(err == 0) {
+			found = true;
+		} else if(err != CFS_ERRNOMEM) {
+			err = 0;
+		}
+	}
+	cfs_read_end();
+
+	if(err < 0 || !found) {
+		cfs_dir_close(dir);
+		cfs_err = err < 0 ? err : CFS_ERRNOENT;
+		return NULL;
+	}
+	return dir;
+}
+
+size_t cfs_dir_next(cfs_dir* dir, cfs_dirent* entries, size_t max) {
+	size_t n;
+
+	for(n = 0; n < max && dir->next < dir->entry_count; n++, dir->next++) {
+		entries[n].name = dir->names + dir->entries[dir->next].name;
+		entries[n].length = dir->entries[dir->next].length;
+		entries[n].type = dir->entries[dir->next].type;
+	}
+	return n;
+}
+
+int cfs_dir_close(cfs_dir* dir) {
+	cfs_free(dir->names);
+	cfs_free(dir->entries);
+	cfs_free(dir->table);
+	cfs_free(dir);
+	return 0;
+}
+
+/*
+ * Metadata. A path is resolved like cfs_file_open resolves it and stat_fn of
+ * the first mount which has it answers, backends without one are opened and
+ * sought instead. Every thread keeps the results of its last stats next to
+ * its resolution cache. A result is valid for the mount table it came from
+ * while neither the resolution epoch nor the stat epoch, which any write
+ * reaching a backend moves, has changed.
+ */
+
+typedef struct cfs_stat_slot {
+	// 0 while empty.
+	uint64_t generation;
+	uint64_t epoch;
+	uint64_t stat_epoch;
+	// 0 or CFS_ERRNOENT.
+	int result;
+	uint32_t hash;
+	uint32_t length;
+	cfs_stat info;
+	char path[CFS_RESOLVE_PATH];
+} cfs_stat_slot;
+
+// Slot of the calling thread's cache for a normalized absolute path like
+// cfs_resolve_find, epochs are stored in the returned slot on a miss.
+static cfs_stat_slot* cfs_stat_find(const cfs_mount_table* table, const char* path, size_t length, bool* hit) {
+	cfs_thread* thread = thread_self;
+	cfs_stat_slot* slot;
+	uint64_t epoch, written;
+	uint32_t hash;
+
+	*hit = false;
+	if(length >= CFS_RESOLVE_PATH) {
+		return NULL;
+	}
+	if(thread->stats == NULL) {
+		thread->stats = cfs_malloc(sizeof(cfs_stat_slot) * CFS_STAT_CACHE_SIZE);
+		if(thread->stats == NULL) {
+			return NULL;
+		}
+		memset(thread->stats, 0, sizeof(cfs_stat_slot) * CFS_STAT_CACHE_SIZE);
+	}
+	hash = cfs_hash(path, length);
+	slot = &thread->stats[hash % CFS_STAT_CACHE_SIZE];
+	epoch = __atomic_load_n(&resolve_epoch, __ATOMIC_SEQ_CST);
+	written = __atomic_load_n(&stat_epoch, __ATOMIC_SEQ_CST);
+	*hit = slot->generation == table->generation && slot->epoch == epoch && slot->stat_epoch == written &&
+		slot->hash == hash && slot->length == length && memcmp(slot->path, path, length) == 0;
+	if(!*hit) {
+		slot->generation = 0;
+		slot->epoch = epoch;
+		slot->stat_epoch = written;
+	}
+	return slot;
+}
+
+// Stats the file a backend without stat_fn opens for path.
+static int cfs_stat_open(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_stat* info) {
+	cfs_fs_impl* impl = fs->handler->impl;
+	cfs_file_handle* handle = impl->open_fn(fs, path, "rb");
+	long int size;
+
+	if(handle == NULL) {
+		return CFS_ERRNOENT;
+	}
+	size = impl->seek_fn(fs, handle, 0, CFS_SEEK_END);
+	if(impl->close_fn != NULL) {
+		impl->close_fn(fs, handle);
+	}
+	if(size < 0) {
+		return CFS_ERRIO;
+	}
+	info->size = size;
+	info->mtime = 0;
+	info->type = CFS_DIRENT_FILE;
+	return 0;
+}
+
+static int cfs_stat_resolve(const cfs_mount_table* table, const char* path, size_t length, cfs_stat* info) {
+	const cfs_mount_node* node;
+	cfs_fs_handle* indexed = NULL;
+	cfs_fs_handle* fs;
+	cfs_fs_path relative;
+	size_t offset, i;
+	long int id = -1;
+	bool complete;
+
+	if(table->index != NULL) {
+		indexed = cfs_index_find(table, path, length, &id);
+		// Directories are not indexed, files are only looked for in it.
+		if(indexed != NULL && table->unindexed == 0 && indexed->handler->impl->stat_fn != NULL) {
+			offset = cfs_mount_relative(indexed);
+			relative.name = path + offset;
+			relative.length = length - offset;
+			relative.hash = cfs_hash(relative.name, relative.length);
+			relative.id = id;
+			if(indexed->handler->impl->stat_fn(indexed, &relative, info) == 0) {
+				return 0;
+			}
+		}
+	}
+
+	// The path may be a mount point itself.
+	node = cfs_mount_lookup(table, path, length, &complete);
+	for(i = 0; i < node->mount_count; i++) {
+		fs = node->mounts[i];
+		offset = cfs_mount_relative(fs);
+		relative.name = offset < length ? path + offset : path + length;
+		relative.length = offset < length ? length - offset : 0;
+		relative.hash = cfs_hash(relative.name, relative.length);
+		relative.id = fs == indexed ? id : -1;
+		if(fs->handler->impl->stat_fn != NULL) {
+			if(fs->handler->impl->stat_fn(fs, &relative, info) == 0) {
+				return 0;
+			}
+		} else if(relative.length > 0 && cfs_stat_open(fs, &relative, info) == 0) {
+			return 0;
+		}
+	}
+	if(complete) {
+		info->size = 0;
+		info->mtime = 0;
+		info->type = CFS_DIRENT_DIRECTORY;
+		return 0;
+	}
+	return CFS_ERRNOENT;
+}
+
+int cfs_file_stat(const char* filename, cfs_stat* info) {
+	const cfs_mount_table* table;
+	cfs_stat_slot* slot;
+	char path[CFS_PATH_MAX];
+	size_t length;
+	bool hit;
+	int err;
+
+	length = cfs_path_get_absolute("/", filename, path, sizeof(path));
+	if(length >= sizeof(path)) {
+		return CFS_ERRNAMETOOLONG;
+	}
+	if((table = cfs_read_begin()) == NULL) {
+		return cfs_err;
+	}
+	slot = cfs_stat_find(table, path, length, &hit);
+	if(hit) {
+		err = slot->result;
+		if(err == 0) {
+			*info = slot->info;
+		}
+		cfs_read_end();
+		return err;
+	}
+	err = cfs_stat_resolve(table, path, length, info);
+	if(slot != NULL && (err == 0 || err == CFS_ERRNOENT)) {
+		slot->generation = table->generation;
+		slot->result = err;
+		slot->hash = cfs_hash(path, length);
+		slot->length = (uint32_t)length;
+		memcpy(slot->path, path, length);
+		if(err == 0) {
+			slot->info = *info;
+		}
+	}
+	cfs_read_end();
+	return err;
+}
+
+int cfs_file_fstat(cfs_file* file, cfs_stat* info) {
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	long int position, size;
+
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return CFS_ERRIO;
+	}
+	if(impl->fstat_fn != NULL) {
+		return impl->fstat_fn(handle->fs_impl, handle, info);
+	}
+	if((position = cfs_file_ftell(file)) < 0 || cfs_file_fseek(file, 0, CFS_SEEK_END) < 0 ||
+	   (size = cfs_file_ftell(file)) < 0 || cfs_file_fseek(file, position, CFS_SEEK_SET) < 0) {
+		return CFS_ERRIO;
+	}
+	info->size = size;
+	info->mtime = 0;
+	info->type = CFS_DIRENT_FILE;
+	return 0;
+}
+
+/*
+ * Asynchronous reads.
+ *
+ * Every queued read takes one of depth preallocated requests. When the file
+ * is a plain range of a descriptor (fd_fn) and io_uring is available the
+ * request becomes a submission queue entry, which go to the kernel in one
+ * io_uring_enter per submit. Anything else is handed to a pool of worker
+ * threads started on first use, which read with cfs_file_read_at and append
+ * the request to the completed list. Polling drains that list and the
+ * completion queue.
+ */
+
+typedef struct cfs_async_request {
+	cfs_file* file;
+	void* buffer;
+	long int size;
+	long int offset;
+	void* userdata;
+	long int result;
+#ifdef CFS_IO_URING
+	struct iovec iov;
+#endif
+	struct cfs_async_request* next;
+} cfs_async_request;
+
+struct cfs_async {
+	cfs_async_request* requests;
+	cfs_async_request* free;
+	cfs_async_request* done;
+	cfs_async_request* done_tail;
+	// Reads in flight in the ring and in the pool, including completed ones
+	// which were not returned yet.
+	unsigned int ring_count;
+	unsigned int pool_count;
+#ifdef CFS_IO_URING
+	int ring_fd;
+	unsigned int unsubmitted;
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+	unsigned int* sq_tail;
+	unsigned int* sq_mask;
+	unsigned int* sq_array;
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int* cq_mask;
+	struct io_uring_cqe* cqes;
+#endif
+#ifdef CFS_POSIX
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t completed;
+	// Serializes reads of backends without read_at_fn, which have to seek.
+	pthread_mutex_t serial;
+	pthread_t workers[CFS_ASYNC_WORKERS];
+	int worker_count;
+	bool stop;
+	cfs_async_request* queue;
+	cfs_async_request* queue_tail;
+#endif
+};
+
+static long int cfs_async_execute(cfs_async* async, cfs_async_request* req) {
+	cfs_file_handle* handle = req->file->handle;
+	long int result;
+
+#ifdef CFS_POSIX
+	if(handle->fs_impl->handler->impl->read_at_fn == NULL) {
+		pthread_mutex_lock(&async->serial);
+		result = cfs_file_read_at(req->file, req->buffer, req->size, req->offset);
+		pthread_mutex_unlock(&async->serial);
+		return result;
+	}
+#endif
+	(void)async;
+	(void)handle;
+	result = cfs_file_read_at(req->file, req->buffer, req->size, req->offset);
+	return result;
+}
+
+// Appends to the completed list, with the lock held when there are workers.
+static void cfs_async_complete(cfs_async* async, cfs_async_request* req) {
+	req->next = NULL;
+	if(async->done_tail != NULL) {
+		async->done_tail->next = req;
+	} else {
+		async->done = req;
+	}
+	async->done_tail = req;
+}
+
+#ifdef CFS_IO_URING
+static int cfs_async_ring_setup(cfs_async* async, unsigned int depth) {
+	struct io_uring_params params;
+	char* sq;
+	char* cq;
+
+	memset(&params, 0, sizeof(params));
+	async->ring_fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+	if(async->ring_fd < 0) {
+		return -1;
+	}
+
+	async->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	async->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		if(async->cq_ring_size > async->sq_ring_size) {
+			async->sq_ring_size = async->cq_ring_size;
+		}
+		async->cq_ring_size = 0;
+	}
+	async->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	async->sq_ring = mmap(NULL, async->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQ_RING);
+	if(async->sq_ring == MAP_FAILED) {
+		close(async->ring_fd);
+		async->ring_fd = -1;
+		return -1;
+	}
+	async->cq_ring = async->sq_ring;
+	if(async->cq_ring_size > 0) {
+		async->cq_ring = mmap(NULL, async->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_CQ_RING);
+		if(async->cq_ring == MAP_FAILED) {
+			munmap(async->sq_ring, async->sq_ring_size);
+			close(async->ring_fd);
+			async->ring_fd = -1;
+			return -1;
+		}
+	}
+	async->sqes = mmap(NULL, async->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, async->ring_fd, IORING_OFF_SQES);
+	if(async->sqes == MAP_FAILED) {
+		if(async->cq_ring_size > 0) {
+			munmap(async->cq_ring, async->cq_ring_size);
+		}
+		munmap(async->sq_ring, async->sq_ring_size);
+		close(async->ring_fd);
+		async->ring_fd = -1;
+		return -1;
+	}
+
+	sq = async->sq_ring;
+	cq = async->cq_ring;
+	async->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+	async->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	async->sq_array = (unsigned int*)(sq + params.sq_off.array);
+	async->cq_head = (unsigned int*)(cq + params.cq_off.head);
+	async->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+	async->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	async->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+	return 0;
+}
+
+static void cfs_async_ring_queue(cfs_async* async, cfs_async_request* req, int fd, long int base, long int limit) {
+	unsigned int tail = *async->sq_tail;
+	unsigned int index = tail & *async->sq_mask;
+	struct io_uring_sqe* sqe = &async->sqes[index];
+	long int size = req->size;
+
+	// The file may end before the descriptor does.
+	if(limit >= 0 && size > limit - req->offset) {
+		size = req->offset < limit ? limit - req->offset : 0;
+	}
+	req->iov.iov_base = req->buffer;
+	req->iov.iov_len = (size_t)size;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->off = (uint64_t)(base + req->offset);
+	sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+	sqe->len = 1;
+	sqe->user_data = (uint64_t)(uintptr_t)req;
+	async->sq_array[index] = index;
+	__atomic_store_n(async->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	async->unsubmitted++;
+}
+
+static int cfs_async_ring_enter(cfs_async* async, unsigned int wait) {
+	long int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, async->ring_fd, async->unsubmitted, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while(ret < 0 && errno == EINTR);
+	if(ret < 0) {
+		return CFS_ERRIO;
+	}
+	async->unsubmitted -= (unsigned int)ret;
+	return 0;
+}
+
+static int cfs_async_ring_reap(cfs_async* async, cfs_async_result* results, int max) {
+	unsigned int head = *async->cq_head;
+	unsigned int tail = __atomic_load_n(async->cq_tail, __ATOMIC_ACQUIRE);
+	cfs_async_request* req;
+	int n = 0;
+
+	while(head != tail && n < max) {
+		struct io_uring_cqe* cqe = &async->cqes[head & *async->cq_mask];
+		req = (cfs_async_request*)(uintptr_t)cqe->user_data;
+		results[n].userdata = req->userdata;
+		results[n].result = cqe->res < 0 ? CFS_ERRIO : cqe->res;
+		req->next = async->free;
+		async->free = req;
+		async->ring_count--;
+		++head;
+		++n;
+	}
+	__atomic_store_n(async->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+#endif
+
+#ifdef CFS_POSIX
+static void* cfs_async_worker(void* arg) {
+	cfs_async* async = arg;
+	cfs_async_request* req;
+
+	pthread_mutex_lock(&async->lock);
+	for(;;) {
+		while(async->queue == NULL && !async->stop) {
+			pthread_cond_wait(&async->work, &async->lock);
+		}
+		if(async->queue == NULL) {
+			break;
+		}
+		req = async->queue;
+		async->queue = req->next;
+		if(async->queue == NULL) {
+			async->queue_tail = NULL;
+		}
+		pthread_mutex_unlock(&async->lock);
+
+		req->result = cfs_async_execute(async, req);
+
+		pthread_mutex_lock(&async->lock);
+		cfs_async_complete(async, req);
+		pthread_cond_signal(&async->completed);
+	}
+	pthread_mutex_unlock(&async->lock);
+	return NULL;
+}
+
+static bool cfs_async_start_workers(cfs_async* async) {
+	while(async->worker_count < CFS_ASYNC_WORKERS) {
+		if(pthread_create(&async->workers[async->worker_count], NULL, cfs_async_worker, async) != 0) {
+			break;
+		}
+		async->worker_count++;
+	}
+	return async->worker_count > 0;
+}
+#endif
+
+cfs_async* cfs_async_create(unsigned int depth) {
+	cfs_async* async;
+	unsigned int i;
+
+	if(depth == 0) {
+		return NULL;
+	}
+	async = cfs_malloc(sizeof(cfs_async));
+	if(async == NULL) {
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	memset(async, 0, sizeof(cfs_async));
+	async->requests = cfs_malloc(sizeof(cfs_async_request) * depth);
+	if(async->requests == NULL) {
+		cfs_free(async);
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	for(i = 0; i < depth; i++) {
+		async->requests[i].next = i + 1 < depth ? &async->requests[i + 1] : NULL;
+	}
+	async->free = &async->requests[0];
+
+#ifdef CFS_IO_URING
+	// Without io_uring, e.g. on old kernels or under seccomp, every read
+	// goes to the worker pool.
+	cfs_async_ring_setup(async, depth);
+#endif
+#ifdef CFS_POSIX
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_mutex_init(&async->serial, NULL);
+	pthread_cond_init(&async->work, NULL);
+	pthread_cond_init(&async->completed, NULL);
+#endif
+	return async;
+}
+
+int cfs_async_read(cfs_async* async, cfs_file* file, void* buffer, long int sz, long int offset, void* userdata) {
+	cfs_async_request* req;
+#ifdef CFS_IO_URING
+	cfs_file_handle* handle = file->handle;
+	cfs_fs_impl* impl = handle->fs_impl->handler->impl;
+	long int base, limit;
+	int fd;
+#endif
+
+	if(async->free == NULL) {
+		return CFS_ERRBUSY;
+	}
+	// Reads bypass the buffer, so pending writes have to reach the backend.
+	if(file->state == CFS_FILE_WRITING && cfs_file_flush(file) < 0) {
+		return CFS_ERRIO;
+	}
+	req = async->free;
+	async->free = req->next;
+	req->file = file;
+	req->buffer = buffer;
+	req->size = sz;
+	req->offset = offset;
+	req->userdata = userdata;
+
+#ifdef CFS_IO_URING
+	if(async->ring_fd >= 0 && impl->fd_fn != NULL && impl->fd_fn(handle->fs_impl, handle, &fd, &base, &limit) == 0) {
+		cfs_async_ring_queue(async, req, fd, base, limit);
+		async->ring_count++;
+		return 0;
+	}
+#endif
+#ifdef CFS_POSIX
+	if(cfs_async_start_workers(async)) {
+		req->next = NULL;
+		pthread_mutex_lock(&async->lock);
+		if(async->queue_tail != NULL) {
+			async->queue_tail->next = req;
+		} else {
+			async->queue = req;
+		}
+		async->queue_tail = req;
+		async->pool_count++;
+		pthread_cond_signal(&async->work);
+		pthread_mutex_unlock(&async->lock);
+		return 0;
+	}
+#endif
+
+	// No way to do it asynchronously, the read completes right away.
+	req->result = cfs_async_execute(async, req);
+#ifdef CFS_POSIX
+	pthread_mutex_lock(&async->lock);
+	cfs_async_complete(async, req);
+	async->pool_count++;
+	pthread_mutex_unlock(&async->lock);
+#else
+	cfs_async_complete(async, req);
+	async->pool_count++;
+#endif
+	return 0;
+}
+
+int cfs_async_submit(cfs_async* async) {
+#ifdef CFS_IO_URING
+	if(async->ring_fd >= 0 && async->unsubmitted > 0) {
+		return cfs_async_ring_enter(async, 0);
+	}
+#endif
+	(void)async;
+	return 0;
+}
+
+int cfs_async_poll(cfs_async* async, cfs_async_result* results, int max) {
+	cfs_async_request* req;
+	int n = 0;
+
+	cfs_async_submit(async);
+#ifdef CFS_POSIX
+	pthread_mutex_lock(&async->lock);
+#endif
+	while(n < max && (req = async->done) != NULL) {
+		async->done = req->next;
+		if(async->done == NULL) {
+			async->done_tail = NULL;
+		}
+		results[n].userdata = req->userdata;
+		results[n].result = req->result;
+		req->next = async->free;
+		async->free = req;
+		async->pool_count--;
+		++n;
+	}
+#ifdef CFS_POSIX
+	pthread_mutex_unlock(&async->lock);
+#endif
+#ifdef CFS_IO_URING
+	if(async->ring_fd >= 0 && n < max) {
+		n += cfs_async_ring_reap(async, results + n, max - n);
+	}
+#endif
+	return n;
+}
+
+int cfs_async_wait(cfs_async* async, cfs_async_result* results, int min, int max) {
+	int n = 0;
+
+	if(min > max) {
+		min = max;
+	}
+	for(;;) {
+		n += cfs_async_poll(async, results + n, max - n);
+		if(n >= min || async->ring_count + async->pool_count == 0) {
+			return n;
+		}
+#ifdef CFS_IO_URING
+		// Block in the kernel only when the pool has nothing to deliver.
+		if(async->ring_count > 0 && async->pool_count == 0) {
+			if(cfs_async_ring_enter(async, 1) < 0) {
+				return n;
+			}
+			continue;
+		}
+#endif
+#ifdef CFS_POSIX
+		pthread_mutex_lock(&async->lock);
+		if(async->done == NULL) {
+			if(async->ring_count > 0) {
+				// Both have reads in flight, look at the ring again shortly.
+				struct timespec deadline;
+				clock_gettime(CLOCK_REALTIME, &deadline);
+				deadline.tv_nsec += 100000;
+				if(deadline.tv_nsec >= 1000000000) {
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000;
+				}
+				pthread_cond_timedwait(&async->completed, &async->lock, &deadline);
+			} else {
+				pthread_cond_wait(&async->completed, &async->lock);
+			}
+		}
+		pthread_mutex_unlock(&async->lock);
+#endif
+	}
+}
+
+void cfs_async_destroy(cfs_async* async) {
+	cfs_async_result results[64];
+	int i;
+
+	while(async->ring_count + async->pool_count > 0) {
+		// Nothing comes back only when the ring failed to enter, its reads
+		// are dropped with it below.
+		if(cfs_async_wait(async, results, 1, 64) == 0) {
+			break;
+		}
+	}
+#ifdef CFS_POSIX
+	pthread_mutex_lock(&async->lock);
+	async->stop = true;
+	pthread_cond_broadcast(&async->work);
+	pthread_mutex_unlock(&async->lock);
+	for(i = 0; i < async->worker_count; i++) {
+		pthread_join(async->workers[i], NULL);
+	}
+	pthread_mutex_destroy(&async->lock);
+	pthread_mutex_destroy(&async->serial);
+	pthread_cond_destroy(&async->work);
+	pthread_cond_destroy(&async->completed);
+#endif
+#ifdef CFS_IO_URING
+	if(async->ring_fd >= 0) {
+		munmap(async->sqes, async->sqes_size);
+		if(async->cq_ring_size > 0) {
+			munmap(async->cq_ring, async->cq_ring_size);
+		}
+		munmap(async->sq_ring, async->sq_ring_size);
+		close(async->ring_fd);
+	}
+#endif
+	(void)i;
+	cfs_free(async->requests);
+	cfs_free(async);
+}
+
+#ifdef CFS_POSIX
+/*
+ * Built in POSIX backend. A mount keeps a descriptor of its source directory
+ * and opens files relative to it, so the already normalized path is used as
+ * is. Every handle tracks its own offset and transfers with pread/pwrite,
+ * seeking never reaches the kernel and positional reads from several threads
+ * do not race on a shared file offset.
+ */
+
+// cfs_iovec arrays are passed to the kernel as they are.
+_Static_assert(sizeof(cfs_iovec) == sizeof(struct iovec) &&
+	offsetof(cfs_iovec, base) == offsetof(struct iovec, iov_base) &&
+	offsetof(cfs_iovec, size) == offsetof(struct iovec, iov_len), "cfs_iovec must match struct iovec");
+
+typedef struct cfs_posix_file {
+	cfs_file_handle handle;
+	int fd;
+	bool append;
+	long int offset;
+} cfs_posix_file;
+
+static int cfs_posix_mount(cfs_fs_handle* fs) {
+	int fd = open(fs->src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		return CFS_ERRIO;
+	}
+	fs->userdata = (void*)(intptr_t)fd;
+	return 0;
+}
+
+static void cfs_posix_unmount(cfs_fs_handle* fs) {
+	close((int)(intptr_t)fs->userdata);
+}
+
+static cfs_file_handle* cfs_posix_open(cfs_fs_handle* fs, const cfs_fs_path* path, const char* mode) {
+	cfs_posix_file* file;
+	struct stat st;
+	int flags, fd;
+
+	switch(mode[0]) {
+		case 'r':
+			flags = strchr(mode, '+') ? O_RDWR : O_RDONLY;
+		break;
+		case 'w':
+			flags = (strchr(mode, '+') ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+		break;
+		case 'a':
+			flags = (strchr(mode, '+') ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+		break;
+		default:
+			return NULL;
+	}
+
+	fd = openat((int)(intptr_t)fs->userdata, path->name, flags | O_CLOEXEC, 0666);
+	if(fd < 0) {
+		// Anything but a missing file is worth reporting.
+		if(errno != ENOENT && errno != ENOTDIR && errno != EISDIR) {
+			cfs_err = CFS_ERRIO;
+		}
+		return NULL;
+	}
+	// Directories and devices open fine read only, but are not files.
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return NULL;
+	}
+	file = cfs_pool_alloc(sizeof(cfs_posix_file));
+	if(file == NULL) {
+		close(fd);
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	file->handle.handle = file;
+	file->handle.fs_impl = fs;
+	file->fd = fd;
+	file->append = (flags & O_APPEND) != 0;
+	file->offset = file->append ? (long int)lseek(fd, 0, SEEK_END) : 0;
+	return &file->handle;
+}
+
+static int cfs_posix_locate(cfs_fs_handle* fs, const cfs_fs_path* path, long int* order, long int* size) {
+	struct stat st;
+
+	if(fstatat((int)(intptr_t)fs->userdata, path->name, &st, 0) < 0 || !S_ISREG(st.st_mode)) {
+		return CFS_ERRNOENT;
+	}
+	// The inode number is the best hint at where the file is on disk.
+	*order = (long int)st.st_ino;
+	*size = (long int)st.st_size;
+	return 0;
+}
+
+static void cfs_posix_info(const struct stat* st, cfs_stat* info) {
+	info->size = S_ISDIR(st->st_mode) ? 0 : (long int)st->st_size;
+	info->mtime = cfs_stat_mtime(st);
+	info->type = S_ISDIR(st->st_mode) ? CFS_DIRENT_DIRECTORY : CFS_DIRENT_FILE;
+}
+
+static int cfs_posix_stat(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_stat* info) {
+	struct stat st;
+
+	if(fstatat((int)(intptr_t)fs->userdata, path->length > 0 ? path->name : ".", &st, 0) < 0) {
+		return CFS_ERRNOENT;
+	}
+	cfs_posix_info(&st, info);
+	return 0;
+}
+
+static int cfs_posix_fstat(cfs_fs_handle* fs, cfs_file_handle* handle, cfs_stat* info) {
+	cfs_posix_file* file = handle->handle;
+	struct stat st;
+
+	if(fstat(file->fd, &st) < 0) {
+		return CFS_ERRIO;
+	}
+	cfs_posix_info(&st, info);
+	return 0;
+}
+
+static int cfs_posix_enumerate(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_fs_impl_entry entry, void* context) {
+	struct dirent* ent;
+	struct stat st;
+	DIR* dir;
+	int fd, type, err = 0;
+
+	fd = openat((int)(intptr_t)fs->userdata, path->length > 0 ? path->name : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		return CFS_ERRNOENT;
+	}
+	dir = fdopendir(fd);
+	if(dir == NULL) {
+		close(fd);
+		return CFS_ERRIO;
+	}
+	while(err >= 0 && (ent = readdir(dir)) != NULL) {
+		type = ent->d_type == DT_DIR ? CFS_DIRENT_DIRECTORY : CFS_DIRENT_FILE;
+		// Not every file system reports types and links are followed on open.
+		if((ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) &&
+		   fstatat(dirfd(dir), ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode)) {
+			type = CFS_DIRENT_DIRECTORY;
+		}
+		err = entry(context, ent->d_name, strlen(ent->d_name), type);
+	}
+	closedir(dir);
+	return err < 0 ? err : 0;
+}
+
+static int cfs_posix_close(cfs_fs_handle* fs, cfs_file_handle* handle) {
+	cfs_posix_file* file = handle->handle;
+	int ret = close(file->fd);
+
+	cfs_pool_free(file, sizeof(cfs_posix_file));
+	return ret < 0 ? CFS_ERRIO : 0;
+}
+
+static long int cfs_posix_read_at(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz, long int offset) {
+	cfs_posix_file* file = handle->handle;
+	ssize_t n;
+
+	do {
+		n = pread(file->fd, buffer, (size_t)sz, (off_t)offset);
+	} while(n < 0 && errno == EINTR);
+	return (long int)n;
+}
+
+static long int cfs_posix_write_at(cfs_fs_handle* fs, cfs_file_handle* handle, const void* buffer, long int sz, long int offset) {
+	cfs_posix_file* file = handle->handle;
+	ssize_t n;
+
+	do {
+		n = pwrite(file->fd, buffer, (size_t)sz, (off_t)offset);
+	} while(n < 0 && errno == EINTR);
+	return (long int)n;
+}
+
+static long int cfs_posix_readv(cfs_fs_handle* fs, cfs_file_handle* handle, const cfs_iovec* iov, int count) {
+	cfs_posix_file* file = handle->handle;
+	ssize_t n;
+
+	do {
+		n = preadv(file->fd, (const struct iovec*)iov, count, (off_t)file->offset);
+	} while(n < 0 && errno == EINTR);
+	if(n > 0) {
+		file->offset += (long int)n;
+	}
+	return (long int)n;
+}
+
+static long int cfs_posix_writev(cfs_fs_handle* fs, cfs_file_handle* handle, const cfs_iovec* iov, int count) {
+	cfs_posix_file* file = handle->handle;
+	ssize_t n;
+
+	do {
+		if(file->append) {
+			n = writev(file->fd, (const struct iovec*)iov, count);
+		} else {
+			n = pwritev(file->fd, (const struct iovec*)iov, count, (off_t)file->offset);
+		}
+	} while(n < 0 && errno == EINTR);
+	if(n > 0) {
+		file->offset = file->append ? (long int)lseek(file->fd, 0, SEEK_CUR) : file->offset + (long int)n;
+	}
+	return (long int)n;
+}
+
+static long int cfs_posix_read(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	cfs_posix_file* file = handle->handle;
+	long int n = cfs_posix_read_at(fs, handle, buffer, sz, file->offset);
+
+	if(n > 0) {
+		file->offset += n;
+	}
+	return n;
+}
+
+static long int cfs_posix_write(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	cfs_posix_file* file = handle->handle;
+	ssize_t n;
+
+	if(!file->append) {
+		n = cfs_posix_write_at(fs, handle, buffer, sz, file->offset);
+		if(n > 0) {
+			file->offset += n;
+		}
+		return (long int)n;
+	}
+
+	// pwrite ignores the offset of O_APPEND descriptors on some systems, so
+	// appends go through write and pick up the new end afterwards.
+	do {
+		n = write(file->fd, buffer, (size_t)sz);
+	} while(n < 0 && errno == EINTR);
+	if(n > 0) {
+		file->offset = (long int)lseek(file->fd, 0, SEEK_CUR);
+	}
+	return (long int)n;
+}
+
+static long int cfs_posix_seek(cfs_fs_handle* fs, cfs_file_handle* handle, long int offset, int whence) {
+	cfs_posix_file* file = handle->handle;
+	struct stat st;
+	long int base;
+
+	switch(whence) {
+		case CFS_SEEK_SET:
+			base = 0;
+		break;
+		case CFS_SEEK_CUR:
+			base = file->offset;
+		break;
+		case CFS_SEEK_END:
+			if(fstat(file->fd, &st) < 0) {
+				return -1;
+			}
+			base = (long int)st.st_size;
+		break;
+		default:
+			return -1;
+	}
+	if(base + offset < 0) {
+		return -1;
+	}
+	file->offset = base + offset;
+	return file->offset;
+}
+
+static int cfs_posix_map(cfs_fs_handle* fs, cfs_file_handle* handle, const void** data, size_t* size) {
+	cfs_posix_file* file = handle->handle;
+	struct stat st;
+	void* map;
+
+	if(fstat(file->fd, &st) < 0) {
+		return CFS_ERRIO;
+	}
+	// Empty files can not be mapped but have nothing to point at anyway.
+	if(st.st_size == 0) {
+		*data = "";
+		*size = 0;
+		return 0;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+	if(map == MAP_FAILED) {
+		return CFS_ERRIO;
+	}
+	*data = map;
+	*size = (size_t)st.st_size;
+	return 0;
+}
+
+static int cfs_posix_fd(cfs_fs_handle* fs, cfs_file_handle* handle, int* fd, long int* base, long int* size) {
+	cfs_posix_file* file = handle->handle;
+
+	*fd = file->fd;
+	*base = 0;
+	*size = -1;
+	return 0;
+}
+
+static void cfs_posix_unmap(cfs_fs_handle* fs, cfs_file_handle* handle, const void* data, size_t size) {
+	if(size > 0) {
+		munmap((void*)data, size);
+	}
+}
+
+static cfs_fs_impl cfs_posix_impl = {
+	.open_fn = cfs_posix_open,
+	.seek_fn = cfs_posix_seek,
+	.read_fn = cfs_posix_read,
+	.write_fn = cfs_posix_write,
+	.map_fn = cfs_posix_map,
+	.unmap_fn = cfs_posix_unmap,
+	.read_at_fn = cfs_posix_read_at,
+	.write_at_fn = cfs_posix_write_at,
+	.readv_fn = cfs_posix_readv,
+	.writev_fn = cfs_posix_writev,
+	.fd_fn = cfs_posix_fd,
+	.locate_fn = cfs_posix_locate,
+	.stat_fn = cfs_posix_stat,
+	.fstat_fn = cfs_posix_fstat,
+	.enumerate_fn = cfs_posix_enumerate,
+	.close_fn = cfs_posix_close,
+	.mount_fn = cfs_posix_mount,
+	.unmount_fn = cfs_posix_unmount
+};
+
+int cfs_fs_posix_register(void) {
+	static const char* exts[] = { "", NULL };
+	return cfs_fs_impl_register(&cfs_posix_impl, exts, NULL);
+}
+#endif
+
+#ifdef CFS_POSIX
+/*
+ * Inflate (RFC 1951). The compressed data is always completely in memory, so
+ * only the output side has to be resumable: decoding stops as soon as the
+ * caller's buffer is full, in the middle of a match or a stored block if need
+ * be, and carries on from there with the next call. Huffman codes of up to
+ * CFS_INFLATE_FAST_BITS bits are decoded with a single table lookup, longer
+ * ones canonically one bit at a time.
+ */
+
+#define CFS_INFLATE_WINDOW 32768
+#define CFS_INFLATE_FAST_BITS 10
+
+typedef struct cfs_huffman {
+	// Symbol | length << 9 for every code of up to CFS_INFLATE_FAST_BITS
+	// bits, indexed by the next bits of the stream. 0 for longer codes.
+	uint16_t fast[1 << CFS_INFLATE_FAST_BITS];
+	uint16_t count[16];
+	uint16_t symbol[288];
+} cfs_huffman;
+
+enum {
+	CFS_INFLATE_HEADER,
+	CFS_INFLATE_STORED,
+	CFS_INFLATE_CODES,
+	CFS_INFLATE_DONE,
+	CFS_INFLATE_ERROR
+};
+
+typedef struct cfs_inflate {
+	const unsigned char* in;
+	size_t in_size;
+	size_t in_pos;
+	uint64_t bits;
+	unsigned int bit_count;
+	int state;
+	bool last;
+	// Bytes left of the current stored block.
+	size_t stored;
+	// Bytes left of the current match and its distance.
+	unsigned int copy;
+	unsigned int distance;
+	// Bytes produced so far, the last CFS_INFLATE_WINDOW of them are kept in
+	// window at total modulo its size.
+	uint64_t total;
+	cfs_huffman lengths;
+	cfs_huffman distances;
+	unsigned char window[CFS_INFLATE_WINDOW];
+} cfs_inflate;
+
+static const uint16_t cfs_inflate_length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t cfs_inflate_length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t cfs_inflate_distance_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t cfs_inflate_distance_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void cfs_inflate_init(cfs_inflate* z, const unsigned char* in, size_t size) {
+	z->in = in;
+	z->in_size = size;
+	z->in_pos = 0;
+	z->bits = 0;
+	z->bit_count = 0;
+	z->state = CFS_INFLATE_HEADER;
+	z->last = false;
+	z->stored = 0;
+	z->copy = 0;
+	z->distance = 0;
+	z->total = 0;
+}
+
+// Makes sure at least count bits are buffered, false if the input ends first.
+static bool cfs_inflate_need(cfs_inflate* z, unsigned int count) {
+	while(z->bit_count <= 56 && z->in_pos < z->in_size) {
+		z->bits |= (uint64_t)z->in[z->in_pos++] << z->bit_count;
+		z->bit_count += 8;
+	}
+	return z->bit_count >= count;
+}
+
+static unsigned int cfs_inflate_bits(cfs_inflate* z, unsigned int count) {
+	unsigned int value = (unsigned int)(z->bits & ((1u << count) - 1));
+
+	z->bits >>= count;
+	z->bit_count -= count;
+	return value;
+}
+
+static int cfs_huffman_build(cfs_huffman* h, const unsigned char* lengths, unsigned int n) {
+	uint16_t offsets[16];
+	unsigned int len, sym, code, index, i, reversed, j;
+	int left;
+
+	memset(h->count, 0, sizeof(h->count));
+	memset(h->fast, 0, sizeof(h->fast));
+	for(sym = 0; sym < n; sym++) {
+		h->count[lengths[sym]]++;
+	}
+	h->count[0] = 0;
+
+	// Over-subscribed sets of lengths are no prefix code. Incomplete ones are
+	// allowed, their unused codes fail to decode.
+	left = 1;
+	for(len = 1; len < 16; len++) {
+		left = (left << 1) - h->count[len];
+		if(left < 0) {
+			return -1;
+		}
+	}
+
+	offsets[1] = 0;
+	for(len = 1; len < 15; len++) {
+		offsets[len + 1] = offsets[len] + h->count[len];
+	}
+	for(sym = 0; sym < n; sym++) {
+		if(lengths[sym] != 0) {
+			h->symbol[offsets[lengths[sym]]++] = (uint16_t)sym;
+		}
+	}
+
+	// Canonical codes are assigned in order of length, then symbol. Deflate
+	// packs them starting with their top bit, so they are reversed to index
+	// the table with the next stream bits.
+	code = 0;
+	index = 0;
+	for(len = 1; len <= CFS_INFLATE_FAST_BITS; len++) {
+		for(i = 0; i < h->count[len]; i++, code++) {
+			reversed = 0;
+			for(j = 0; j < len; j++) {
+				reversed |= ((code >> j) & 1) << (len - 1 - j);
+			}
+			for(j = reversed; j < (1u << CFS_INFLATE_FAST_BITS); j += 1u << len) {
+				h->fast[j] = (uint16_t)(h->symbol[index] | len << 9);
+			}
+			index++;
+		}
+		code <<= 1;
+	}
+	return 0;
+}
+
+static int cfs_inflate_decode(cfs_inflate* z, const cfs_huffman* h) {
+	unsigned int entry, len, code, first, index, count;
+	uint64_t bits;
+
+	if(z->bit_count < 15) {
+		cfs_inflate_need(z, 15);
+	}
+	entry = h->fast[z->bits & ((1u << CFS_INFLATE_FAST_BITS) - 1)];
+	if(entry != 0) {
+		len = entry >> 9;
+		if(len > z->bit_count) {
+			return -1;
+		}
+		z->bits >>= len;
+		z->bit_count -= len;
+		return (int)(entry & 511);
+	}
+
+	bits = z->bits;
+	code = first = index = 0;
+	for(len = 1; len < 16 && len <= z->bit_count; len++) {
+		code |= (unsigned int)(bits & 1);
+		bits >>= 1;
+		count = h->count[len];
+		if(code < first + count) {
+			z->bits >>= len;
+			z->bit_count -= len;
+			return h->symbol[index + code - first];
+		}
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+static int cfs_inflate_dynamic(cfs_inflate* z) {
+	static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	unsigned char lengths[286 + 30];
+	unsigned int nlen, ndist, ncode, i, repeat;
+	unsigned char value;
+	int sym;
+
+	if(!cfs_inflate_need(z, 14)) {
+		return -1;
+	}
+	nlen = cfs_inflate_bits(z, 5) + 257;
+	ndist = cfs_inflate_bits(z, 5) + 1;
+	ncode = cfs_inflate_bits(z, 4) + 4;
+	if(nlen > 286 || ndist > 30) {
+		return -1;
+	}
+
+	memset(lengths, 0, 19);
+	for(i = 0; i < ncode; i++) {
+		if(!cfs_inflate_need(z, 3)) {
+			return -1;
+		}
+		lengths[order[i]] = (unsigned char)cfs_inflate_bits(z, 3);
+	}
+	// The code length code is only needed until the real ones are known.
+	if(cfs_huffman_build(&z->lengths, lengths, 19) < 0) {
+		return -1;
+	}
+
+	for(i = 0; i < nlen + ndist;) {
+		if((sym = cfs_inflate_decode(z, &z->lengths)) < 0) {
+			return -1;
+		}
+		if(sym < 16) {
+			lengths[i++] = (unsigned char)sym;
+			continue;
+		}
+		if(sym == 16) {
+			if(i == 0 || !cfs_inflate_need(z, 2)) {
+				return -1;
+			}
+			value = lengths[i - 1];
+			repeat = 3 + cfs_inflate_bits(z, 2);
+		} else if(sym == 17) {
+			if(!cfs_inflate_need(z, 3)) {
+				return -1;
+			}
+			value = 0;
+			repeat = 3 + cfs_inflate_bits(z, 3);
+		} else {
+			if(!cfs_inflate_need(z, 7)) {
+				return -1;
+			}
+			value = 0;
+			repeat = 11 + cfs_inflate_bits(z, 7);
+		}
+		if(i + repeat > nlen + ndist) {
+			return -1;
+		}
+		while(repeat--) {
+			lengths[i++] = value;
+		}
+	}
+
+	// A block without an end of block code could never end.
+	if(lengths[256] == 0) {
+		return -1;
+	}
+	if(cfs_huffman_build(&z->lengths, lengths, nlen) < 0 ||
+	   cfs_huffman_build(&z->distances, lengths + nlen, ndist) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int cfs_inflate_header(cfs_inflate* z) {
+	unsigned char lengths[288];
+	unsigned int length;
+
+	if(!cfs_inflate_need(z, 3)) {
+		return -1;
+	}
+	z->last = cfs_inflate_bits(z, 1) != 0;
+	switch(cfs_inflate_bits(z, 2)) {
+		case 0:
+			// Stored blocks start at the next byte.
+			cfs_inflate_bits(z, z->bit_count & 7);
+			if(!cfs_inflate_need(z, 32)) {
+				return -1;
+			}
+			length = cfs_inflate_bits(z, 16);
+			if(length != (~cfs_inflate_bits(z, 16) & 0xffff)) {
+				return -1;
+			}
+			z->stored = length;
+			z->state = CFS_INFLATE_STORED;
+			return 0;
+		case 1:
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			cfs_huffman_build(&z->lengths, lengths, 288);
+			memset(lengths, 5, 30);
+			cfs_huffman_build(&z->distances, lengths, 30);
+		break;
+		case 2:
+			if(cfs_inflate_dynamic(z) < 0) {
+				return -1;
+			}
+		break;
+		default:
+			return -1;
+	}
+	z->state = CFS_INFLATE_CODES;
+	return 0;
+}
+
+// Appends data to the window of recent output.
+static void cfs_inflate_remember(cfs_inflate* z, const unsigned char* data, size_t size) {
+	size_t at, part;
+
+	if(size > CFS_INFLATE_WINDOW) {
+		z->total += size - CFS_INFLATE_WINDOW;
+		data += size - CFS_INFLATE_WINDOW;
+		size = CFS_INFLATE_WINDOW;
+	}
+	while(size > 0) {
+		at = (size_t)(z->total & (CFS_INFLATE_WINDOW - 1));
+		part = CFS_INFLATE_WINDOW - at < size ? CFS_INFLATE_WINDOW - at : size;
+		memcpy(z->window + at, data, part);
+		z->total += part;
+		data += part;
+		size -= part;
+	}
+}
+
+// Copies up to size bytes of the current stored block.
+static size_t cfs_inflate_stored(cfs_inflate* z, unsigned char* out, size_t size) {
+	unsigned char c;
+	size_t n = 0;
+
+	if(size > z->stored) {
+		size = z->stored;
+	}
+	// Whole bytes may still be buffered from reading the block header.
+	while(n < size && z->bit_count >= 8) {
+		c = (unsigned char)cfs_inflate_bits(z, 8);
+		z->window[z->total++ & (CFS_INFLATE_WINDOW - 1)] = c;
+		if(out != NULL) {
+			out[n] = c;
+		}
+		n++;
+	}
+	if(n < size) {
+		if(size - n > z->in_size - z->in_pos) {
+			return (size_t)-1;
+		}
+		if(out != NULL) {
+			memcpy(out + n, z->in + z->in_pos, size - n);
+		}
+		cfs_inflate_remember(z, z->in + z->in_pos, size - n);
+		z->in_pos += size - n;
+		n = size;
+	}
+	z->stored -= n;
+	return n;
+}
+
+/*
+    Produces up to size bytes into out, or skips them if out is NULL. Returns
+    how many, 0 at the end of the stream or -1 if it is corrupt.
+*/
+static long int cfs_inflate_read(cfs_inflate* z, unsigned char* out, size_t size) {
+	unsigned char* window = z->window;
+	uint64_t total = z->total;
+	size_t n = 0, stored;
+	unsigned int extra;
+	unsigned char c;
+	int sym;
+
+	while(n < size) {
+		// Finish a match cut short by the end of the last buffer.
+		while(z->copy > 0 && n < size) {
+			c = window[(total - z->distance) & (CFS_INFLATE_WINDOW - 1)];
+			window[total++ & (CFS_INFLATE_WINDOW - 1)] = c;
+			if(out != NULL) {
+				out[n] = c;
+			}
+			n++;
+			z->copy--;
+		}
+		if(n == size) {
+			break;
+		}
+
+		switch(z->state) {
+			case CFS_INFLATE_HEADER:
+				z->total = total;
+				if(cfs_inflate_header(z) < 0) {
+					z->state = CFS_INFLATE_ERROR;
+				}
+			break;
+			case CFS_INFLATE_STORED:
+				z->total = total;
+				stored = cfs_inflate_stored(z, out != NULL ? out + n : NULL, size - n);
+				if(stored == (size_t)-1) {
+					z->state = CFS_INFLATE_ERROR;
+					break;
+				}
+				n += stored;
+				total = z->total;
+				if(z->stored == 0) {
+					z->state = z->last ? CFS_INFLATE_DONE : CFS_INFLATE_HEADER;
+				}
+			break;
+			case CFS_INFLATE_CODES:
+				if((sym = cfs_inflate_decode(z, &z->lengths)) < 0) {
+					z->state = CFS_INFLATE_ERROR;
+				} else if(sym < 256) {
+					window[total++ & (CFS_INFLATE_WINDOW - 1)] = (unsigned char)sym;
+					if(out != NULL) {
+						out[n] = (unsigned char)sym;
+					}
+					n++;
+				} else if(sym == 256) {
+					z->state = z->last ? CFS_INFLATE_DONE : CFS_INFLATE_HEADER;
+				} else if(sym - 257 >= 29) {
+					z->state = CFS_INFLATE_ERROR;
+				} else {
+					sym -= 257;
+					extra = cfs_inflate_length_extra[sym];
+					if(!cfs_inflate_need(z, extra)) {
+						z->state = CFS_INFLATE_ERROR;
+						break;
+					}
+					z->copy = cfs_inflate_length_base[sym] + cfs_inflate_bits(z, extra);
+					if((sym = cfs_inflate_decode(z, &z->distances)) < 0 || sym >= 30) {
+						z->state = CFS_INFLATE_ERROR;
+						break;
+					}
+					extra = cfs_inflate_distance_extra[sym];
+					if(!cfs_inflate_need(z, extra)) {
+						z->state = CFS_INFLATE_ERROR;
+						break;
+					}
+					z->distance = cfs_inflate_distance_base[sym] + cfs_inflate_bits(z, extra);
+					if(z->distance > total) {
+						z->state = CFS_INFLATE_ERROR;
+					}
+				}
+			break;
+			case CFS_INFLATE_DONE:
+				z->total = total;
+				return (long int)n;
+			default:
+				z->total = total;
+				return n > 0 ? (long int)n : -1;
+		}
+	}
+	z->total = total;
+	return (long int)n;
+}
+
+/*
+ * Built in ZIP backend for .zip and .pk3 archives, including ZIP64 ones.
+ * Mounting maps the archive and reads its central directory front to back
+ * once, into a flat array of entries with their normalized names packed in a
+ * single block and an open addressed table of entry indices keyed by the
+ * hash the core already passes in cfs_fs_path. Opening an entry is a single
+ * probe however large the archive is. Stored entries are served straight
+ * from the mapping, deflated ones are inflated as they are read.
+ */
+
+#define CFS_ZIP_LOCAL 0x04034b50u
+#define CFS_ZIP_CENTRAL 0x02014b50u
+#define CFS_ZIP_END 0x06054b50u
+#define CFS_ZIP64_END 0x06064b50u
+#define CFS_ZIP64_LOCATOR 0x07064b50u
+
+enum {
+	CFS_ZIP_STORED = 0,
+	CFS_ZIP_DEFLATED = 8
+};
+
+typedef struct cfs_zip_entry {
+	uint64_t offset;
+	uint64_t compressed;
+	uint64_t size;
+	const char* name;
+	size_t length;
+	uint32_t hash;
+	// DOS time in the low and DOS date in the high half.
+	uint32_t modified;
+	uint16_t method;
+	bool directory;
+} cfs_zip_entry;
+
+typedef struct cfs_zip_archive {
+	int fd;
+	const unsigned char* data;
+	size_t size;
+	cfs_zip_entry* entries;
+	size_t entry_count;
+	char* names;
+	size_t names_size;
+	// Entry index + 1 per slot, 0 for empty ones.
+	uint32_t* table;
+	size_t table_mask;
+	// The entries ordered by name, built by the first enumeration under lock.
+	const cfs_zip_entry** sorted;
+	pthread_mutex_t lock;
+} cfs_zip_archive;
+
+typedef struct cfs_zip_file {
+	cfs_file_handle handle;
+	const cfs_zip_entry* entry;
+	const unsigned char* data;
+	long int position;
+	// Deflated entries only, allocated on first read. lock serializes
+	// positional reads, which share the stream.
+	cfs_inflate* inflate;
+	pthread_mutex_t lock;
+	// Copies of the stream state at every checkpoint_spacing bytes of output
+	// reached so far, the first one after the first interval. The spacing
+	// starts at CFS_ZIP_CHECKPOINT_SIZE and doubles whenever more than
+	// CFS_ZIP_CHECKPOINT_MAX would be needed.
+	cfs_inflate** checkpoints;
+	size_t checkpoint_count;
+	size_t checkpoint_capacity;
+	uint64_t checkpoint_spacing;
+} cfs_zip_file;
+
+static uint16_t cfs_zip_u16(const unsigned char* p) {
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t cfs_zip_u32(const unsigned char* p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t cfs_zip_u64(const unsigned char* p) {
+	return (uint64_t)cfs_zip_u32(p) | (uint64_t)cfs_zip_u32(p + 4) << 32;
+}
+
+static void cfs_zip_free(cfs_zip_archive* zip) {
+	if(zip->data != NULL) {
+		munmap((void*)zip->data, zip->size);
+	}
+	if(zip->fd >= 0) {
+		close(zip->fd);
+	}
+	pthread_mutex_destroy(&zip->lock);
+	cfs_free(zip->entries);
+	cfs_free(zip->names);
+	cfs_free(zip->table);
+	cfs_free(zip->sorted);
+	cfs_free(zip);
+}
+
+// Finds the central directory through the end record, or the ZIP64 one if
+// the archive has it.
+static int cfs_zip_find_directory(const cfs_zip_archive* zip, uint64_t* offset, uint64_t* length, uint64_t* count) {
+	const unsigned char* p;
+	size_t end, limit;
+	uint64_t at;
+
+	if(zip->size < 22) {
+		return CFS_ERRIO;
+	}
+	// The end record is followed by a comment of at most 65535 bytes.
+	limit = zip->size - 22 > 65535 ? zip->size - 22 - 65535 : 0;
+	for(end = zip->size - 22; cfs_zip_u32(zip->data + end) != CFS_ZIP_END; end--) {
+		if(end == limit) {
+			return CFS_ERRIO;
+		}
+	}
+	p = zip->data + end;
+	*count = cfs_zip_u16(p + 10);
+	*length = cfs_zip_u32(p + 12);
+	*offset = cfs_zip_u32(p + 16);
+
+	if(end >= 20 && cfs_zip_u32(p - 20) == CFS_ZIP64_LOCATOR) {
+		at = cfs_zip_u64(p - 20 + 8);
+		if(at <= end - 20 && end - 20 - at >= 56 && cfs_zip_u32(zip->data + at) == CFS_ZIP64_END) {
+			p = zip->data + at;
+			*count = cfs_zip_u64(p + 32);
+			*length = cfs_zip_u64(p + 40);
+			*offset = cfs_zip_u64(p + 48);
+		}
+	}
+	if(*offset > zip->size || *length > zip->size - *offset) {
+		return CFS_ERRIO;
+	}
+	return 0;
+}
+
+// Reads the ZIP64 extra field, which holds the values whose regular fields
+// are saturated, in this order.
+static void cfs_zip_extra(const unsigned char* p, size_t size, uint64_t* length, uint64_t* compressed, uint64_t* offset) {
+	const unsigned char* end = p + size;
+	const unsigned char* q;
+	const unsigned char* field_end;
+	uint16_t field_size;
+
+	for(; end - p >= 4; p += 4 + field_size) {
+		field_size = cfs_zip_u16(p + 2);
+		if(end - p - 4 < field_size) {
+			return;
+		}
+		if(cfs_zip_u16(p) != 0x0001) {
+			continue;
+		}
+		q = p + 4;
+		field_end = q + field_size;
+		if(*length == 0xffffffffu && field_end - q >= 8) {
+			*length = cfs_zip_u64(q);
+			q += 8;
+		}
+		if(*compressed == 0xffffffffu && field_end - q >= 8) {
+			*compressed = cfs_zip_u64(q);
+			q += 8;
+		}
+		if(*offset == 0xffffffffu && field_end - q >= 8) {
+			*offset = cfs_zip_u64(q);
+		}
+		return;
+	}
+}
+
+static void cfs_zip_insert(cfs_zip_archive* zip, size_t index) {
+	const cfs_zip_entry* entry = &zip->entries[index];
+	const cfs_zip_entry* other;
+	size_t i;
+
+	for(i = entry->hash & zip->table_mask; zip->table[i] != 0; i = (i + 1) & zip->table_mask) {
+		other = &zip->entries[zip->table[i] - 1];
+		// Later entries replace earlier ones of the same name.
+		if(other->hash == entry->hash && other->length == entry->length &&
+		   memcmp(other->name, entry->name, entry->length) == 0) {
+			break;
+		}
+	}
+	zip->table[i] = (uint32_t)(index + 1);
+}
+
+static int cfs_zip_read_directory(cfs_zip_archive* zip, uint64_t offset, uint64_t length, uint64_t count) {
+	char name[CFS_PATH_MAX];
+	const unsigned char* p = zip->data + offset;
+	const unsigned char* end = p + length;
+	cfs_zip_entry* entry;
+	size_t names, capacity, name_length, extra_length, comment_length, n, i;
+	uint16_t flags;
+
+	// Every header takes at least 46 bytes, which bounds the count. Names
+	// only get shorter by normalizing and the headers leave room for their
+	// terminators, so the directory size bounds the name block as well.
+	if(count > length / 46) {
+		return CFS_ERRIO;
+	}
+	for(capacity = 16; capacity < count * 2; capacity *= 2) {}
+	zip->entries = cfs_malloc(sizeof(cfs_zip_entry) * (count > 0 ? (size_t)count : 1));
+	zip->names = cfs_malloc((size_t)length + 1);
+	zip->table = cfs_malloc(sizeof(uint32_t) * capacity);
+	if(zip->entries == NULL || zip->names == NULL || zip->table == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	memset(zip->table, 0, sizeof(uint32_t) * capacity);
+	zip->table_mask = capacity - 1;
+
+	names = 0;
+	for(i = 0; i < count; i++) {
+		if(end - p < 46 || cfs_zip_u32(p) != CFS_ZIP_CENTRAL) {
+			return CFS_ERRIO;
+		}
+		name_length = cfs_zip_u16(p + 28);
+		extra_length = cfs_zip_u16(p + 30);
+		comment_length = cfs_zip_u16(p + 32);
+		if((size_t)(end - p) - 46 < name_length + extra_length + comment_length) {
+			return CFS_ERRIO;
+		}
+
+		entry = &zip->entries[zip->entry_count];
+		flags = cfs_zip_u16(p + 8);
+		entry->method = cfs_zip_u16(p + 10);
+		entry->compressed = cfs_zip_u32(p + 20);
+		entry->size = cfs_zip_u32(p + 24);
+		entry->offset = cfs_zip_u32(p + 42);
+		entry->modified = cfs_zip_u32(p + 12);
+		cfs_zip_extra(p + 46 + name_length, extra_length, &entry->size, &entry->compressed, &entry->offset);
+
+		if(name_length < sizeof(name)) {
+			memcpy(name, p + 46, name_length);
+		}
+		p += 46 + name_length + extra_length + comment_length;
+
+		// Encrypted entries, other methods and names too long to be opened are
+		// left out. So are stored entries whose sizes disagree.
+		if((flags & 1) != 0 || name_length >= sizeof(name) ||
+		   (entry->method != CFS_ZIP_DEFLATED && entry->method != CFS_ZIP_STORED) ||
+		   (entry->method == CFS_ZIP_STORED && entry->compressed != entry->size)) {
+			continue;
+		}
+		for(n = 0; n < name_length; n++) {
+			if(name[n] == '\\') {
+				name[n] = '/';
+			}
+		}
+		entry->directory = name_length > 0 && name[name_length - 1] == '/';
+		n = cfs_path_normalize_n(name, name_length, zip->names + names, (size_t)length + 1 - names);
+		if(n == 0 || (n == 1 && zip->names[names] == '.')) {
+			continue;
+		}
+		if(zip->names[names] == '/') {
+			memmove(zip->names + names, zip->names + names + 1, n--);
+		}
+		entry->name = zip->names + names;
+		entry->length = n;
+		entry->hash = cfs_hash(zip->names + names, n);
+		names += n + 1;
+		zip->names_size = names;
+		cfs_zip_insert(zip, zip->entry_count++);
+	}
+	return 0;
+}
+
+// Opens and maps the archive of fs, without reading its directory.
+static int cfs_zip_open_archive(cfs_fs_handle* fs, cfs_zip_archive** archive) {
+	cfs_zip_archive* zip;
+	struct stat st;
+	void* map;
+
+	zip = cfs_malloc(sizeof(cfs_zip_archive));
+	if(zip == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	memset(zip, 0, sizeof(cfs_zip_archive));
+	pthread_mutex_init(&zip->lock, NULL);
+	zip->fd = open(fs->src, O_RDONLY | O_CLOEXEC);
+	if(zip->fd < 0 || fstat(zip->fd, &st) < 0 || st.st_size == 0) {
+		cfs_zip_free(zip);
+		return CFS_ERRIO;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, zip->fd, 0);
+	if(map == MAP_FAILED) {
+		cfs_zip_free(zip);
+		return CFS_ERRIO;
+	}
+	zip->data = map;
+	zip->size = (size_t)st.st_size;
+	*archive = zip;
+	return 0;
+}
+
+static int cfs_zip_mount(cfs_fs_handle* fs) {
+	cfs_zip_archive* zip;
+	uint64_t offset, length, count;
+	size_t page;
+	int err;
+
+	if((err = cfs_zip_open_archive(fs, &zip)) < 0) {
+		return err;
+	}
+	if((err = cfs_zip_find_directory(zip, &offset, &length, &count)) == 0) {
+		// Have the whole directory read in ahead of the pass over it.
+		page = (size_t)sysconf(_SC_PAGESIZE);
+		madvise((void*)(zip->data + (offset & ~(uint64_t)(page - 1))), (size_t)(length + (offset & (page - 1))), MADV_WILLNEED);
+		err = cfs_zip_read_directory(zip, offset, length, count);
+	}
+	if(err < 0) {
+		cfs_zip_free(zip);
+		return err;
+	}
+	fs->userdata = zip;
+	return 0;
+}
+
+static void cfs_zip_unmount(cfs_fs_handle* fs) {
+	cfs_zip_free(fs->userdata);
+}
+
+// What a snapshot keeps of an archive: this header, the entries with their
+// names as offsets into the name block, the name block and the table.
+typedef struct cfs_zip_state {
+	uint64_t size;
+	uint64_t entry_count;
+	uint64_t names_size;
+	uint64_t table_mask;
+} cfs_zip_state;
+
+typedef struct cfs_zip_saved_entry {
+	uint64_t offset;
+	uint64_t compressed;
+	uint64_t size;
+	uint64_t name;
+	uint64_t length;
+	uint32_t hash;
+	uint32_t modified;
+	uint16_t method;
+	uint16_t directory;
+	uint32_t reserved;
+} cfs_zip_saved_entry;
+
+static int cfs_zip_save(cfs_fs_handle* fs, cfs_fs_impl_output output, void* context) {
+	const cfs_zip_archive* zip = fs->userdata;
+	const cfs_zip_entry* entry;
+	cfs_zip_state state;
+	cfs_zip_saved_entry saved;
+	size_t i;
+	int err;
+
+	state.size = zip->size;
+	state.entry_count = zip->entry_count;
+	state.names_size = zip->names_size;
+	state.table_mask = zip->table_mask;
+	if((err = output(context, &state, sizeof(state))) < 0) {
+		return err;
+	}
+	for(i = 0; i < zip->entry_count; i++) {
+		entry = &zip->entries[i];
+		memset(&saved, 0, sizeof(saved));
+		saved.offset = entry->offset;
+		saved.compressed = entry->compressed;
+		saved.size = entry->size;
+		saved.name = (uint64_t)(entry->name - zip->names);
+		saved.length = entry->length;
+		saved.hash = entry->hash;
+		saved.modified = entry->modified;
+		saved.method = entry->method;
+		saved.directory = entry->directory;
+		if((err = output(context, &saved, sizeof(saved))) < 0) {
+			return err;
+		}
+	}
+	if((err = output(context, zip->names, zip->names_size)) < 0) {
+		return err;
+	}
+	return output(context, zip->table, sizeof(uint32_t) * (zip->table_mask + 1));
+}
+
+// Restores what cfs_zip_save wrote. Nothing in it is trusted that a damaged
+// snapshot could turn into reads outside the archive or endless probing.
+static int cfs_zip_load(cfs_fs_handle* fs, const void* data, size_t size) {
+	const unsigned char* p = data;
+	cfs_zip_archive* zip;
+	cfs_zip_entry* entry;
+	cfs_zip_state state;
+	cfs_zip_saved_entry saved;
+	size_t used, i;
+	int err;
+
+	if(size < sizeof(state)) {
+		return CFS_ERRIO;
+	}
+	memcpy(&state, p, sizeof(state));
+	p += sizeof(state);
+	size -= sizeof(state);
+	if(state.entry_count > size / sizeof(saved) || state.names_size > size - state.entry_count * sizeof(saved) ||
+	   (state.table_mask & (state.table_mask + 1)) != 0 || state.entry_count > state.table_mask ||
+	   size - state.entry_count * sizeof(saved) - state.names_size != (state.table_mask + 1) * sizeof(uint32_t)) {
+		return CFS_ERRIO;
+	}
+	if((err = cfs_zip_open_archive(fs, &zip)) < 0) {
+		return err;
+	}
+	zip->entries = cfs_malloc(sizeof(cfs_zip_entry) * (state.entry_count > 0 ? (size_t)state.entry_count : 1));
+	zip->names = cfs_malloc((size_t)state.names_size + 1);
+	zip->table = cfs_malloc(sizeof(uint32_t) * (size_t)(state.table_mask + 1));
+	if(zip->entries == NULL || zip->names == NULL || zip->table == NULL) {
+		cfs_zip_free(zip);
+		return CFS_ERRNOMEM;
+	}
+	if(zip->size != state.size) {
+		cfs_zip_free(zip);
+		return CFS_ERRIO;
+	}
+
+	for(i = 0; i < state.entry_count; i++, p += sizeof(saved)) {
+		memcpy(&saved, p, sizeof(saved));
+		if(saved.name >= state.names_size || saved.length >= state.names_size - saved.name ||
+		   (saved.method != CFS_ZIP_DEFLATED && saved.method != CFS_ZIP_STORED) ||
+		   (saved.method == CFS_ZIP_STORED && saved.compressed != saved.size)) {
+			cfs_zip_free(zip);
+			return CFS_ERRIO;
+		}
+		entry = &zip->entries[i];
+		entry->offset = saved.offset;
+		entry->compressed = saved.compressed;
+		entry->size = saved.size;
+		entry->name = zip->names + saved.name;
+		entry->length = (size_t)saved.length;
+		entry->hash = saved.hash;
+		entry->modified = saved.modified;
+		entry->method = saved.method;
+		entry->directory = saved.directory != 0;
+	}
+	memcpy(zip->names, p, (size_t)state.names_size);
+	zip->names[state.names_size] = '\0';
+	p += state.names_size;
+	memcpy(zip->table, p, sizeof(uint32_t) * (size_t)(state.table_mask + 1));
+
+	// At most entry_count slots are used, which leaves one empty at least.
+	used = 0;
+	for(i = 0; i <= state.table_mask; i++) {
+		if(zip->table[i] > state.entry_count || (zip->table[i] != 0 && ++used > state.entry_count)) {
+			cfs_zip_free(zip);
+			return CFS_ERRIO;
+		}
+	}
+	zip->entry_count = (size_t)state.entry_count;
+	zip->names_size = (size_t)state.names_size;
+	zip->table_mask = (size_t)state.table_mask;
+	fs->userdata = zip;
+	return 0;
+}
+
+static const cfs_zip_entry* cfs_zip_find(const cfs_zip_archive* zip, const cfs_fs_path* path) {
+	const cfs_zip_entry* entry;
+	uint32_t slot;
+	size_t i;
+
+	for(i = path->hash & zip->table_mask; (slot = zip->table[i]) != 0; i = (i + 1) & zip->table_mask) {
+		entry = &zip->entries[slot - 1];
+		if(entry->hash == path->hash && entry->length == path->length &&
+		   memcmp(entry->name, path->name, path->length) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+// Start of the data of entry behind its local header, NULL if the header is
+// damaged or the data does not fit in the archive.
+static const unsigned char* cfs_zip_data(const cfs_zip_archive* zip, const cfs_zip_entry* entry) {
+	const unsigned char* p;
+	uint64_t start;
+
+	if(entry->offset > zip->size || zip->size - entry->offset < 30) {
+		return NULL;
+	}
+	p = zip->data + entry->offset;
+	if(cfs_zip_u32(p) != CFS_ZIP_LOCAL) {
+		return NULL;
+	}
+	start = entry->offset + 30 + cfs_zip_u16(p + 26) + cfs_zip_u16(p + 28);
+	if(start > zip->size || zip->size - start < entry->compressed) {
+		return NULL;
+	}
+	return zip->data + start;
+}
+
+static cfs_file_handle* cfs_zip_open(cfs_fs_handle* fs, const cfs_fs_path* path, const char* mode) {
+	cfs_zip_archive* zip = fs->userdata;
+	const cfs_zip_entry* entry;
+	const unsigned char* data;
+	cfs_zip_file* file;
+
+	// Archives are read only.
+	if(mode[0] != 'r' || strchr(mode, '+') != NULL) {
+		return NULL;
+	}
+	if(path->id >= 0 && (size_t)path->id < zip->entry_count) {
+		entry = &zip->entries[path->id];
+	} else {
+		entry = cfs_zip_find(zip, path);
+	}
+	if(entry == NULL || entry->directory) {
+		return NULL;
+	}
+	if((data = cfs_zip_data(zip, entry)) == NULL) {
+		cfs_err = CFS_ERRIO;
+		return NULL;
+	}
+	file = cfs_pool_alloc(sizeof(cfs_zip_file));
+	if(file == NULL) {
+		cfs_err = CFS_ERRNOMEM;
+		return NULL;
+	}
+	file->handle.handle = file;
+	file->handle.fs_impl = fs;
+	file->entry = entry;
+	file->data = data;
+	file->position = 0;
+	file->inflate = NULL;
+	pthread_mutex_init(&file->lock, NULL);
+	file->checkpoints = NULL;
+	file->checkpoint_count = 0;
+	file->checkpoint_capacity = 0;
+	file->checkpoint_spacing = CFS_ZIP_CHECKPOINT_SIZE;
+	return &file->handle;
+}
+
+static int cfs_zip_locate(cfs_fs_handle* fs, const cfs_fs_path* path, long int* order, long int* size) {
+	const cfs_zip_entry* entry = cfs_zip_find(fs->userdata, path);
+
+	if(entry == NULL || entry->directory) {
+		return CFS_ERRNOENT;
+	}
+	*order = (long int)entry->offset;
+	*size = (long int)entry->size;
+	return 0;
+}
+
+static int cfs_zip_entry_compare(const void* a, const void* b) {
+	const cfs_zip_entry* x = *(const cfs_zip_entry* const*)a;
+	const cfs_zip_entry* y = *(const cfs_zip_entry* const*)b;
+	int c = memcmp(x->name, y->name, x->length < y->length ? x->length : y->length);
+
+	if(c != 0) {
+		return c;
+	}
+	return x->length < y->length ? -1 : x->length > y->length;
+}
+
+static const cfs_zip_entry** cfs_zip_sorted(cfs_zip_archive* zip) {
+	const cfs_zip_entry** sorted = __atomic_load_n(&zip->sorted, __ATOMIC_ACQUIRE);
+	size_t i;
+
+	if(sorted != NULL) {
+		return sorted;
+	}
+	pthread_mutex_lock(&zip->lock);
+	if((sorted = zip->sorted) == NULL) {
+		sorted = cfs_malloc(sizeof(cfs_zip_entry*) * (zip->entry_count > 0 ? zip->entry_count : 1));
+		if(sorted != NULL) {
+			for(i = 0; i < zip->entry_count; i++) {
+				sorted[i] = &zip->entries[i];
+			}
+			qsort(sorted, zip->entry_count, sizeof(cfs_zip_entry*), cfs_zip_entry_compare);
+			__atomic_store_n(&zip->sorted, sorted, __ATOMIC_RELEASE);
+		}
+	}
+	pthread_mutex_unlock(&zip->lock);
+	return sorted;
+}
+
+// Orders entry against the names inside directory prefix: below 0 if it sorts
+// before all of them, 0 if it is one of them, above 0 if after.
+static int cfs_zip_compare_prefix(const cfs_zip_entry* entry, const char* prefix, size_t length) {
+	int c = memcmp(entry->name, prefix, entry->length < length ? entry->length : length);
+
+	if(c != 0) {
+		return c;
+	} else if(entry->length <= length) {
+		return -1;
+	}
+	return (int)(unsigned char)entry->name[length] - '/';
+}
+
+// Archives need not list directories, every name below the directory stands
+// for its first segment. Sorted by name, all names below the directory are
+// a single run, and so are those sharing a segment.
+static int cfs_zip_enumerate(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_fs_impl_entry entry, void* context) {
+	cfs_zip_archive* zip = fs->userdata;
+	const cfs_zip_entry** sorted = cfs_zip_sorted(zip);
+	const cfs_zip_entry* found;
+	const char* name;
+	const char* slash;
+	const char* last = NULL;
+	size_t begin, end, low, high, mid, skip, length, last_length = 0;
+	int err;
+
+	if(sorted == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	if(path->length == 0) {
+		begin = 0;
+		end = zip->entry_count;
+	} else {
+		for(low = 0, high = zip->entry_count; low < high;) {
+			mid = low + (high - low) / 2;
+			if(cfs_zip_compare_prefix(sorted[mid], path->name, path->length) < 0) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		begin = low;
+		for(high = zip->entry_count; low < high;) {
+			mid = low + (high - low) / 2;
+			if(cfs_zip_compare_prefix(sorted[mid], path->name, path->length) <= 0) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		end = low;
+		// An empty directory is only there if the archive lists it.
+		if(begin == end) {
+			found = cfs_zip_find(zip, path);
+			return found != NULL && found->directory ? 0 : CFS_ERRNOENT;
+		}
+	}
+
+	skip = path->length > 0 ? path->length + 1 : 0;
+	for(; begin < end; begin++) {
+		name = sorted[begin]->name + skip;
+		length = sorted[begin]->length - skip;
+		slash = memchr(name, '/', length);
+		if(slash != NULL) {
+			length = (size_t)(slash - name);
+		}
+		if(last != NULL && length == last_length && memcmp(name, last, length) == 0) {
+			continue;
+		}
+		err = entry(context, name, length, slash != NULL || sorted[begin]->directory ? CFS_DIRENT_DIRECTORY : CFS_DIRENT_FILE);
+		if(err < 0) {
+			return err;
+		}
+		last = name;
+		last_length = length;
+	}
+	return 0;
+}
+
+// Archives store local time without a zone, it is taken as UTC.
+static int64_t cfs_zip_mtime(uint32_t modified) {
+	int64_t year = 1980 + (modified >> 25), month = (modified >> 21) & 15, day = (modified >> 16) & 31;
+	int64_t hour = (modified >> 11) & 31, minute = (modified >> 5) & 63, second = (modified & 31) * 2;
+	int64_t era, doy, doe, days;
+
+	if(month < 1 || month > 12 || day < 1) {
+		return 0;
+	}
+	// Days since 1970-01-01 of the proleptic Gregorian calendar.
+	year -= month <= 2;
+	era = year / 400;
+	doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	doe = (year - era * 400) * 365 + (year - era * 400) / 4 - (year - era * 400) / 100 + doy;
+	days = era * 146097 + doe - 719468;
+	return ((days * 24 + hour) * 60 + minute) * 60 * 1000000000 + second * 1000000000;
+}
+
+static void cfs_zip_info(const cfs_zip_entry* entry, cfs_stat* info) {
+	info->size = entry->directory ? 0 : (long int)entry->size;
+	info->mtime = cfs_zip_mtime(entry->modified);
+	info->type = entry->directory ? CFS_DIRENT_DIRECTORY : CFS_DIRENT_FILE;
+}
+
+// Answers from the entries, directories the archive does not list are there
+// if any name is inside them.
+static int cfs_zip_stat(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_stat* info) {
+	cfs_zip_archive* zip = fs->userdata;
+	const cfs_zip_entry** sorted;
+	const cfs_zip_entry* entry;
+	size_t low, high, mid;
+
+	if(path->id >= 0 && (size_t)path->id < zip->entry_count) {
+		entry = &zip->entries[path->id];
+	} else {
+		entry = cfs_zip_find(zip, path);
+	}
+	if(entry != NULL) {
+		cfs_zip_info(entry, info);
+		return 0;
+	}
+	if(path->length > 0) {
+		if((sorted = cfs_zip_sorted(zip)) == NULL) {
+			return CFS_ERRNOENT;
+		}
+		for(low = 0, high = zip->entry_count; low < high;) {
+			mid = low + (high - low) / 2;
+			if(cfs_zip_compare_prefix(sorted[mid], path->name, path->length) < 0) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if(low == zip->entry_count || cfs_zip_compare_prefix(sorted[low], path->name, path->length) != 0) {
+			return CFS_ERRNOENT;
+		}
+	}
+	info->size = 0;
+	info->mtime = 0;
+	info->type = CFS_DIRENT_DIRECTORY;
+	return 0;
+}
+
+static int cfs_zip_fstat(cfs_fs_handle* fs, cfs_file_handle* handle, cfs_stat* info) {
+	cfs_zip_file* file = handle->handle;
+
+	cfs_zip_info(file->entry, info);
+	return 0;
+}
+
+// Reports every file once, by its index in the entries.
+static int cfs_zip_index(cfs_fs_handle* fs, cfs_fs_impl_index_entry entry, void* context) {
+	cfs_zip_archive* zip = fs->userdata;
+	const cfs_zip_entry* found;
+	size_t i;
+	int err;
+
+	for(i = 0; i <= zip->table_mask; i++) {
+		if(zip->table[i] == 0) {
+			continue;
+		}
+		found = &zip->entries[zip->table[i] - 1];
+		if(!found->directory && (err = entry(context, found->name, found->length, (long int)(zip->table[i] - 1))) < 0) {
+			return err;
+		}
+	}
+	return 0;
+}
+
+static int cfs_zip_close(cfs_fs_handle* fs, cfs_file_handle* handle) {
+	cfs_zip_file* file = handle->handle;
+	size_t i;
+
+	pthread_mutex_destroy(&file->lock);
+	for(i = 0; i < file->checkpoint_count; i++) {
+		cfs_free(file->checkpoints[i]);
+	}
+	cfs_free(file->checkpoints);
+	cfs_pool_free(file->inflate, sizeof(cfs_inflate));
+	cfs_pool_free(file, sizeof(cfs_zip_file));
+	return 0;
+}
+
+// Inflates like cfs_inflate_read, stopping at the next checkpoint the stream
+// has not reached before to take it. A checkpoint is the whole decoder state,
+// so it can be taken anywhere, even in the middle of a match.
+static long int cfs_zip_inflate(cfs_zip_file* file, unsigned char* out, size_t size) {
+	cfs_inflate* z = file->inflate;
+	uint64_t next = (uint64_t)(file->checkpoint_count + 1) * file->checkpoint_spacing;
+	cfs_inflate** checkpoints;
+	cfs_inflate* checkpoint;
+	size_t i;
+	long int n;
+
+	if(z->total < next && next - z->total < size) {
+		size = (size_t)(next - z->total);
+	}
+	n = cfs_inflate_read(z, out, size);
+	if(n <= 0 || z->total != next) {
+		return n;
+	}
+
+	// Out of checkpoints, keep the ones at even multiples of the spacing and
+	// double it. The one just reached is at an odd multiple, so it is not
+	// taken either.
+	if(file->checkpoint_count == CFS_ZIP_CHECKPOINT_MAX) {
+		for(i = 0; i < file->checkpoint_count; i++) {
+			if(i % 2 == 0) {
+				cfs_free(file->checkpoints[i]);
+			} else {
+				file->checkpoints[i / 2] = file->checkpoints[i];
+			}
+		}
+		file->checkpoint_count /= 2;
+		file->checkpoint_spacing *= 2;
+		return n;
+	}
+
+	// Without memory for it the checkpoint is just skipped, later ones are
+	// then not taken either.
+	if(file->checkpoint_count == file->checkpoint_capacity) {
+		size_t capacity = file->checkpoint_capacity ? file->checkpoint_capacity * 2 : 16;
+		if(capacity > CFS_ZIP_CHECKPOINT_MAX) {
+			capacity = CFS_ZIP_CHECKPOINT_MAX;
+		}
+		checkpoints = cfs_realloc(file->checkpoints, sizeof(cfs_inflate*) * capacity);
+		if(checkpoints == NULL) {
+			return n;
+		}
+		file->checkpoints = checkpoints;
+		file->checkpoint_capacity = capacity;
+	}
+	checkpoint = cfs_malloc(sizeof(cfs_inflate));
+	if(checkpoint != NULL) {
+		memcpy(checkpoint, z, sizeof(cfs_inflate));
+		file->checkpoints[file->checkpoint_count++] = checkpoint;
+	}
+	return n;
+}
+
+// Inflates sz bytes at offset. Reading on where the last call stopped just
+// continues the stream, anything else resumes from the closest checkpoint
+// before offset unless the stream is closer already.
+static long int cfs_zip_inflate_at(cfs_zip_file* file, unsigned char* buffer, long int sz, long int offset) {
+	cfs_inflate* z = file->inflate;
+	uint64_t target = (uint64_t)offset;
+	size_t i;
+	long int n, done;
+
+	if(z == NULL) {
+		z = file->inflate = cfs_pool_alloc(sizeof(cfs_inflate));
+		if(z == NULL) {
+			return -1;
+		}
+		cfs_inflate_init(z, file->data, (size_t)file->entry->compressed);
+	}
+	i = (size_t)(target / file->checkpoint_spacing);
+	if(i > file->checkpoint_count) {
+		i = file->checkpoint_count;
+	}
+	if(z->total > target || (i > 0 && file->checkpoints[i - 1]->total > z->total)) {
+		if(i > 0) {
+			memcpy(z, file->checkpoints[i - 1], sizeof(cfs_inflate));
+		} else {
+			cfs_inflate_init(z, file->data, (size_t)file->entry->compressed);
+		}
+	}
+	while(z->total < target) {
+		if(cfs_zip_inflate(file, NULL, (size_t)(target - z->total)) <= 0) {
+			return -1;
+		}
+	}
+	for(done = 0; done < sz; done += n) {
+		if((n = cfs_zip_inflate(file, buffer + done, (size_t)(sz - done))) <= 0) {
+			return n < 0 && done == 0 ? -1 : done;
+		}
+	}
+	return done;
+}
+
+static long int cfs_zip_read_at(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz, long int offset) {
+	cfs_zip_file* file = handle->handle;
+	const cfs_zip_entry* entry = file->entry;
+	long int n;
+
+	if(offset < 0 || sz < 0) {
+		return -1;
+	}
+	if((uint64_t)offset >= entry->size) {
+		return 0;
+	}
+	if((uint64_t)sz > entry->size - (uint64_t)offset) {
+		sz = (long int)(entry->size - (uint64_t)offset);
+	}
+	if(entry->method == CFS_ZIP_STORED) {
+		memcpy(buffer, file->data + offset, (size_t)sz);
+		return sz;
+	}
+	pthread_mutex_lock(&file->lock);
+	n = cfs_zip_inflate_at(file, buffer, sz, offset);
+	pthread_mutex_unlock(&file->lock);
+	return n;
+}
+
+static long int cfs_zip_read(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	cfs_zip_file* file = handle->handle;
+	long int n = cfs_zip_read_at(fs, handle, buffer, sz, file->position);
+
+	if(n > 0) {
+		file->position += n;
+	}
+	return n;
+}
+
+static long int cfs_zip_write(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	return -1;
+}
+
+static long int cfs_zip_seek(cfs_fs_handle* fs, cfs_file_handle* handle, long int offset, int whence) {
+	cfs_zip_file* file = handle->handle;
+	long int base;
+
+	switch(whence) {
+		case CFS_SEEK_SET:
+			base = 0;
+		break;
+		case CFS_SEEK_CUR:
+			base = file->position;
+		break;
+		case CFS_SEEK_END:
+			base = (long int)file->entry->size;
+		break;
+		default:
+			return -1;
+	}
+	if(base + offset < 0) {
+		return -1;
+	}
+	file->position = base + offset;
+	return file->position;
+}
+
+// Stored entries are mapped for free, deflated ones are inflated in one go.
+static int cfs_zip_map(cfs_fs_handle* fs, cfs_file_handle* handle, const void** data, size_t* size) {
+	cfs_zip_file* file = handle->handle;
+	const cfs_zip_entry* entry = file->entry;
+	unsigned char* buffer;
+
+	if(entry->method == CFS_ZIP_STORED) {
+		*data = file->data;
+		*size = (size_t)entry->size;
+		return 0;
+	}
+	buffer = cfs_malloc(entry->size > 0 ? (size_t)entry->size : 1);
+	if(buffer == NULL) {
+		return CFS_ERRNOMEM;
+	}
+	if(cfs_zip_read_at(fs, handle, buffer, (long int)entry->size, 0) != (long int)entry->size) {
+		cfs_free(buffer);
+		return CFS_ERRIO;
+	}
+	*data = buffer;
+	*size = (size_t)entry->size;
+	return 0;
+}
+
+static void cfs_zip_unmap(cfs_fs_handle* fs, cfs_file_handle* handle, const void* data, size_t size) {
+	cfs_zip_file* file = handle->handle;
+
+	if(file->entry->method != CFS_ZIP_STORED) {
+		cfs_free((void*)data);
+	}
+}
+
+static int cfs_zip_fd(cfs_fs_handle* fs, cfs_file_handle* handle, int* fd, long int* base, long int* size) {
+	cfs_zip_file* file = handle->handle;
+	cfs_zip_archive* zip = fs->userdata;
+
+	if(file->entry->method != CFS_ZIP_STORED) {
+		return CFS_ERRIO;
+	}
+	*fd = zip->fd;
+	*base = (long int)(file->data - zip->data);
+	*size = (long int)file->entry->size;
+	return 0;
+}
+
+static cfs_fs_impl cfs_zip_impl = {
+	.open_fn = cfs_zip_open,
+	.seek_fn = cfs_zip_seek,
+	.read_fn = cfs_zip_read,
+	.write_fn = cfs_zip_write,
+	.map_fn = cfs_zip_map,
+	.unmap_fn = cfs_zip_unmap,
+	.read_at_fn = cfs_zip_read_at,
+	.fd_fn = cfs_zip_fd,
+	.locate_fn = cfs_zip_locate,
+	.stat_fn = cfs_zip_stat,
+	.fstat_fn = cfs_zip_fstat,
+	.enumerate_fn = cfs_zip_enumerate,
+	.index_fn = cfs_zip_index,
+	.close_fn = cfs_zip_close,
+	.mount_fn = cfs_zip_mount,
+	.unmount_fn = cfs_zip_unmount,
+	.save_fn = cfs_zip_save,
+	.load_fn = cfs_zip_load
+};
+
+int cfs_fs_zip_register(void) {
+	static const char* exts[] = { "zip", "pk3", NULL };
+	return cfs_fs_impl_register(&cfs_zip_impl, exts, NULL);
+}
+#endif
+
+
+/*
+ * Path handling functions mostly taken from cwalk https://github.com/likle/cwalk
+ *  and modified the API for platform and non platform specific versions.
+ *
+ * Internally every path is a [begin, end) range so that the _n variants can
+ * work on slices which are not terminated, e.g. names inside an archive index.
+ * The terminated variants measure the string once and forward.
+ */
+
+#ifndef CFS_PLAT_PATH_STYLE
+#if defined(WIN32) || defined(_WIN32) ||                                       \
+  defined(__WIN32) && !defined(__CYGWIN__)
+#define CFS_PLAT_PATH_STYLE CFS_PATH_WINDOWS
+#else
+#define CFS_PLAT_PATH_STYLE CFS_PATH_UNIX
+#endif
+#endif
+
+/*
+ * The style is a compile time constant for every public entry point, so the
+ * implementation functions are forced inline into them. Each entry point then
+ * gets its own copy specialized for its style, where separator tests reduce
+ * to plain compares and the unix variants never touch tolower.
+ */
+#if defined(__GNUC__)
+#define CFS_PATH_SPECIALIZE static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define CFS_PATH_SPECIALIZE static __forceinline
+#else
+#define CFS_PATH_SPECIALIZE static inline
+#endif
+
+static const char* const seperators[] = {
+	"\\/",
+	"/"
+};
+
+CFS_PATH_SPECIALIZE bool cfs_path_is_sep_impl(cfs_path_style style, const char* str) {
+	if(style == CFS_PATH_WINDOWS) {
+		return (*str == '/') | (*str == '\\');
+	}
+	return *str == '/';
+}
+
+// The separator which is written to output, also the one the scanning
+// kernels test for besides '/'.
+CFS_PATH_SPECIALIZE char cfs_path_separator(cfs_path_style style) {
+	return style == CFS_PATH_WINDOWS ? '\\' : '/';
+}
+
+/*
+ * Separator scanning.
+ *
+ * Finding the next or previous stop is the inner loop of every path function,
+ * so on x86 it is done 16 or 32 bytes at a time with SSE2 or AVX2, picked on
+ * first use depending on what the CPU supports. '/' is a separator in every
+ * style, the kernels take the style's other separator as sep ('/' again for
+ * unix paths). Define CFS_NO_SIMD to always use the scalar loops.
+ */
+
+#if !defined(CFS_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CFS_PATH_SIMD
+#include <immintrin.h>
+#endif
+
+typedef const char* (*cfs_path_scan_next_fn)(const char* c, const char* end, char sep);
+typedef const char* (*cfs_path_scan_previous_fn)(const char* begin, const char* c, char sep);
+
+// Returns the first separator in [c, end) or end if there is none.
+static const char* cfs_path_scan_next_scalar(const char* c, const char* end, char sep) {
+	while(c < end && *c != '/' && *c != sep) {
+		++c;
+	}
+	return c;
+}
+
+// Returns the last separator in [begin, c] or NULL if there is none.
+static const char* cfs_path_scan_previous_scalar(const char* begin, const char* c, char sep) {
+	for(;;) {
+		if(*c == '/' || *c == sep) {
+			return c;
+		}
+		if(c == begin) {
+			return NULL;
+		}
+		--c;
+	}
+}
+
+#ifdef CFS_PATH_SIMD
+__attribute__((target("sse2")))
+static const char* cfs_path_scan_next_sse2(const char* c, const char* end, char sep) {
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i other = _mm_set1_epi8(sep);
+	unsigned int mask;
+	__m128i v;
+
+	while(end - c >= 16) {
+		v = _mm_loadu_si128((const __m128i*)c);
+		mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, other)));
+		if(mask != 0) {
+			return c + __builtin_ctz(mask);
+		}
+		c += 16;
+	}
+	return cfs_path_scan_next_scalar(c, end, sep);
+}
+
+__attribute__((target("sse2")))
+static const char* cfs_path_scan_previous_sse2(const char* begin, const char* c, char sep) {
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i other = _mm_set1_epi8(sep);
+	const char* end = c + 1;
+	unsigned int mask;
+	__m128i v;
+
+	while(end - begin >= 16) {
+		v = _mm_loadu_si128((const __m128i*)(end - 16));
+		mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, other)));
+		if(mask != 0) {
+			return end - 16 + (31 - __builtin_clz(mask));
+		}
+		end -= 16;
+	}
+	return end > begin ? cfs_path_scan_previous_scalar(begin, end - 1, sep) : NULL;
+}
+
+__attribute__((target("avx2")))
+static const char* cfs_path_scan_next_avx2(const char* c, const char* end, char sep) {
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i other = _mm256_set1_epi8(sep);
+	unsigned int mask;
+	__m256i v;
+
+	while(end - c >= 32) {
+		v = _mm256_loadu_si256((const __m256i*)c);
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, slash), _mm256_cmpeq_epi8(v, other)));
+		if(mask != 0) {
+			return c + __builtin_ctz(mask);
+		}
+		c += 32;
+	}
+	return cfs_path_scan_next_scalar(c, end, sep);
+}
+
+__attribute__((target("avx2")))
+static const char* cfs_path_scan_previous_avx2(const char* begin, const char* c, char sep) {
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i other = _mm256_set1_epi8(sep);
+	const char* end = c + 1;
+	unsigned int mask;
+	__m256i v;
+
+	while(end - begin >= 32) {
+		v = _mm256_loadu_si256((const __m256i*)(end - 32));
+		mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, slash), _mm256_cmpeq_epi8(v, other)));
+		if(mask != 0) {
+			return end - 32 + (31 - __builtin_clz(mask));
+		}
+		end -= 32;
+	}
+	return end > begin ? cfs_path_scan_previous_scalar(begin, end - 1, sep) : NULL;
+}
+#endif
+
+static const char* cfs_path_scan_next_init(const char* c, const char* end, char sep);
+static const char* cfs_path_scan_previous_init(const char* begin, const char* c, char sep);
+
+// The kernels are picked on first use by whichever thread gets there, so the
+// pointers are only ever accessed atomically. Every thread picks the same
+// kernels, relaxed order is enough.
+static cfs_path_scan_next_fn cfs_path_scan_next_kernel = cfs_path_scan_next_init;
+static cfs_path_scan_previous_fn cfs_path_scan_previous_kernel = cfs_path_scan_previous_init;
+
+static void cfs_path_scan_select(void) {
+	cfs_path_scan_next_fn next = cfs_path_scan_next_scalar;
+	cfs_path_scan_previous_fn previous = cfs_path_scan_previous_scalar;
+
+#ifdef CFS_PATH_SIMD
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		next = cfs_path_scan_next_avx2;
+		previous = cfs_path_scan_previous_avx2;
+	} else if(__builtin_cpu_supports("sse2")) {
+		next = cfs_path_scan_next_sse2;
+		previous = cfs_path_scan_previous_sse2;
+	}
+#endif
+	__atomic_store_n(&cfs_path_scan_next_kernel, next, __ATOMIC_RELAXED);
+	__atomic_store_n(&cfs_path_scan_previous_kernel, previous, __ATOMIC_RELAXED);
+}
+
+static inline const char* cfs_path_scan_next(const char* c, const char* end, char sep) {
+	return __atomic_load_n(&cfs_path_scan_next_kernel, __ATOMIC_RELAXED)(c, end, sep);
+}
+
+static inline const char* cfs_path_scan_previous(const char* begin, const char* c, char sep) {
+	return __atomic_load_n(&cfs_path_scan_previous_kernel, __ATOMIC_RELAXED)(begin, c, sep);
+}
+
+static const char* cfs_path_scan_next_init(const char* c, const char* end, char sep) {
+	cfs_path_scan_select();
+	return cfs_path_scan_next(c, end, sep);
+}
+
+static const char* cfs_path_scan_previous_init(const char* begin, const char* c, char sep) {
+	cfs_path_scan_select();
+	return cfs_path_scan_previous(begin, c, sep);
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_first_segment_without_root(cfs_path_style style, const char* path, const char* path_end, const char* segments, cfs_path *segment);
+CFS_PATH_SPECIALIZE bool cfs_path_get_first_segment_impl(cfs_path_style style, const char *path, const char* path_end, cfs_path *segment);
+CFS_PATH_SPECIALIZE bool cfs_path_get_last_segment_impl(cfs_path_style style, const char* path, const char* path_end, cfs_path* segment);
+CFS_PATH_SPECIALIZE bool cfs_path_get_next_segment_impl(cfs_path_style style, cfs_path* segment);
+CFS_PATH_SPECIALIZE bool cfs_path_get_previous_segment_impl(cfs_path_style style, cfs_path* segment);
+
+CFS_PATH_SPECIALIZE size_t cfs_path_normalize_impl(cfs_path_style style, const char* path, const char* path_end, char* buffer, size_t buffer_size);
+
+CFS_PATH_SPECIALIZE void cfs_path_basename_impl(cfs_path_style style, const char* path, const char* path_end, const char** basename, size_t* length);
+CFS_PATH_SPECIALIZE void cfs_path_dirname_impl(cfs_path_style style, const char* path, const char* path_end, size_t* length);
+
+CFS_PATH_SPECIALIZE bool cfs_path_extension_impl(cfs_path_style style, const char* path, const char* path_end, const char** extension, size_t* length);
+
+
+
+CFS_PATH_SPECIALIZE const char* cfs_path_find_next_stop(cfs_path_style style, const char* c, const char* end);
+CFS_PATH_SPECIALIZE const char* cfs_path_find_previous_stop(cfs_path_style style, const char* begin, const char* c);
+CFS_PATH_SPECIALIZE void cfs_path_get_root_impl(cfs_path_style style, const char* path, const char* path_end, size_t* length);
+
+void cfs_path_basename(const char* path, const char** basename, size_t* length) {
+	cfs_path_basename_impl(CFS_PATH_UNIX, path, path + strlen(path), basename, length);
+}
+
+void cfs_path_dirname(const char *path, size_t *length) {
+	cfs_path_dirname_impl(CFS_PATH_UNIX, path, path + strlen(path), length);
+}
+
+void cfs_plat_path_basename(const char* path, const char** basename, size_t* length) {
+	cfs_path_basename_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), basename, length);
+}
+
+void cfs_plat_path_dirname(const char *path, size_t *length) {
+	cfs_path_dirname_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), length);
+}
+
+void cfs_path_basename_n(const char* path, size_t path_length, const char** basename, size_t* length) {
+	cfs_path_basename_impl(CFS_PATH_UNIX, path, path + path_length, basename, length);
+}
+
+void cfs_path_dirname_n(const char* path, size_t path_length, size_t* length) {
+	cfs_path_dirname_impl(CFS_PATH_UNIX, path, path + path_length, length);
+}
+
+void cfs_plat_path_basename_n(const char* path, size_t path_length, const char** basename, size_t* length) {
+	cfs_path_basename_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, basename, length);
+}
+
+void cfs_plat_path_dirname_n(const char* path, size_t path_length, size_t* length) {
+	cfs_path_dirname_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, length);
+}
+
+CFS_PATH_SPECIALIZE void cfs_path_basename_impl(cfs_path_style style, const char* path, const char* path_end, const char** basename, size_t* length) {
+	cfs_path segment;
+	if(!cfs_path_get_last_segment_impl(style, path, path_end, &segment)) {
+		*basename = NULL;
+		*length = 0;
+		return;
+	}
+	*basename = segment.begin;
+	*length = segment.size;
+}
+
+CFS_PATH_SPECIALIZE void cfs_path_dirname_impl(cfs_path_style style, const char* path, const char* path_end, size_t* length) {
+	cfs_path segment;
+	if(!cfs_path_get_last_segment_impl(style, path, path_end, &segment)) {
+		*length = 0;
+		return;
+	}
+	*length = (size_t)(segment.begin - path);
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_extension_impl(cfs_path_style style, const char* path, const char* path_end, const char** extension, size_t* length) {
+	cfs_path segment;
+	const char* c;
+
+	if(!cfs_path_get_last_segment_impl(style, path, path_end, &segment)) {
+		return false;
+	}
+
+	for(c = segment.end - 1; c >= segment.begin; --c) {
+		if(*c == '.') {
+			*extension = c;
+			*length = (size_t)(segment.end - c);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool cfs_path_extension(const char *path, const char **extension, size_t *length) {
+	return cfs_path_extension_impl(CFS_PATH_UNIX, path, path + strlen(path), extension, length);
+}
+
+bool cfs_plat_path_extension(const char *path, const char **extension, size_t *length) {
+	return cfs_path_extension_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), extension, length);
+}
+
+bool cfs_path_extension_n(const char* path, size_t path_length, const char** extension, size_t* length) {
+	return cfs_path_extension_impl(CFS_PATH_UNIX, path, path + path_length, extension, length);
+}
+
+bool cfs_plat_path_extension_n(const char* path, size_t path_length, const char** extension, size_t* length) {
+	return cfs_path_extension_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, extension, length);
+}
+
+bool cfs_path_has_extension(const char *path) {
+	const char* extension;
+	size_t length;
+
+	return cfs_path_extension_impl(CFS_PATH_UNIX, path, path + strlen(path), &extension, &length);
+}
+
+bool cfs_plat_path_has_extension(const char *path) {
+	const char* extension;
+	size_t length;
+
+	return cfs_path_extension_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), &extension, &length);
+}
+
+bool cfs_path_has_extension_n(const char* path, size_t path_length) {
+	const char* extension;
+	size_t length;
+
+	return cfs_path_extension_impl(CFS_PATH_UNIX, path, path + path_length, &extension, &length);
+}
+
+bool cfs_plat_path_has_extension_n(const char* path, size_t path_length) {
+	const char* extension;
+	size_t length;
+
+	return cfs_path_extension_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, &extension, &length);
+}
+
+bool cfs_path_is_sep(cfs_path_style style, const char* str) {
+	return cfs_path_is_sep_impl(style, str);
+}
+
+size_t cfs_path_normalize(const char *path, char *buffer, size_t buffer_size) {
+	return cfs_path_normalize_impl(CFS_PATH_UNIX, path, path + strlen(path), buffer, buffer_size);
+}
+
+size_t cfs_plat_path_normalize(const char *path, char *buffer, size_t buffer_size) {
+	return cfs_path_normalize_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), buffer, buffer_size);
+}
+
+size_t cfs_path_normalize_n(const char* path, size_t path_length, char* buffer, size_t buffer_size) {
+	return cfs_path_normalize_impl(CFS_PATH_UNIX, path, path + path_length, buffer, buffer_size);
+}
+
+size_t cfs_plat_path_normalize_n(const char* path, size_t path_length, char* buffer, size_t buffer_size) {
+	return cfs_path_normalize_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, buffer, buffer_size);
+}
+
+
+CFS_PATH_SPECIALIZE void cfs_path_get_root_windows(const char* path, const char* path_end, size_t* length) {
+	const char *c;
+	bool is_device_path;
+
+	// We can not determine the root if this is an empty string. So we set the
+	// root to NULL and the length to zero and cancel the whole thing.
+  	c = path;
+  	*length = 0;
+  	if (c == path_end) {
+    	return;
+	}
+
+  	// Now we have to verify whether this is a windows network path (UNC), which
+  	// we will consider our root.
+  	if (cfs_path_is_sep_impl(CFS_PATH_WINDOWS, c)) {
+  	  ++c;
+	}
+    // Check whether the path starts with a single back slash, which means this
+    // is not a network path - just a normal path starting with a backslash.
+    if (c == path_end || !cfs_path_is_sep_impl(CFS_PATH_WINDOWS, c)) {
+      // Okay, this is not a network path but we still use the backslash as a
+      // root.
+      ++(*length);
+      return;
+    }
+
+    // A device path is a path which starts with "\\." or "\\?". A device path
+    // can be a UNC path as well, in which case it will take up one more
+    // segment. So, this is a network or device path. Skip the previous
+    // separator. Now we need to determine whether this is a device path. We
+    // might advance one character here if the server name starts with a '?' or
+    // a '.', but that's fine since we will search for a separator afterwards
+    // anyway.
+    ++c;
+    is_device_path = c < path_end && (*c == '?' || *c == '.') &&
+      ++c < path_end && cfs_path_is_sep_impl(CFS_PATH_WINDOWS, c);
+    if (is_device_path) {
+      // That's a device path, and the root must be either "\\.\" or "\\?\"
+      // which is 4 characters long. (at least that's how Windows
+      // GetFullPathName behaves.)
+      *length = 4;
+      return;
+    }
+
+    // We will grab anything up to the next stop. The next stop might be the end
+    // or another separator. That will be the server name.
+    c = cfs_path_find_next_stop(CFS_PATH_WINDOWS, c, path_end);
+
+    // If this is a separator and not the end of a string we wil have to include
+    // it. However, if this is the end we must not skip it.
+    while (c < path_end && cfs_path_is_sep_impl(CFS_PATH_WINDOWS, c)) {
+      ++c;
+    }
+
+    // We are now skipping the shared folder name, which will end after the
+    // next stop.
+    c = cfs_path_find_next_stop(CFS_PATH_WINDOWS, c, path_end);
+
+    // Then there might be a separator at the end. We will include that as well,
+    // it will mark the path as absolute.
+    if (c < path_end && cfs_path_is_sep_impl(CFS_PATH_WINDOWS, c)) {
+      ++c;
+    }
+
+    // Finally, calculate the size of the root.
+    *length = (size_t)(c - path);
+    return;
+}
+
+CFS_PATH_SPECIALIZE const char* cfs_path_find_next_stop(cfs_path_style style, const char* c, const char* end) {
+	return cfs_path_scan_next(c, end, cfs_path_separator(style));
+}
+
+CFS_PATH_SPECIALIZE void cfs_path_get_root_unix(const char* path, const char* path_end, size_t* length) {
+	if(path < path_end && cfs_path_is_sep_impl(CFS_PATH_UNIX, path)) {
+		*length = 1;
+	} else {
+		*length = 0;
+	}
+}
+
+
+CFS_PATH_SPECIALIZE void cfs_path_get_root_impl(cfs_path_style style, const char *path, const char* path_end, size_t *length) {
+	switch(style) {
+		case CFS_PATH_WINDOWS:
+			cfs_path_get_root_windows(path, path_end, length);
+		break;
+		case CFS_PATH_UNIX:
+			cfs_path_get_root_unix(path, path_end, length);
+		break;
+	}
+}
+
+void cfs_path_get_root(cfs_path_style style, const char *path, size_t *length) {
+	cfs_path_get_root_impl(style, path, path + strlen(path), length);
+}
+
+void cfs_path_get_root_n(cfs_path_style style, const char* path, size_t path_length, size_t* length) {
+	cfs_path_get_root_impl(style, path, path + path_length, length);
+}
+
+
+bool cfs_path_get_first_segment(const char *path, cfs_path *segment) {
+	return cfs_path_get_first_segment_impl(CFS_PATH_UNIX, path, path + strlen(path), segment);
+}
+
+bool cfs_plat_path_get_first_segment(const char* path, cfs_path* segment) {
+	return cfs_path_get_first_segment_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), segment);
+}
+
+bool cfs_path_get_first_segment_n(const char* path, size_t path_length, cfs_path* segment) {
+	return cfs_path_get_first_segment_impl(CFS_PATH_UNIX, path, path + path_length, segment);
+}
+
+bool cfs_plat_path_get_first_segment_n(const char* path, size_t path_length, cfs_path* segment) {
+	return cfs_path_get_first_segment_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, segment);
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_first_segment_impl(cfs_path_style style, const char* path, const char* path_end, cfs_path* segment) {
+	size_t length;
+	const char* segments;
+	cfs_path_get_root_impl(style, path, path_end, &length);
+	segments = path + length;
+
+	return cfs_path_get_first_segment_without_root(style, path, path_end, segments, segment);
+}
+CFS_PATH_SPECIALIZE bool cfs_path_get_first_segment_without_root(cfs_path_style style, const char* path, const char* path_end, const char* segments, cfs_path *segment) {
+	segment->path = path;
+	segment->segments = segments;
+	segment->begin = segments;
+	segment->end = segments;
+	segment->size = 0;
+	segment->path_end = path_end;
+
+	while(segments < path_end && cfs_path_is_sep_impl(style, segments)) {
+		++segments;
+	}
+	if(segments == path_end) {
+		return false;
+	}
+
+	segment->begin = segments;
+	segments = cfs_path_find_next_stop(style, segments, path_end);
+
+	segment->size = (size_t)(segments - segment->begin);
+	segment->end = segments;
+	return true;
+}
+
+// Finds the last segment by scanning backwards from the end of the path, so
+// only the trailing separators and the segment itself are looked at instead
+// of every segment in front of it.
+CFS_PATH_SPECIALIZE bool cfs_path_get_last_segment_reversed(cfs_path_style style, const char* path, const char* path_end, const char* segments, cfs_path* segment) {
+	const char* c;
+
+	segment->path = path;
+	segment->segments = segments;
+	segment->path_end = path_end;
+
+	c = path_end;
+	while(c > segments && cfs_path_is_sep_impl(style, c - 1)) {
+		--c;
+	}
+	if(c == segments) {
+		segment->begin = segments;
+		segment->end = segments;
+		segment->size = 0;
+		return false;
+	}
+
+	segment->end = c;
+	segment->begin = cfs_path_find_previous_stop(style, segments, c - 1);
+	segment->size = (size_t)(segment->end - segment->begin);
+	return true;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_last_segment_impl(cfs_path_style style, const char* path, const char* path_end, cfs_path* segment) {
+	size_t length;
+
+	cfs_path_get_root_impl(style, path, path_end, &length);
+	return cfs_path_get_last_segment_reversed(style, path, path_end, path + length, segment);
+}
+
+bool cfs_path_get_last_segment(const char *path, cfs_path *segment) {
+	return cfs_path_get_last_segment_impl(CFS_PATH_UNIX, path, path + strlen(path), segment);
+}
+
+bool cfs_plat_path_get_last_segment(const char* path, cfs_path* segment) {
+	return cfs_path_get_last_segment_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path), segment);
+}
+
+bool cfs_path_get_last_segment_n(const char* path, size_t path_length, cfs_path* segment) {
+	return cfs_path_get_last_segment_impl(CFS_PATH_UNIX, path, path + path_length, segment);
+}
+
+bool cfs_plat_path_get_last_segment_n(const char* path, size_t path_length, cfs_path* segment) {
+	return cfs_path_get_last_segment_impl(CFS_PLAT_PATH_STYLE, path, path + path_length, segment);
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_next_segment_impl(cfs_path_style style, cfs_path* segment) {
+	const char* c;
+	c = segment->begin + segment->size;
+	if(c == segment->path_end) {
+		return false;
+	}
+
+	assert(cfs_path_is_sep_impl(style, c));
+	do {
+		++c;
+	} while(c < segment->path_end && cfs_path_is_sep_impl(style, c));
+
+	if(c == segment->path_end)
+		return false;
+
+	segment->begin = c;
+	c = cfs_path_find_next_stop(style, c, segment->path_end);
+	segment->end = c;
+	segment->size = (size_t)(c - segment->begin);
+
+	return true;
+}
+
+bool cfs_path_get_next_segment(cfs_path *segment) {
+	return cfs_path_get_next_segment_impl(CFS_PATH_UNIX, segment);
+}
+
+bool cfs_plat_path_get_next_segment(cfs_path *segment) {
+	return cfs_path_get_next_segment_impl(CFS_PLAT_PATH_STYLE, segment);
+}
+
+CFS_PATH_SPECIALIZE const char* cfs_path_find_previous_stop(cfs_path_style style, const char* begin, const char* c) {
+	const char* sep = cfs_path_scan_previous(begin, c, cfs_path_separator(style));
+	return sep != NULL ? sep + 1 : begin;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_previous_segment_impl(cfs_path_style style, cfs_path* segment) {
+	const char* c;
+
+	c = segment->begin;
+	if(c <= segment->segments) {
+		return false;
+	}
+
+	do {
+		--c;
+		if(c < segment->segments) {
+			return false;
+		}
+	} while(cfs_path_is_sep_impl(style, c));
+
+	segment->end = c + 1;
+	segment->begin = cfs_path_find_previous_stop(style, segment->segments, c);
+	segment->size = (size_t)(segment->end - segment->begin);
+
+	return true;
+}
+
+
+
+bool cfs_path_get_previous_segment(cfs_path* segment) {
+	return cfs_path_get_previous_segment_impl(CFS_PATH_UNIX, segment);
+}
+
+bool cfs_plat_path_get_previous_segment(cfs_path* segment) {
+	return cfs_path_get_previous_segment_impl(CFS_PLAT_PATH_STYLE, segment);
+}
+
+typedef struct cfs_path_range {
+	const char* begin;
+	const char* end;
+} cfs_path_range;
+
+typedef struct cfs_segment_joined {
+	cfs_path segment;
+	const cfs_path_range* paths;
+	size_t count;
+	size_t path_index;
+} cfs_segment_joined;
+
+CFS_PATH_SPECIALIZE bool cfs_path_string_equal(cfs_path_style style, const char* first, const char* second, size_t first_size, size_t second_size) {
+	if(first_size != second_size) {
+		return false;
+	}
+
+	if(style == CFS_PATH_UNIX) {
+		return memcmp(first, second, first_size) == 0;
+	}
+
+	while(first_size > 0) {
+		if(tolower((unsigned char)*first++) != tolower((unsigned char)*second++)) {
+			return false;
+		}
+		--first_size;
+	}
+	return true;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_first_segment_joined(cfs_path_style style, const cfs_path_range* paths, size_t count, cfs_segment_joined* sj) {
+	bool result;
+
+	sj->path_index = 0;
+	sj->paths = paths;
+	sj->count = count;
+	result = false;
+  	while (sj->path_index < count &&
+         (result = cfs_path_get_first_segment_impl(style, paths[sj->path_index].begin,
+            paths[sj->path_index].end, &sj->segment)) == false) {
+    ++sj->path_index;
+  }
+
+  return result;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_is_root_absolute(cfs_path_style style, const char* path, size_t length) {
+	if(length == 0) {
+		return false;
+	}
+
+	return cfs_path_is_sep_impl(style, &path[length -1]);
+}
+
+static enum cfs_path_segment_type cfs_path_get_segment_type(const cfs_path* segment) {
+	if(segment->size == 1 && segment->begin[0] == '.') {
+		return CFS_PATH_CURRENT;
+	} else if(segment->size == 2 && segment->begin[0] == '.' && segment->begin[1] == '.') {
+		return CFS_PATH_BACK;
+	}
+	return CFS_PATH_NORMAL;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_last_segment_without_root(cfs_path_style style, const char* path, const char* path_end, cfs_path* segment) {
+	return cfs_path_get_last_segment_reversed(style, path, path_end, path, segment);
+}
+
+
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_previous_segment_joined(cfs_path_style style, cfs_segment_joined* sj) {
+	bool result;
+
+	if(sj->count == 0) {
+		return false;
+	} else if(cfs_path_get_previous_segment_impl(style, &sj->segment)) {
+		return true;
+	}
+
+
+	result = false;
+	do {
+		// We are done once we reached index 0. In that case there are no more
+		// segments left.
+    
+		if (sj->path_index == 0) {
+			break;
+		}
+
+    	// There is another path which we have to inspect. So we decrease the path
+		// index.
+	    --sj->path_index;
+		
+    	// If this is the first path we will have to consider that this path might
+    	// include a root, otherwise we just treat is as a segment.
+    	if (sj->path_index == 0) {
+      		result = cfs_path_get_last_segment_impl(style, sj->paths[sj->path_index].begin,
+        	sj->paths[sj->path_index].end, &sj->segment);
+    	} else {
+      		result = cfs_path_get_last_segment_without_root(style, sj->paths[sj->path_index].begin,
+        	sj->paths[sj->path_index].end, &sj->segment);
+    	}
+	} while (!result);
+
+	return result;	
+}
+
+
+
+CFS_PATH_SPECIALIZE bool cfs_path_segment_back_will_be_removed(cfs_path_style style, cfs_segment_joined* sj) {
+	enum cfs_path_segment_type type;
+	int counter;
+	
+	counter = 0;
+
+	while(cfs_path_get_previous_segment_joined(style, sj)) {
+		type = cfs_path_get_segment_type(&sj->segment);
+		if(type == CFS_PATH_NORMAL) {
+			++counter;
+			if(counter > 0) {
+				return true;
+			}
+		} else if (type == CFS_PATH_BACK) {
+			--counter;
+		}
+	}
+
+	return false;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_get_next_segment_joined(cfs_path_style style, cfs_segment_joined *sj) {
+	bool result;
+
+	if(sj->path_index >= sj->count) {
+		return false;
+	} else if(cfs_path_get_next_segment_impl(style, &sj->segment)) {
+		return true;
+	}
+
+	result = false;
+	do {
+		++sj->path_index;
+
+		if(sj->path_index >= sj->count) {
+			break;
+		}
+
+		result = cfs_path_get_first_segment_without_root(style, sj->paths[sj->path_index].begin,
+			sj->paths[sj->path_index].end, sj->paths[sj->path_index].begin, &sj->segment);
+	} while(!result);
+
+	return result;
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_segment_normal_will_be_removed(cfs_path_style style, cfs_segment_joined* sj) {
+	enum cfs_path_segment_type type;
+	int counter;
+
+	counter = 0;
+
+	while(cfs_path_get_next_segment_joined(style, sj)) {
+		type = cfs_path_get_segment_type(&sj->segment);
+		if(type == CFS_PATH_NORMAL) {
+			++counter;
+		} else if(type == CFS_PATH_BACK) {
+			--counter;
+			if(counter < 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+
+CFS_PATH_SPECIALIZE bool cfs_path_segment_will_be_removed(cfs_path_style style, const cfs_segment_joined* sj, bool absolute) {
+	enum cfs_path_segment_type type;
+	cfs_segment_joined sjc;
+	
+	sjc = *sj;
+
+	type = cfs_path_get_segment_type(&sj->segment);
+	if(type == CFS_PATH_CURRENT || (type == CFS_PATH_BACK && absolute)) {
+		return true;
+	} else if(type == CFS_PATH_BACK) {
+		return cfs_path_segment_back_will_be_removed(style, &sjc);
+	} else {
+		return cfs_path_segment_normal_will_be_removed(style, &sjc);
+	}
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_segment_joined_skip_invisible(cfs_path_style style, cfs_segment_joined* sj, bool absolute) {
+	while(cfs_path_segment_will_be_removed(style, sj, absolute)) {
+		if(!cfs_path_get_next_segment_joined(style, sj)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+CFS_PATH_SPECIALIZE size_t cfs_path_get_intersection_impl(cfs_path_style style, const char* path_base, const char* base_end, const char* path_other, const char* other_end) {
+	bool absolute;
+	size_t base_root_length, other_root_length;
+	const char *end;
+	cfs_path_range paths_base[1], paths_other[1];
+	cfs_segment_joined base, other;
+	
+  	// We first compare the two roots. We just return zero if they are not equal.
+  	// This will also happen to return zero if the paths are mixed relative and
+  	// absolute.
+	cfs_path_get_root_impl(style, path_base, base_end, &base_root_length);
+	cfs_path_get_root_impl(style, path_other, other_end, &other_root_length);
+	if (!cfs_path_string_equal(style, path_base, path_other, base_root_length, other_root_length)) {
+		return 0;
+	}
+
+ 	// Configure our paths. We just have a single path in here for now.
+ 	paths_base[0].begin = path_base;
+  	paths_base[0].end = base_end;
+  	paths_other[0].begin = path_other;
+  	paths_other[0].end = other_end;
+
+  	// So we get the first segment of both paths. If one of those paths don't have
+  	// any segment, we will return 0.
+  	if (!cfs_path_get_first_segment_joined(style, paths_base, 1, &base) ||
+    	  !cfs_path_get_first_segment_joined(style, paths_other, 1, &other)) {
+    	return base_root_length;
+  	}
+
+  	// We now determine whether the path is absolute or not. This is required
+  	// because if will ignore removed segments, and this behaves differently if
+  	// the path is absolute. However, we only need to check the base path because
+  	// we are guaranteed that both paths are either relative or absolute.
+  	absolute = cfs_path_is_root_absolute(style, path_base, base_root_length);
+
+  	// We must keep track of the end of the previous segment. Initially, this is
+  	// set to the beginning of the path. This means that 0 is returned if the
+ 	// first segment is not equal.
+  	end = path_base + base_root_length;
+
+  	// Now we loop over both segments until one of them reaches the end or their
+  	// contents are not equal.
+  	do {
+    	// We skip all segments which will be removed in each path, since we want to
+    	// know about the true path.
+    	if (!cfs_path_segment_joined_skip_invisible(style, &base, absolute) ||
+        	!cfs_path_segment_joined_skip_invisible(style, &other, absolute)) {
+      		break;
+    	}
+
+    	if (!cfs_path_string_equal(style, base.segment.begin, other.segment.begin,
+          	base.segment.size, other.segment.size)) {
+      		// So the content of those two segments are not equal. We will return the
+      		// size up to the beginning.
+      		return (size_t)(end - path_base);
+    	}
+
+    	// Remember the end of the previous segment before we go to the next one.
+    	end = base.segment.end;
+  	} while (cfs_path_get_next_segment_joined(style, &base) &&
+			 cfs_path_get_next_segment_joined(style, &other));
+
+  	// Now we calculate the length up to the last point where our paths pointed to
+  	// the same place.
+  	return (size_t)(end - path_base);
+}
+
+size_t cfs_path_get_intersection(const char *path_base, const char *path_other) {
+	return cfs_path_get_intersection_impl(CFS_PATH_UNIX, path_base, path_base + strlen(path_base), path_other, path_other + strlen(path_other));
+}
+
+size_t cfs_plat_path_get_intersection(const char *path_base, const char *path_other) {
+	return cfs_path_get_intersection_impl(CFS_PLAT_PATH_STYLE, path_base, path_base + strlen(path_base), path_other, path_other + strlen(path_other));
+}
+
+size_t cfs_path_get_intersection_n(const char* path_base, size_t base_length, const char* path_other, size_t other_length) {
+	return cfs_path_get_intersection_impl(CFS_PATH_UNIX, path_base, path_base + base_length, path_other, path_other + other_length);
+}
+
+size_t cfs_plat_path_get_intersection_n(const char* path_base, size_t base_length, const char* path_other, size_t other_length) {
+	return cfs_path_get_intersection_impl(CFS_PLAT_PATH_STYLE, path_base, path_base + base_length, path_other, path_other + other_length);
+}
+
+static size_t cfs_path_output_sized(char* buffer, size_t buffer_size, size_t position, const char* str, size_t length) {
+  size_t amount_written;
+
+  // First we determine the amount which we can write to the buffer. There are
+  // three cases. In the first case we have enough to store the whole string in
+  // it. In the second one we can only store a part of it, and in the third we
+  // have no space left.
+  if (buffer_size > position + length) {
+    amount_written = length;
+  } else if (buffer_size > position) {
+    amount_written = buffer_size - position;
+  } else {
+    amount_written = 0;
+  }
+
+  // If we actually want to write out something we will do that here. We will
+  // always append a '\0', this way we are guaranteed to have a valid string at
+  // all times.
+  if (amount_written > 0) {
+    memmove(&buffer[position], str, amount_written);
+  }
+
+  // Return the theoretical length which would have been written when everything
+  // would have fit in the buffer.
+  return length;
+}
+
+static void cfs_path_terminate_output(char* buffer, size_t buffer_size, size_t position) {
+	if(buffer_size > 0) {
+		if(position >= buffer_size) {
+			buffer[buffer_size - 1] = '\0'; 
+		} else {
+			buffer[position] = '\0';
+		}
+	}
+}
+
+CFS_PATH_SPECIALIZE bool cfs_path_has_segment(cfs_path_style style, const cfs_path_range* path) {
+	const char* c;
+	size_t length;
+
+	cfs_path_get_root_impl(style, path->begin, path->end, &length);
+	c = path->begin + length;
+	while(c < path->end && cfs_path_is_sep_impl(style, c)) {
+		++c;
+	}
+	return c != path->end;
+}
+
+/*
+ * Normalization works on the joined paths from the back. Walking backwards a
+ * '..' is seen before the segment it removes, so the stack of unresolved
+ * '..' segments reduces to a counter: every normal segment either cancels one
+ * of them or is part of the result. Whatever is left over once the front is
+ * reached leads a relative result and is dropped for an absolute one. This
+ * keeps normalization linear in the length of the path.
+ */
+
+// Emits every surviving segment of paths[first..count) right aligned so that
+// the output ends at offset end. Pieces which would start before the buffer
+// are skipped. Returns the length of the output and stores the number of
+// unresolved '..' segments in back.
+CFS_PATH_SPECIALIZE size_t cfs_path_output_reversed(cfs_path_style style, const cfs_path_range* paths, size_t first, size_t count, char* buffer, size_t buffer_size, size_t end, size_t* back) {
+	const char *start, *c, *segment_end;
+	size_t k, root_length, size, length, pending;
+
+	length = 0;
+	pending = 0;
+	for(k = count; k-- > first;) {
+		// Only the first path containing segments may start with a root.
+		start = paths[k].begin;
+		if(k == first) {
+			cfs_path_get_root_impl(style, start, paths[k].end, &root_length);
+			start += root_length;
+		}
+
+		c = paths[k].end;
+		for(;;) {
+			while(c > start && cfs_path_is_sep_impl(style, c - 1)) {
+				--c;
+			}
+			if(c == start) {
+				break;
+			}
+			segment_end = c;
+			c = cfs_path_find_previous_stop(style, start, c - 1);
+			size = (size_t)(segment_end - c);
+
+			if(size == 1 && c[0] == '.') {
+				continue;
+			} else if(size == 2 && c[0] == '.' && c[1] == '.') {
+				++pending;
+				continue;
+			} else if(pending > 0) {
+				--pending;
+				continue;
+			}
+
+			if(length > 0) {
+				++length;
+				if(length <= end) {
+					cfs_path_output_sized(buffer, buffer_size, end - length, seperators[style], 1);
+				}
+			}
+			length += size;
+			if(length <= end) {
+				cfs_path_output_sized(buffer, buffer_size, end - length, c, size);
+			}
+		}
+	}
+
+	*back = pending;
+	return length;
+}
+
+CFS_PATH_SPECIALIZE size_t cfs_path_output_back(cfs_path_style style, char* buffer, size_t buffer_size, size_t position, size_t back, bool more) {
+	size_t i;
+
+	for(i = 0; i < back; i++) {
+		position += cfs_path_output_sized(buffer, buffer_size, position, "..", 2);
+		if(i + 1 < back || more) {
+			position += cfs_path_output_sized(buffer, buffer_size, position, seperators[style], 1);
+		}
+	}
+	return position;
+}
+
+CFS_PATH_SPECIALIZE size_t cfs_path_join_and_normalize_multiple(cfs_path_style style, const cfs_path_range* paths, size_t count, char* buffer, size_t buffer_size) {
+	size_t root_length, first, content, back, unused, length;
+	bool absolute;
+
+	cfs_path_get_root_impl(style, paths[0].begin, paths[0].end, &root_length);
+	absolute = cfs_path_is_root_absolute(style, paths[0].begin, root_length);
+
+	for(first = 0; first < count && !cfs_path_has_segment(style, &paths[first]); ++first) {}
+
+	// Measure the segments first, the length of the result tells where they
+	// end up, so they are written once and nothing past the result is touched.
+	content = cfs_path_output_reversed(style, paths, first, count, NULL, 0, 0, &back);
+	if(absolute) {
+		back = 0;
+	}
+
+	length = root_length + content + back * 3;
+	if(back > 0 && content == 0) {
+		--length;
+	}
+
+	if(length == 0 && first < count) {
+		// Every segment was removed, which leaves the current directory.
+		assert(absolute == false);
+		length = cfs_path_output_sized(buffer, buffer_size, 0, ".", 1);
+	} else {
+		// A truncated result is clipped at the end of the buffer.
+		if(content > 0) {
+			cfs_path_output_reversed(style, paths, first, count, buffer, buffer_size, length, &unused);
+		}
+		cfs_path_output_sized(buffer, buffer_size, 0, paths[0].begin, root_length);
+		cfs_path_output_back(style, buffer, buffer_size, root_length, back, content > 0);
+	}
+
+	cfs_path_terminate_output(buffer, buffer_size, length);
+
+	return length;
+}
+
+CFS_PATH_SPECIALIZE size_t cfs_path_normalize_impl(cfs_path_style style, const char* path, const char* path_end, char* buffer, size_t buffer_size) {
+	cfs_path_range paths[1];
+
+	paths[0].begin = path;
+	paths[0].end = path_end;
+
+	return cfs_path_join_and_normalize_multiple(style, paths, 1, buffer, buffer_size);
+}
+
+
+CFS_PATH_SPECIALIZE bool cfs_path_is_absolute_impl(cfs_path_style style, const char* path, const char* path_end) {
+	size_t length;
+
+	cfs_path_get_root_impl(style, path, path_end, &length);
+	return cfs_path_is_root_absolute(style, path, length);
+}
+
+bool cfs_path_is_absolute(const char* path) {
+	return cfs_path_is_absolute_impl(CFS_PATH_UNIX, path, path + strlen(path));
+}
+
+bool cfs_plat_path_is_absolute(const char* path) {
+	return cfs_path_is_absolute_impl(CFS_PLAT_PATH_STYLE, path, path + strlen(path));
+}
+
+bool cfs_path_is_absolute_n(const char* path, size_t path_length) {
+	return cfs_path_is_absolute_impl(CFS_PATH_UNIX, path, path + path_length);
+}
+
+bool cfs_plat_path_is_absolute_n(const char* path, size_t path_length) {
+	return cfs_path_is_absolute_impl(CFS_PLAT_PATH_STYLE, path, path + path_length);
+}
+
+CFS_PATH_SPECIALIZE size_t cfs_path_get_absolute_impl(cfs_path_style style, const char* base, const char* base_end, const char* path, const char* path_end, char* buffer, size_t buffer_size) {
+	size_t i;
+	cfs_path_range paths[3];
+
+	if(cfs_path_is_absolute_impl(style, base, base_end)) {
+		i = 0;
+	} else {
+		paths[0].begin = seperators[style];
+		paths[0].end = paths[0].begin + 1;
+		i = 1;
+	}
+
+  	if (cfs_path_is_absolute_impl(style, path, path_end)) {
+    // If the submitted path is not relative the base path becomes irrelevant.
+    // We will only normalize the submitted path instead.
+    paths[i].begin = path;
+    paths[i++].end = path_end;
+  } else {
+    // Otherwise we append the relative path to the base path and normalize it.
+    // The result will be a new absolute path.
+    paths[i].begin = base;
+    paths[i++].end = base_end;
+    paths[i].begin = path;
+    paths[i++].end = path_end;
+  }
+
+  // Finally join everything together and normalize it.
+  return cfs_path_join_and_normalize_multiple(style, paths, i, buffer, buffer_size);
+
+}
+
+size_t cfs_path_get_absolute(const char* base, const char* path, char* buffer, size_t buffer_size) {
+	return cfs_path_get_absolute_impl(CFS_PATH_UNIX, base, base + strlen(base), path, path + strlen(path), buffer, buffer_size);
+}
+
+size_t cfs_plat_path_get_absolute(const char* base, const char* path, char* buffer, size_t buffer_size) {
+	return cfs_path_get_absolute_impl(CFS_PLAT_PATH_STYLE, base, base + strlen(base), path, path + strlen(path), buffer, buffer_size);
+}
+
+size_t cfs_path_get_absolute_n(const char* base, size_t base_length, const char* path, size_t path_length, char* buffer, size_t buffer_size) {
+	return cfs_path_get_absolute_impl(CFS_PATH_UNIX, base, base + base_length, path, path + path_length, buffer, buffer_size);
+}
+
+size_t cfs_plat_path_get_absolute_n(const char* base, size_t base_length, const char* path, size_t path_length, char* buffer, size_t buffer_size) {
+	return cfs_path_get_absolute_impl(CFS_PLAT_PATH_STYLE, base, base + base_length, path, path + path_length, buffer, buffer_size);
+}
@@ -1,149 +1,569 @@
-#ifndef __CFS_H__
-#define __CFS_H__
-
-#include <stdarg.h>
-#include <stddef.h>
-#include <stdbool.h>
-#include <stdlib.h>
-
-
-#ifndef cfs_malloc
-    #define cfs_malloc(size) malloc(size)
-#endif
-#ifndef cfs_free
-    #define cfs_free(ptr) free(ptr)
-#endif
-#ifndef cfs_realloc
-    #define cfs_realloc(ptr, size) realloc(ptr, size)
-#endif
-typedef struct cfs_fs_handler cfs_fs_handler;
-typedef struct cfs_fs_handle cfs_fs_handle;
-typedef struct cfs_file_handle cfs_file_handle;
-typedef struct cfs_fs_impl cfs_fs_impl;
-
-typedef cfs_file_handle* (*cfs_fs_impl_open)(cfs_fs_handle* fs, const char* filename, const char* mode);
-typedef long int (*cfs_fs_impl_seek)(cfs_fs_handle* fs, cfs_file_handle* handle, long int offset, int whence);
-typedef long int (*cfs_fs_impl_read)(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz);
-typedef long int (*cfs_fs_impl_write)(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz);
-
-enum {
-    CFS_SEEK_SET,
-    CFS_SEEK_CUR,
-    CFS_SEEK_END
-};
-
-enum {
-    CFS_ERRNOMEM = -1,
-    CFS_ERRNOHANDLER = -2,
-	CFS_ERRPATH = -3,
-};
-
-/*
-    Filesystem implementation struct to be filled by the user defined callbacks 
-    for e.g. stdio / tar / zlib etc.
-*/
-typedef struct cfs_fs_impl {
-    cfs_fs_impl_open open_fn;
-    cfs_fs_impl_seek seek_fn;
-    cfs_fs_impl_read read_fn;
-    cfs_fs_impl_write write_fn;
-} cfs_fs_impl;
-
-typedef struct cfs_fs_handle {
-    cfs_fs_handler* handler;
-    const char* mount;
-    const char* src;
-    void* userdata;
-} cfs_fs_handle;
-
-typedef struct cfs_file_handle {
-    void* handle;
-    cfs_fs_handle* fs_impl;
-} cfs_file_handle;
-
-typedef struct cfs_file {
-
-} cfs_file;
-
-int cfs_fs_impl_register(cfs_fs_impl* impl, const char** extensions, void* userdata);
-int cfs_fs_mount(const char* src, const char* mount);
-
-const char* cfs_getstrerr(int errnum);
-/*
-    File handling functions mirrors stdio functions.
-*/
-int cfs_file_close(cfs_file* file);
-void cfs_file_clear_error(cfs_file* file);
-int cfs_file_eof(cfs_file* file);
-int cfs_file_error(cfs_file* file);
-int cfs_file_flush(cfs_file* file);
-//int cfs_file_getpos(cfs_fs_file* file, long int* pos);
-
-cfs_file_handle* cfs_file_open(const char* filename, const char* mode);
-long int cfs_file_read(cfs_file_handle* file, void* buffer, long int sz);
-long int cfs_file_write(cfs_file_handle* file, void* buffer, long int sz);
-
-int cfs_file_fseek(cfs_file_handle* file, long int offset, int whence);
-long int cfs_file_ftell(cfs_file_handle* file);
-
-
-int cfs_file_fprintf(cfs_file_handle* file, const char* format, ...);
-int cfs_file_vfprintf(cfs_file_handle* file, const char* format, va_list arg);
-
-int cfs_file_fscanf(cfs_file_handle* file, const char* format, ...);
-
-/*
- * Path handling.
- */
-
-typedef struct cfs_path {
-	const char* path;
-	const char* segments;
-	const char* begin;
-	const char* end;
-	long int size;
-} cfs_path;
-
-typedef enum cfs_path_style {
-	CFS_PATH_WINDOWS,
-	CFS_PATH_UNIX
-} cfs_path_style;
-
-enum cfs_path_segment_type {
-	CFS_PATH_NORMAL,
-	CFS_PATH_CURRENT,
-	CFS_PATH_BACK
-};
-
-void cfs_path_basename(const char* path, const char** basename, size_t* length);
-void cfs_path_dirname(const char* path, size_t* length);
-void cfs_plat_path_basename(const char* path, const char** basename, size_t* length);
-void cfs_plat_path_dirname(const char* path, size_t* length);
-
-bool cfs_path_extension(const char* path, const char** extension, size_t* length);
-bool cfs_plat_path_extension(const char* path, const char** extension, size_t* length);
-
-bool cfs_path_has_extension(const char* path);
-bool cfs_plat_path_has_extension(const char* path);
-
-size_t cfs_path_normalize(const char* path, char* buffer, size_t buffer_size);
-size_t cfs_plat_path_normalize(const char* path, char* buffer, size_t buffer_size);
-
-size_t cfs_path_get_intersection(const char* path_base, const char* path_other);
-size_t cfs_plat_path_get_intersection(const char* path_base, const char* path_other);
-
-bool cfs_path_is_sep(cfs_path_style style, const char* str);
-
-void cfs_path_get_root(cfs_path_style style, const char* path, size_t* length);
-
-bool cfs_path_get_first_segment(const char* path, cfs_path* segment);
-bool cfs_path_get_last_segment(const char* path, cfs_path* segment); 
-bool cfs_path_get_next_segment(cfs_path* segment);
-bool cfs_path_get_previous_segment(cfs_path* segment);
-
-bool cfs_plat_path_get_first_segment(const char* path, cfs_path* segment);
-bool cfs_plat_path_get_last_segment(const char* path, cfs_path* segment);
-bool cfs_plat_path_get_next_segment(cfs_path* segment);
-bool cfs_plat_path_get_previous_segment(cfs_path* segment);
-
-#endif
+#ifndef __CFS_H__
+#define __CFS_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+#ifndef cfs_malloc
+    #define cfs_malloc(size) malloc(size)
+#endif
+#ifndef cfs_free
+    #define cfs_free(ptr) free(ptr)
+#endif
+#ifndef cfs_realloc
+    #define cfs_realloc(ptr, size) realloc(ptr, size)
+#endif
+#ifndef CFS_PATH_MAX
+    #define CFS_PATH_MAX 1024
+#endif
+#ifndef CFS_FILE_BUFFER_SIZE
+    #define CFS_FILE_BUFFER_SIZE 65536
+#endif
+#ifndef CFS_ASYNC_WORKERS
+    #define CFS_ASYNC_WORKERS 4
+#endif
+#ifndef CFS_RESOLVE_CACHE_SIZE
+    #define CFS_RESOLVE_CACHE_SIZE 256
+#endif
+#ifndef CFS_STAT_CACHE_SIZE
+    #define CFS_STAT_CACHE_SIZE 256
+#endif
+#ifndef CFS_POOL_CACHE_SIZE
+    #define CFS_POOL_CACHE_SIZE (256 * 1024)
+#endif
+#ifndef CFS_ZIP_CHECKPOINT_SIZE
+    #define CFS_ZIP_CHECKPOINT_SIZE (1024 * 1024)
+#endif
+#ifndef CFS_ZIP_CHECKPOINT_MAX
+    #define CFS_ZIP_CHECKPOINT_MAX 64
+#endif
+#if !defined(CFS_NO_POSIX) && (defined(__unix__) || defined(__APPLE__))
+    #define CFS_POSIX
+#endif
+typedef struct cfs_fs_handler cfs_fs_handler;
+typedef struct cfs_fs_handle cfs_fs_handle;
+typedef struct cfs_file_handle cfs_file_handle;
+typedef struct cfs_file cfs_file;
+typedef struct cfs_fs_impl cfs_fs_impl;
+typedef struct cfs_fs_path cfs_fs_path;
+typedef struct cfs_stat cfs_stat;
+
+/* Buffer of a vectored transfer, laid out like struct iovec. */
+typedef struct cfs_iovec {
+    void* base;
+    size_t size;
+} cfs_iovec;
+
+typedef cfs_file_handle* (*cfs_fs_impl_open)(cfs_fs_handle* fs, const cfs_fs_path* path, const char* mode);
+typedef long int (*cfs_fs_impl_seek)(cfs_fs_handle* fs, cfs_file_handle* handle, long int offset, int whence);
+typedef long int (*cfs_fs_impl_read)(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz);
+typedef long int (*cfs_fs_impl_write)(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz);
+typedef long int (*cfs_fs_impl_read_at)(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz, long int offset);
+typedef long int (*cfs_fs_impl_write_at)(cfs_fs_handle* fs, cfs_file_handle* handle, const void* buffer, long int sz, long int offset);
+typedef long int (*cfs_fs_impl_readv)(cfs_fs_handle* fs, cfs_file_handle* handle, const cfs_iovec* iov, int count);
+typedef long int (*cfs_fs_impl_writev)(cfs_fs_handle* fs, cfs_file_handle* handle, const cfs_iovec* iov, int count);
+typedef int (*cfs_fs_impl_fd)(cfs_fs_handle* fs, cfs_file_handle* handle, int* fd, long int* base, long int* size);
+typedef int (*cfs_fs_impl_stat)(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_stat* info);
+typedef int (*cfs_fs_impl_fstat)(cfs_fs_handle* fs, cfs_file_handle* handle, cfs_stat* info);
+typedef int (*cfs_fs_impl_locate)(cfs_fs_handle* fs, const cfs_fs_path* path, long int* order, long int* size);
+typedef int (*cfs_fs_impl_entry)(void* context, const char* name, size_t length, int type);
+typedef int (*cfs_fs_impl_enumerate)(cfs_fs_handle* fs, const cfs_fs_path* path, cfs_fs_impl_entry entry, void* context);
+typedef int (*cfs_fs_impl_index_entry)(void* context, const char* name, size_t length, long int id);
+typedef int (*cfs_fs_impl_index)(cfs_fs_handle* fs, cfs_fs_impl_index_entry entry, void* context);
+typedef int (*cfs_fs_impl_close)(cfs_fs_handle* fs, cfs_file_handle* handle);
+typedef int (*cfs_fs_impl_mount)(cfs_fs_handle* fs);
+typedef void (*cfs_fs_impl_unmount)(cfs_fs_handle* fs);
+typedef int (*cfs_fs_impl_output)(void* context, const void* data, size_t size);
+typedef int (*cfs_fs_impl_save)(cfs_fs_handle* fs, cfs_fs_impl_output output, void* context);
+typedef int (*cfs_fs_impl_load)(cfs_fs_handle* fs, const void* data, size_t size);
+typedef bool (*cfs_fs_impl_sniff)(const char* src, void* userdata);
+typedef int (*cfs_fs_impl_map)(cfs_fs_handle* fs, cfs_file_handle* handle, const void** data, size_t* size);
+typedef void (*cfs_fs_impl_unmap)(cfs_fs_handle* fs, cfs_file_handle* handle, const void* data, size_t size);
+
+enum {
+    CFS_SEEK_SET,
+    CFS_SEEK_CUR,
+    CFS_SEEK_END
+};
+
+enum {
+    CFS_DIRENT_FILE,
+    CFS_DIRENT_DIRECTORY
+};
+
+/* Metadata of a file or directory. */
+struct cfs_stat {
+    /* Size in bytes, 0 for directories. */
+    long int size;
+    /* Modification time in ns since the epoch, 0 if unknown. */
+    int64_t mtime;
+    /* A CFS_DIRENT_ type. */
+    int type;
+};
+
+enum {
+    CFS_ERRNOMEM = -1,
+    CFS_ERRNOHANDLER = -2,
+	CFS_ERRPATH = -3,
+	CFS_ERRNAMETOOLONG = -4,
+	CFS_ERRIO = -5,
+	CFS_ERRBUSY = -6,
+	CFS_ERRNOENT = -7,
+};
+
+/*
+    Filesystem implementation struct to be filled by the user defined callbacks 
+    for e.g. stdio / tar / zlib etc.
+    read_fn and write_fn return the number of bytes transferred, 0 at the end
+    of the file and a negative value on failure. seek_fn returns the new offset
+    from the start of the file or a negative value on failure.
+*/
+typedef struct cfs_fs_impl {
+    cfs_fs_impl_open open_fn;
+    cfs_fs_impl_seek seek_fn;
+    cfs_fs_impl_read read_fn;
+    cfs_fs_impl_write write_fn;
+    /* Optional, only used by handlers registered as content sniffers. */
+    cfs_fs_impl_sniff sniff_fn;
+    /*
+        Optional, hands out the whole file as a pointer which stays valid until
+        unmap_fn, e.g. from mmap or an in-memory archive. Returns 0 or a
+        negative error code.
+    */
+    cfs_fs_impl_map map_fn;
+    cfs_fs_impl_unmap unmap_fn;
+    /*
+        Optional, transfer at offset without using or moving the position of
+        handle, so they may be called from several threads at once.
+    */
+    cfs_fs_impl_read_at read_at_fn;
+    cfs_fs_impl_write_at write_at_fn;
+    /*
+        Optional, transfer into or out of count buffers in order at the position
+        of handle like read_fn and write_fn.
+    */
+    cfs_fs_impl_readv readv_fn;
+    cfs_fs_impl_writev writev_fn;
+    /*
+        Optional, reports that the contents of handle are the size bytes of the
+        descriptor fd starting at base, size -1 meaning up to its end, so the
+        core can read them itself, e.g. asynchronously. Returns 0 or a negative
+        error code if it can not.
+    */
+    cfs_fs_impl_fd fd_fn;
+    /*
+        Optional, finds path without opening it. Stores its size and a key
+        ordering it by position in the source, e.g. its offset in an archive,
+        and returns 0 or CFS_ERRNOENT.
+    */
+    cfs_fs_impl_locate locate_fn;
+    /*
+        Optional, fill info for path, which may be a directory, or for the
+        open handle without any I/O where possible. stat_fn returns 0 or
+        CFS_ERRNOENT, fstat_fn 0 or a negative error code. Without them the
+        core opens the file and seeks to its end instead.
+    */
+    cfs_fs_impl_stat stat_fn;
+    cfs_fs_impl_fstat fstat_fn;
+    /*
+        Optional, lists the directory path by calling entry with context, the
+        name of each of its entries and their CFS_DIRENT_ type. Stops at and
+        returns the first negative value entry returns. Returns 0 or
+        CFS_ERRNOENT if path is no directory.
+    */
+    cfs_fs_impl_enumerate enumerate_fn;
+    /*
+        Optional, for sources whose contents do not change while mounted.
+        Reports every file by calling entry with context, its normalized path
+        relative to the mount point and an id of at least 0, which open_fn is
+        then passed in cfs_fs_path to find it by. Returns 0 or a negative error
+        code, e.g. the first negative value entry returned.
+    */
+    cfs_fs_impl_index index_fn;
+    /* Optional, releases handle and everything open_fn allocated for it. */
+    cfs_fs_impl_close close_fn;
+    /* Optional, called once src is mounted, may set fs->userdata. */
+    cfs_fs_impl_mount mount_fn;
+    /*
+        Optional, releases what mount_fn set up. Called once src is unmounted
+        and the last file opened from it is closed.
+    */
+    cfs_fs_impl_unmount unmount_fn;
+    /*
+        Optional, for snapshots. save_fn writes what mount_fn read from src by
+        calling output with context. When a snapshot is loaded and src did not
+        change, load_fn is called with those bytes instead of mount_fn. They
+        are only valid for the duration of the call. Both return 0 or a
+        negative error code, load_fn failing falls back to mount_fn.
+    */
+    cfs_fs_impl_save save_fn;
+    cfs_fs_impl_load load_fn;
+} cfs_fs_impl;
+
+/*
+    The path a backend is asked to open, relative to its mount point and already
+    normalized: no root, no '.' or '..' segments and single '/' separators. name
+    is terminated and only valid for the duration of the call. hash is
+    cfs_path_hash(name, length), so backends keeping an index of their entries
+    can look it up without hashing again. id is the one index_fn reported for
+    the path or -1.
+*/
+typedef struct cfs_fs_path {
+    const char* name;
+    size_t length;
+    uint32_t hash;
+    long int id;
+} cfs_fs_path;
+
+typedef struct cfs_fs_handle {
+    cfs_fs_handler* handler;
+    const char* mount;
+    size_t mount_length;
+    const char* src;
+    void* userdata;
+} cfs_fs_handle;
+
+typedef struct cfs_file_handle {
+    void* handle;
+    cfs_fs_handle* fs_impl;
+} cfs_file_handle;
+
+/*
+    Registers impl for every extension in the NULL terminated extensions list.
+    Extensions are matched case insensitively with or without their leading dot,
+    "" matches sources without an extension such as directories.
+*/
+int cfs_fs_impl_register(cfs_fs_impl* impl, const char** extensions, void* userdata);
+/*
+    Registers impl as a content sniffer consulted, lowest priority first, for
+    sources whose extension has no handler. impl->sniff_fn must be set.
+*/
+int cfs_fs_impl_register_sniffer(cfs_fs_impl* impl, int priority, void* userdata);
+/*
+    Pooled memory for state that lives as long as an open file, such as what
+    open_fn returns. Sizes up to 64 KiB are rounded up to a power of two and
+    freed blocks are kept per thread, up to CFS_POOL_CACHE_SIZE bytes of each
+    size, so opening and closing files settles into reusing them instead of
+    calling cfs_malloc. A block is freed with the size it was allocated with,
+    from any thread.
+*/
+void* cfs_pool_alloc(size_t size);
+void cfs_pool_free(void* ptr, size_t size);
+/*
+    Mounting, unmounting and registering may happen from any thread at any
+    time. Opening files never waits for them: it sees the mounts as they were
+    when it started.
+*/
+int cfs_fs_mount(const char* src, const char* mount);
+/*
+    Removes the most recent mount of src at mount, or returns CFS_ERRNOENT.
+    Files already opened from it stay usable until they are closed.
+*/
+int cfs_fs_unmount(const char* src, const char* mount);
+/*
+    cfs_file_open remembers which mount each path it opened for reading was
+    found in, or that it was found in none, until mounts change or a file is
+    opened for writing. Call this after changing what a source contains behind
+    cfs's back, e.g. creating files in a mounted directory directly. This
+    also drops the results cached by cfs_file_stat.
+*/
+void cfs_fs_invalidate(void);
+/*
+    Indexed mode, off by default. Mounting merges the files of every source
+    whose backend has index_fn into one index keyed by virtual path, opening a
+    file then takes a single lookup in it instead of asking every mount.
+    Unmounting rebuilds the index.
+*/
+int cfs_fs_set_indexed(bool indexed);
+
+#ifdef CFS_POSIX
+/*
+    Registers the built in POSIX backend for sources without an extension, so
+    directories can be mounted. Files are accessed with pread/pwrite and mapped
+    with mmap.
+*/
+int cfs_fs_posix_register(void);
+/*
+    Registers the built in ZIP backend for .zip and .pk3 archives. Entries are
+    read only, stored ones are mapped straight from the archive and deflated
+    ones are inflated while reading. Every CFS_ZIP_CHECKPOINT_SIZE bytes of a
+    deflated entry a checkpoint of the decoder (about 38 KiB) is kept the
+    first time it is read past, so seeking back costs at most that much
+    inflating. An open file keeps at most CFS_ZIP_CHECKPOINT_MAX of them.
+    Reading past the last one drops every other checkpoint and doubles the
+    spacing, so memory stays bounded for entries of any size.
+*/
+int cfs_fs_zip_register(void);
+/*
+    Snapshots. cfs_snapshot_save writes the current mounts to filename, with
+    the saved state of every source whose backend has save_fn and, in indexed
+    mode, the merged index. cfs_snapshot_load mounts them again after any
+    existing mounts. Sources whose size and modification time still match are
+    restored from their saved state, all others are mounted as usual. If
+    nothing was mounted before, the saved index is used in place from the
+    mapped file for the sources up to the first one which changed, the files
+    of the rest are indexed as usual. Returns 0 or the first error of any
+    source, which is then left out.
+*/
+int cfs_snapshot_save(const char* filename);
+int cfs_snapshot_load(const char* filename);
+#endif
+
+/* Hash used for cfs_fs_path, 32 bit FNV-1a over the bytes of the path. */
+uint32_t cfs_path_hash(const char* path, size_t length);
+
+/*
+    Error of the last call on this thread which failed without returning an
+    error code. cfs_file_open fails with CFS_ERRNOENT if no mount has the file,
+    or with the error a backend ran into looking for it.
+*/
+int cfs_geterr(void);
+const char* cfs_getstrerr(int errnum);
+/*
+    File handling functions mirrors stdio functions. Files are buffered with
+    CFS_FILE_BUFFER_SIZE bytes unless changed with cfs_file_setbuffer.
+*/
+cfs_file* cfs_file_open(const char* filename, const char* mode);
+int cfs_file_close(cfs_file* file);
+void cfs_file_clear_error(cfs_file* file);
+int cfs_file_eof(cfs_file* file);
+int cfs_file_error(cfs_file* file);
+int cfs_file_flush(cfs_file* file);
+//int cfs_file_getpos(cfs_fs_file* file, long int* pos);
+
+/*
+    Size, modification time and type of path, found like cfs_file_open finds
+    it. Mount points and their parents are directories. Each thread caches
+    its last CFS_STAT_CACHE_SIZE results, including paths which do not exist,
+    until mounts change, data is written through cfs or cfs_fs_invalidate is
+    called. Returns 0 or a negative error code.
+*/
+int cfs_file_stat(const char* path, cfs_stat* info);
+/* Like cfs_file_stat for an open file, pending writes are flushed first. */
+int cfs_file_fstat(cfs_file* file, cfs_stat* info);
+
+/*
+    Replaces the buffer of file with the size bytes at buffer, which must stay
+    valid until the file is closed. A NULL buffer is allocated on demand and a
+    size of 0 makes the file unbuffered.
+*/
+int cfs_file_setbuffer(cfs_file* file, char* buffer, size_t size);
+
+long int cfs_file_read(cfs_file* file, void* buffer, long int sz);
+long int cfs_file_write(cfs_file* file, void* buffer, long int sz);
+
+/*
+    Vectored reads and writes, filling or draining the count buffers of iov in
+    order. Returns the number of bytes transferred. Large transfers reach the
+    backend as few readv_fn/writev_fn calls.
+*/
+long int cfs_file_readv(cfs_file* file, const cfs_iovec* iov, int count);
+long int cfs_file_writev(cfs_file* file, const cfs_iovec* iov, int count);
+
+/*
+    Maps the whole file and returns its contents in data and size, valid until
+    cfs_file_unmap or cfs_file_close. Backends without map_fn get a copy read
+    into memory instead. Mapping a mapped file returns the same mapping. The
+    file position is not changed.
+*/
+int cfs_file_map(cfs_file* file, const void** data, size_t* size);
+void cfs_file_unmap(cfs_file* file);
+
+/*
+    Positional reads and writes which neither use nor move the file position.
+    They return the number of bytes transferred, 0 at the end of the file or a
+    negative error code. With a backend providing read_at_fn/write_at_fn they
+    may be used from several threads on the same file as long as no buffered
+    writes are pending, otherwise they fall back to seeking.
+*/
+long int cfs_file_read_at(cfs_file* file, void* buffer, long int sz, long int offset);
+long int cfs_file_write_at(cfs_file* file, const void* buffer, long int sz, long int offset);
+
+int cfs_file_fseek(cfs_file* file, long int offset, int whence);
+long int cfs_file_ftell(cfs_file* file);
+
+
+int cfs_file_fprintf(cfs_file* file, const char* format, ...);
+int cfs_file_vfprintf(cfs_file* file, const char* format, va_list arg);
+
+int cfs_file_fscanf(cfs_file* file, const char* format, ...);
+
+/*
+    Result of cfs_file_read_many. data holds the whole file, allocated with
+    cfs_malloc and owned by the caller, if error is 0.
+*/
+typedef struct cfs_read_output {
+    void* data;
+    size_t size;
+    int error;
+} cfs_read_output;
+
+/*
+    Loads the n files at paths into outputs. Paths are resolved in one pass
+    and read grouped by mount in the order they are stored in their source.
+    Returns the number of files loaded or a negative error code.
+*/
+int cfs_file_read_many(const char** paths, cfs_read_output* outputs, size_t n);
+
+/*
+    Directories. A directory lists the mount points directly below it and the
+    entries of every mount at or above it with enumerate_fn. A name found in
+    several mounts is listed once, for the mount cfs_file_open would use.
+    The listing is taken when the directory is opened.
+*/
+typedef struct cfs_dir cfs_dir;
+
+typedef struct cfs_dirent {
+    const char* name;
+    size_t length;
+    int type;
+} cfs_dirent;
+
+cfs_dir* cfs_dir_open(const char* path);
+/*
+    Fills entries with up to max further entries and returns how many, 0 once
+    all were returned. Names are terminated and stay valid until the
+    directory is closed.
+*/
+size_t cfs_dir_next(cfs_dir* dir, cfs_dirent* entries, size_t max);
+int cfs_dir_close(cfs_dir* dir);
+
+/*
+    Asynchronous reads. A queue keeps up to depth reads in flight. Reads from
+    backends with fd_fn are served by io_uring where available, all others by
+    CFS_ASYNC_WORKERS worker threads. A queue must only be used by one thread
+    at a time and the buffers of queued reads must stay valid until their
+    result was returned.
+*/
+typedef struct cfs_async cfs_async;
+
+typedef struct cfs_async_result {
+    void* userdata;
+    /* Bytes read, 0 at the end of the file or a negative error code. */
+    long int result;
+} cfs_async_result;
+
+cfs_async* cfs_async_create(unsigned int depth);
+/*
+    Waits for every read in flight, their results are dropped. Should io_uring
+    fail, the reads still in its ring are cancelled with it instead.
+*/
+void cfs_async_destroy(cfs_async* async);
+/*
+    Queues a read of sz bytes at offset of file, it is passed on with the next
+    cfs_async_submit, _poll or _wait. Returns CFS_ERRBUSY if depth reads are in
+    flight already.
+*/
+int cfs_async_read(cfs_async* async, cfs_file* file, void* buffer, long int sz, long int offset, void* userdata);
+int cfs_async_submit(cfs_async* async);
+/* Stores up to max completed reads in results and returns their count. */
+int cfs_async_poll(cfs_async* async, cfs_async_result* results, int max);
+/* Like cfs_async_poll but blocks until min reads completed. */
+int cfs_async_wait(cfs_async* async, cfs_async_result* results, int min, int max);
+
+/*
+ * Path handling.
+ */
+
+typedef struct cfs_path {
+	const char* path;
+	const char* segments;
+	const char* begin;
+	const char* end;
+	long int size;
+	const char* path_end;
+} cfs_path;
+
+typedef enum cfs_path_style {
+	CFS_PATH_WINDOWS,
+	CFS_PATH_UNIX
+} cfs_path_style;
+
+enum cfs_path_segment_type {
+	CFS_PATH_NORMAL,
+	CFS_PATH_CURRENT,
+	CFS_PATH_BACK
+};
+
+void cfs_path_basename(const char* path, const char** basename, size_t* length);
+void cfs_path_dirname(const char* path, size_t* length);
+void cfs_plat_path_basename(const char* path, const char** basename, size_t* length);
+void cfs_plat_path_dirname(const char* path, size_t* length);
+
+bool cfs_path_extension(const char* path, const char** extension, size_t* length);
+bool cfs_plat_path_extension(const char* path, const char** extension, size_t* length);
+
+bool cfs_path_has_extension(const char* path);
+bool cfs_plat_path_has_extension(const char* path);
+
+/*
+    Normalizes path into buffer and returns the length of the full result, which
+    is truncated if it does not fit. Nothing past the terminator is written.
+*/
+size_t cfs_path_normalize(const char* path, char* buffer, size_t buffer_size);
+size_t cfs_plat_path_normalize(const char* path, char* buffer, size_t buffer_size);
+
+size_t cfs_path_get_intersection(const char* path_base, const char* path_other);
+size_t cfs_plat_path_get_intersection(const char* path_base, const char* path_other);
+
+bool cfs_path_is_absolute(const char* path);
+bool cfs_plat_path_is_absolute(const char* path);
+
+size_t cfs_path_get_absolute(const char* base, const char* path, char* buffer, size_t buffer_size);
+size_t cfs_plat_path_get_absolute(const char* base, const char* path, char* buffer, size_t buffer_size);
+
+bool cfs_path_is_sep(cfs_path_style style, const char* str);
+
+void cfs_path_get_root(cfs_path_style style, const char* path, size_t* length);
+
+bool cfs_path_get_first_segment(const char* path, cfs_path* segment);
+bool cfs_path_get_last_segment(const char* path, cfs_path* segment); 
+bool cfs_path_get_next_segment(cfs_path* segment);
+bool cfs_path_get_previous_segment(cfs_path* segment);
+
+bool cfs_plat_path_get_first_segment(const char* path, cfs_path* segment);
+bool cfs_plat_path_get_last_segment(const char* path, cfs_path* segment);
+bool cfs_plat_path_get_next_segment(cfs_path* segment);
+bool cfs_plat_path_get_previous_segment(cfs_path* segment);
+
+/*
+    Length delimited variants. The path is the path_length bytes at path and
+    does not need to be terminated, so names can be used in place, e.g. inside
+    a mapped archive index. Segments found with these are iterated with the
+    usual next and previous segment functions.
+*/
+void cfs_path_basename_n(const char* path, size_t path_length, const char** basename, size_t* length);
+void cfs_path_dirname_n(const char* path, size_t path_length, size_t* length);
+void cfs_plat_path_basename_n(const char* path, size_t path_length, const char** basename, size_t* length);
+void cfs_plat_path_dirname_n(const char* path, size_t path_length, size_t* length);
+
+bool cfs_path_extension_n(const char* path, size_t path_length, const char** extension, size_t* length);
+bool cfs_plat_path_extension_n(const char* path, size_t path_length, const char** extension, size_t* length);
+
+bool cfs_path_has_extension_n(const char* path, size_t path_length);
+bool cfs_plat_path_has_extension_n(const char* path, size_t path_length);
+
+size_t cfs_path_normalize_n(const char* path, size_t path_length, char* buffer, size_t buffer_size);
+size_t cfs_plat_path_normalize_n(const char* path, size_t path_length, char* buffer, size_t buffer_size);
+
+size_t cfs_path_get_intersection_n(const char* path_base, size_t base_length, const char* path_other, size_t other_length);
+size_t cfs_plat_path_get_intersection_n(const char* path_base, size_t base_length, const char* path_other, size_t other_length);
+
+bool cfs_path_is_absolute_n(const char* path, size_t path_length);
+bool cfs_plat_path_is_absolute_n(const char* path, size_t path_length);
+
+size_t cfs_path_get_absolute_n(const char* base, size_t base_length, const char* path, size_t path_length, char* buffer, size_t buffer_size);
+size_t cfs_plat_path_get_absolute_n(const char* base, size_t base_length, const char* path, size_t path_length, char* buffer, size_t buffer_size);
+
+void cfs_path_get_root_n(cfs_path_style style, const char* path, size_t path_length, size_t* length);
+
+bool cfs_path_get_first_segment_n(const char* path, size_t path_length, cfs_path* segment);
+bool cfs_path_get_last_segment_n(const char* path, size_t path_length, cfs_path* segment);
+bool cfs_plat_path_get_first_segment_n(const char* path, size_t path_length, cfs_path* segment);
+bool cfs_plat_path_get_last_segment_n(const char* path, size_t path_length, cfs_path* segment);
+
+#endif
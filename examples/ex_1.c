@@ -3,14 +3,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-cfs_file_handle* stdio_open(cfs_fs_handle* handle, const char* filename, const char* mode) {
-	printf("stdio open called: %s\n", filename);
+cfs_file_handle* stdio_open(cfs_fs_handle* handle, const cfs_fs_path* path, const char* mode) {
 	char buf[1024];
-	size_t len = cfs_plat_path_normalize(filename, buf, sizeof(buf));
-	printf("stdio open called (normalized): %s\n", buf);
+	snprintf(buf, sizeof(buf), "%s/%.*s", handle->src, (int)path->length, path->name);
+	printf("stdio open called: %s\n", buf);
 
     cfs_file_handle* file = malloc(sizeof(cfs_file_handle));
-    file->handle = fopen(filename, mode);
+    file->handle = fopen(buf, mode);
     file->fs_impl = handle;
 	if(file->handle == NULL) {
 		free(file);
@@ -21,7 +20,7 @@ cfs_file_handle* stdio_open(cfs_fs_handle* handle, const char* filename, const c
 
 long int stdio_read(cfs_fs_handle* handle, cfs_file_handle* file, void* buffer, long int sz) {
     FILE* fp = (FILE*)file->handle;
-    long int ret = fread(buffer, sz, sizeof(unsigned char), fp);
+    long int ret = fread(buffer, sizeof(unsigned char), sz, fp);
     return ret;
 }
 
@@ -39,17 +38,29 @@ long int stdio_seek(cfs_fs_handle* handle, cfs_file_handle* file, long int offse
             stdio_whence = SEEK_END;
             break;
     }
-    return fseek(fp, offset, stdio_whence);
+    if(fseek(fp, offset, stdio_whence) != 0) {
+        return -1;
+    }
+    return ftell(fp);
 }
 
 long int stdio_write(cfs_fs_handle* handle, cfs_file_handle* file, void* buffer, long int sz) {
-    return 0;
+    FILE* fp = (FILE*)file->handle;
+    return fwrite(buffer, sizeof(unsigned char), sz, fp);
 }
+
+int stdio_close(cfs_fs_handle* handle, cfs_file_handle* file) {
+    int ret = fclose((FILE*)file->handle);
+    free(file);
+    return ret == 0 ? 0 : CFS_ERRIO;
+}
+
 static cfs_fs_impl stdio_impl = {
     .open_fn = stdio_open,
     .read_fn = stdio_read,
     .seek_fn = stdio_seek,
-    .write_fn = stdio_write
+    .write_fn = stdio_write,
+    .close_fn = stdio_close
 };
 
 static const char* exts[] = {
@@ -68,16 +79,21 @@ int main(int argc, char** argv) {
         printf("cfs error: %s\n", cfs_getstrerr(err));
         return -1;
     }
-    cfs_file_handle* file = cfs_file_open("/../yolo.txt", "r");
-	cfs_file_handle* f2 = cfs_file_open("/boobs/../../yoloy.txt", "r");
+    cfs_file* file = cfs_file_open("/../yolo.txt", "r");
+	cfs_file* f2 = cfs_file_open("/boobs/../../yoloy.txt", "r");
 	const char* buf2;
 	size_t length;
 	cfs_path_basename("/bono/yokoko.txt", &buf2, &length);
 	printf("basnemae: %.*s\n", length, buf2);
 
+    if(file == NULL) {
+        printf("could not open /yolo.txt\n");
+        return -1;
+    }
     char buf[16];
-    cfs_file_read(file, buf, 16);
-    buf[15] = '\0';
+    long int n = cfs_file_read(file, buf, sizeof(buf) - 1);
+    buf[n] = '\0';
     printf("%s", buf);
+    cfs_file_close(file);
     return 0;
 }
@@ -0,0 +1,264 @@
+/*
+ * Asynchronous reads from a directory mount, whose files io_uring serves,
+ * and from tests/data/basic.zip, whose stored entry io_uring serves as a
+ * range of the archive and whose deflated entry the worker pool inflates.
+ *
+ * - A queue takes depth reads and refuses the next with CFS_ERRBUSY until a
+ *   result was returned.
+ * - A few thousand reads at random offsets, some past the end, go through
+ *   a queue kept full. Every result must come back exactly once with its
+ *   userdata and the bytes a plain read returns.
+ * - Destroying a queue with reads in flight waits for them, and still
+ *   returns when its ring fails.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+#define TEST_DEPTH 16
+#define TEST_DATA_SIZE 300000
+#define TEST_READ 8192
+
+typedef struct test_source {
+	const char* path;
+	cfs_file* file;
+	const char* data;
+	size_t size;
+} test_source;
+
+typedef struct test_request {
+	test_source* source;
+	long int offset;
+	long int size;
+	bool queued;
+	char buffer[TEST_READ];
+} test_request;
+
+static char test_root[] = "/tmp/cfs_async_XXXXXX";
+static char test_data[TEST_DATA_SIZE];
+static char test_lines_data[16384];
+static test_source test_sources[4];
+static test_request test_requests[TEST_DEPTH * 2];
+static int test_failures;
+
+// The lines dynamic.txt was made of.
+static size_t test_lines(char* out) {
+	size_t length = 0;
+	int i;
+
+	for(i = 0; i < 200; i++) {
+		length += (size_t)sprintf(out + length, "line %d: the quick brown fox jumps over the lazy dog %d\n", i, i * i % 97);
+	}
+	return length;
+}
+
+static uint32_t test_random(void) {
+	static uint32_t x = 1;
+
+	x = (x * 1103515245u + 12345u) & 0x7fffffffu;
+	return x >> 8;
+}
+
+static void test_queue(cfs_async* async, test_request* req, test_source* source, long int offset, long int size) {
+	int err;
+
+	req->source = source;
+	req->offset = offset;
+	req->size = size;
+	memset(req->buffer, 0xee, sizeof(req->buffer));
+	if((err = cfs_async_read(async, source->file, req->buffer, size, offset, req)) < 0) {
+		fprintf(stderr, "%s: queueing failed: %s\n", source->path, cfs_getstrerr(err));
+		test_failures++;
+		return;
+	}
+	req->queued = true;
+}
+
+static void test_check(const cfs_async_result* result) {
+	test_request* req = result->userdata;
+	long int want;
+
+	if(req < test_requests || req >= test_requests + TEST_DEPTH * 2 || !req->queued) {
+		fprintf(stderr, "result with unknown userdata %p\n", result->userdata);
+		test_failures++;
+		return;
+	}
+	req->queued = false;
+	want = req->offset >= (long int)req->source->size ? 0 : (long int)req->source->size - req->offset;
+	if(want > req->size) {
+		want = req->size;
+	}
+	if(result->result != want || memcmp(req->buffer, req->source->data + (want > 0 ? req->offset : 0), (size_t)want) != 0) {
+		fprintf(stderr, "%s: read of %ld at %ld returned %ld, expected %ld\n", req->source->path, req->size, req->offset, result->result, want);
+		test_failures++;
+	}
+}
+
+static void test_depth(void) {
+	cfs_async* async = cfs_async_create(TEST_DEPTH);
+	cfs_async_result results[TEST_DEPTH];
+	test_request extra;
+	int i, n;
+
+	for(i = 0; i < TEST_DEPTH; i++) {
+		test_queue(async, &test_requests[i], &test_sources[i % 4], i * 3, 100);
+	}
+	if(cfs_async_read(async, test_sources[0].file, extra.buffer, 100, 0, &extra) != CFS_ERRBUSY) {
+		fprintf(stderr, "read beyond the depth accepted\n");
+		test_failures++;
+	}
+	n = cfs_async_wait(async, results, TEST_DEPTH, TEST_DEPTH);
+	if(n != TEST_DEPTH) {
+		fprintf(stderr, "%d of %d reads completed\n", n, TEST_DEPTH);
+		test_failures++;
+	}
+	for(i = 0; i < n; i++) {
+		test_check(&results[i]);
+	}
+	// Room again.
+	test_queue(async, &test_requests[0], &test_sources[2], 0, 100);
+	if(cfs_async_wait(async, results, 1, TEST_DEPTH) != 1) {
+		fprintf(stderr, "read after the queue drained did not complete\n");
+		test_failures++;
+	}
+	test_check(&results[0]);
+	if(cfs_async_poll(async, results, TEST_DEPTH) != 0) {
+		fprintf(stderr, "idle queue returned results\n");
+		test_failures++;
+	}
+	cfs_async_destroy(async);
+}
+
+static void test_mixed(void) {
+	cfs_async* async = cfs_async_create(TEST_DEPTH);
+	cfs_async_result results[TEST_DEPTH];
+	test_source* source;
+	long int offset, size;
+	size_t slot = 0;
+	int i, j, n, pending = 0;
+
+	for(i = 0; i < 4000; i++) {
+		source = &test_sources[test_random() % 4];
+		offset = (long int)(test_random() % (source->size + 64));
+		size = (long int)(1 + test_random() % TEST_READ);
+		while(test_requests[slot].queued) {
+			slot = (slot + 1) % (TEST_DEPTH * 2);
+		}
+		while(cfs_async_read(async, source->file, test_requests[slot].buffer, size, offset, &test_requests[slot]) == CFS_ERRBUSY) {
+			n = cfs_async_wait(async, results, 1, TEST_DEPTH);
+			for(j = 0; j < n; j++) {
+				test_check(&results[j]);
+			}
+			pending -= n;
+		}
+		test_requests[slot].source = source;
+		test_requests[slot].offset = offset;
+		test_requests[slot].size = size;
+		test_requests[slot].queued = true;
+		pending++;
+		if(i % 7 == 0) {
+			cfs_async_submit(async);
+		}
+	}
+	while(pending > 0 && (n = cfs_async_wait(async, results, 1, TEST_DEPTH)) > 0) {
+		for(j = 0; j < n; j++) {
+			test_check(&results[j]);
+		}
+		pending -= n;
+	}
+	if(pending != 0) {
+		fprintf(stderr, "%d reads never completed\n", pending);
+		test_failures++;
+	}
+	cfs_async_destroy(async);
+}
+
+static void test_destroy(void) {
+	cfs_async* async = cfs_async_create(TEST_DEPTH);
+	int i, fd;
+
+	for(i = 0; i < TEST_DEPTH; i++) {
+		test_queue(async, &test_requests[i], &test_sources[i % 4], i, TEST_READ);
+	}
+	cfs_async_destroy(async);
+
+	// A ring whose descriptor went bad.
+	async = cfs_async_create(TEST_DEPTH);
+	if(async->ring_fd >= 0) {
+		for(i = 0; i < TEST_DEPTH; i++) {
+			test_queue(async, &test_requests[i], &test_sources[i % 2], i, TEST_READ);
+		}
+		fd = open("/dev/null", O_RDONLY);
+		dup2(fd, async->ring_fd);
+		close(fd);
+	}
+	cfs_async_destroy(async);
+	for(i = 0; i < TEST_DEPTH * 2; i++) {
+		test_requests[i].queued = false;
+	}
+}
+
+int main(void) {
+	char path[600];
+	size_t i;
+	FILE* f;
+
+	// A queue which never drains ends the test instead of hanging it.
+	alarm(60);
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	for(i = 0; i < TEST_DATA_SIZE; i++) {
+		test_data[i] = (char)((i * 2654435761u) >> 13);
+	}
+	snprintf(path, sizeof(path), "%s/data.bin", test_root);
+	f = fopen(path, "wb");
+	fwrite(test_data, 1, TEST_DATA_SIZE, f);
+	fclose(f);
+
+	cfs_fs_posix_register();
+	cfs_fs_zip_register();
+	cfs_fs_mount(test_root, "/");
+	cfs_fs_mount("tests/data/basic.zip", "/zip");
+	test_sources[0] = (test_source){"/data.bin", NULL, test_data, TEST_DATA_SIZE};
+	test_sources[1] = (test_source){"/zip/stored.txt", NULL, "stored contents\n", 16};
+	test_sources[2] = (test_source){"/zip/dynamic.txt", NULL, test_lines_data, test_lines(test_lines_data)};
+	test_sources[3] = (test_source){"/data.bin", NULL, test_data, TEST_DATA_SIZE};
+	for(i = 0; i < 4; i++) {
+		if((test_sources[i].file = cfs_file_open(test_sources[i].path, "rb")) == NULL) {
+			fprintf(stderr, "%s not found\n", test_sources[i].path);
+			return 1;
+		}
+	}
+	// A second handle of the same file, partly written through cfs so the
+	// pending bytes are flushed before the read is queued.
+	cfs_file_close(test_sources[3].file);
+	test_sources[3].file = cfs_file_open("/data.bin", "r+b");
+	cfs_file_write(test_sources[3].file, test_data, 100);
+
+	test_depth();
+	test_mixed();
+	test_destroy();
+
+	for(i = 0; i < 4; i++) {
+		cfs_file_close(test_sources[i].file);
+	}
+	remove(path);
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Directory listings merged across overlays. Two directories and
+ * tests/data/basic.zip are mounted at "/", with one directory again at
+ * "/mnt/deep" and the other at "/dir/inner". Each name must be listed once,
+ * with the type of the first mount holding it, and mount points directly
+ * below a directory must show up as directories. Listings are read in
+ * chunks of several sizes, with and without indexed mode, and again after
+ * the first overlay was unmounted.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static char test_root[] = "/tmp/cfs_dir_XXXXXX";
+static char test_upper[512];
+static char test_lower[512];
+static int test_failures;
+
+static void test_write(const char* name, const char* contents) {
+	char path[512];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void test_mkdir(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(mkdir(path, 0777) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void test_remove(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	remove(path);
+}
+
+static int test_compare(const void* a, const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+// The listing of path as its sorted names, directories with a trailing '/'.
+static bool test_list(const char* path, size_t chunk, char* out, size_t size) {
+	char names[64][64];
+	const char* sorted[64];
+	cfs_dirent entries[64];
+	size_t count = 0, n, i;
+	cfs_dir* dir;
+
+	if((dir = cfs_dir_open(path)) == NULL) {
+		return false;
+	}
+	while((n = cfs_dir_next(dir, entries, chunk)) > 0) {
+		for(i = 0; i < n && count < 64; i++, count++) {
+			if(entries[i].length != strlen(entries[i].name)) {
+				fprintf(stderr, "%s: length of %s is %zu\n", path, entries[i].name, entries[i].length);
+				test_failures++;
+			}
+			snprintf(names[count], sizeof(names[count]), "%s%s", entries[i].name, entries[i].type == CFS_DIRENT_DIRECTORY ? "/" : "");
+			sorted[count] = names[count];
+		}
+	}
+	cfs_dir_close(dir);
+	qsort(sorted, count, sizeof(sorted[0]), test_compare);
+	out[0] = '\0';
+	for(i = 0; i < count; i++) {
+		snprintf(out + strlen(out), size - strlen(out), "%s%s", i > 0 ? " " : "", sorted[i]);
+	}
+	return true;
+}
+
+static void test_expect(const char* label, const char* path, const char* expected) {
+	static const size_t chunks[] = {1, 3, 64};
+	char listed[4096];
+	size_t i;
+
+	for(i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		if(!test_list(path, chunks[i], listed, sizeof(listed))) {
+			fprintf(stderr, "%s: %s could not be opened (%d)\n", label, path, cfs_geterr());
+			test_failures++;
+			return;
+		}
+		if(strcmp(listed, expected) != 0) {
+			fprintf(stderr, "%s: %s in chunks of %zu lists\n  %s\nexpected\n  %s\n", label, path, chunks[i], listed, expected);
+			test_failures++;
+			return;
+		}
+	}
+}
+
+static void test_missing(const char* label, const char* path) {
+	cfs_dir* dir = cfs_dir_open(path);
+
+	if(dir != NULL) {
+		fprintf(stderr, "%s: %s opened\n", label, path);
+		test_failures++;
+		cfs_dir_close(dir);
+	} else if(cfs_geterr() != CFS_ERRNOENT) {
+		fprintf(stderr, "%s: %s failed with %d\n", label, path, cfs_geterr());
+		test_failures++;
+	}
+}
+
+static void test_overlays(const char* label) {
+	test_expect(label, "/", "a.txt b.txt dir/ dynamic.txt empty.txt fixed.txt mnt/ raw.txt rooted/ shared.txt stored.txt twice.txt");
+	test_expect(label, "/./mnt/../", "a.txt b.txt dir/ dynamic.txt empty.txt fixed.txt mnt/ raw.txt rooted/ shared.txt stored.txt twice.txt");
+	// The mount point, upper's files, lower's file "dir" is no directory and
+	// the archive's directory "sub" is behind upper's file.
+	test_expect(label, "/dir", "inner/ sub up.txt");
+	test_expect(label, "/dir/inner", "a.txt dir/ shared.txt stored.txt");
+	test_expect(label, "/mnt", "deep/ m.txt");
+	test_expect(label, "/mnt/deep", "b.txt dir mnt/ shared.txt");
+	test_expect(label, "/rooted", "name.txt");
+	test_missing(label, "/nope");
+	test_missing(label, "/a.txt");
+	test_missing(label, "/dir/nope");
+}
+
+int main(void) {
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	snprintf(test_upper, sizeof(test_upper), "%s/upper", test_root);
+	snprintf(test_lower, sizeof(test_lower), "%s/lower", test_root);
+	test_mkdir("upper");
+	test_mkdir("upper/dir");
+	test_mkdir("lower");
+	test_mkdir("lower/mnt");
+	test_write("upper/a.txt", "upper a\n");
+	test_write("upper/shared.txt", "upper shared\n");
+	test_write("upper/stored.txt", "upper stored\n");
+	test_write("upper/dir/up.txt", "up\n");
+	test_write("upper/dir/sub", "a file where the archive has a directory\n");
+	test_write("lower/shared.txt", "lower shared\n");
+	test_write("lower/b.txt", "lower b\n");
+	test_write("lower/dir", "a file where upper has a directory\n");
+	test_write("lower/mnt/m.txt", "m\n");
+
+	cfs_fs_posix_register();
+	cfs_fs_zip_register();
+	cfs_fs_mount(test_upper, "/");
+	cfs_fs_mount(test_lower, "/");
+	cfs_fs_mount("tests/data/basic.zip", "/");
+	cfs_fs_mount(test_lower, "/mnt/deep");
+	cfs_fs_mount(test_upper, "/dir/inner");
+
+	test_overlays("plain");
+	cfs_fs_set_indexed(true);
+	test_overlays("indexed");
+	cfs_fs_set_indexed(false);
+
+	// Without upper, lower's file "dir" comes first. Listing it as a
+	// directory still finds the archive's.
+	cfs_fs_unmount(test_upper, "/dir/inner");
+	cfs_fs_unmount(test_upper, "/");
+	test_expect("unmounted", "/", "b.txt dir dynamic.txt empty.txt fixed.txt mnt/ raw.txt rooted/ shared.txt stored.txt twice.txt");
+	test_expect("unmounted", "/dir", "sub/");
+
+	test_remove("upper/dir/up.txt");
+	test_remove("upper/dir/sub");
+	test_remove("upper/dir");
+	test_remove("upper/a.txt");
+	test_remove("upper/shared.txt");
+	test_remove("upper/stored.txt");
+	test_remove("upper");
+	test_remove("lower/mnt/m.txt");
+	test_remove("lower/mnt");
+	test_remove("lower/shared.txt");
+	test_remove("lower/b.txt");
+	test_remove("lower/dir");
+	test_remove("lower");
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ * Differential test of the path normalizer against the implementation it
+ * replaced, kept below as a reference with every name prefixed ref_.
+ *
+ * cfs_path_normalize, cfs_plat_path_normalize and cfs_path_get_absolute are
+ * run on every short path over a small alphabet and on random long ones, at
+ * every buffer size from 0 to two past the full result. The returned length
+ * and the buffer up to the terminator must match the reference, every byte
+ * past the terminator must stay as it was.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#define REF_MAX 256
+
+static const char* ref_seperators[] = {
+	"\\/",
+	"/"
+};
+
+typedef struct ref_path {
+	const char* path;
+	const char* segments;
+	const char* begin;
+	const char* end;
+	size_t size;
+} ref_path;
+
+typedef struct ref_segment_joined {
+	ref_path segment;
+	const char** paths;
+	size_t path_index;
+} ref_segment_joined;
+
+static bool ref_is_sep(cfs_path_style style, const char* str) {
+	const char* c;
+
+	for(c = ref_seperators[style]; *c; ++c) {
+		if(*c == *str) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static const char* ref_find_next_stop(cfs_path_style style, const char* c) {
+	while(*c != '\0' && !ref_is_sep(style, c)) {
+		++c;
+	}
+	return c;
+}
+
+static void ref_get_root_windows(const char* path, size_t* length) {
+	const char* c = path;
+	bool is_device_path;
+
+	*length = 0;
+	if(!*c) {
+		return;
+	}
+	if(ref_is_sep(CFS_PATH_WINDOWS, c)) {
+		++c;
+	}
+	if(!ref_is_sep(CFS_PATH_WINDOWS, c)) {
+		++(*length);
+		return;
+	}
+	++c;
+	is_device_path = (*c == '?' || *c == '.') && ref_is_sep(CFS_PATH_WINDOWS, ++c);
+	if(is_device_path) {
+		*length = 4;
+		return;
+	}
+	c = ref_find_next_stop(CFS_PATH_WINDOWS, c);
+	while(ref_is_sep(CFS_PATH_WINDOWS, c)) {
+		++c;
+	}
+	c = ref_find_next_stop(CFS_PATH_WINDOWS, c);
+	if(ref_is_sep(CFS_PATH_WINDOWS, c)) {
+		++c;
+	}
+	*length = (size_t)(c - path);
+}
+
+static void ref_get_root(cfs_path_style style, const char* path, size_t* length) {
+	if(style == CFS_PATH_WINDOWS) {
+		ref_get_root_windows(path, length);
+	} else {
+		*length = ref_is_sep(CFS_PATH_UNIX, path) ? 1 : 0;
+	}
+}
+
+static bool ref_get_first_segment_without_root(cfs_path_style style, const char* path, const char* segments, ref_path* segment) {
+	segment->path = path;
+	segment->segments = segments;
+	segment->begin = segments;
+	segment->end = segments;
+	segment->size = 0;
+
+	if(*segments == '\0') {
+		return false;
+	}
+	while(ref_is_sep(style, segments)) {
+		++segments;
+		if(*segments == '\0') {
+			return false;
+		}
+	}
+	segment->begin = segments;
+	segments = ref_find_next_stop(style, segments);
+	segment->size = (size_t)(segments - segment->begin);
+	segment->end = segments;
+	return true;
+}
+
+static bool ref_get_first_segment(cfs_path_style style, const char* path, ref_path* segment) {
+	size_t length;
+
+	ref_get_root(style, path, &length);
+	return ref_get_first_segment_without_root(style, path, path + length, segment);
+}
+
+static bool ref_get_next_segment(cfs_path_style style, ref_path* segment) {
+	const char* c = segment->begin + segment->size;
+
+	if(*c == '\0') {
+		return false;
+	}
+	do {
+		++c;
+	} while(ref_is_sep(style, c));
+	if(*c == '\0') {
+		return false;
+	}
+	segment->begin = c;
+	c = ref_find_next_stop(style, c);
+	segment->end = c;
+	segment->size = (size_t)(c - segment->begin);
+	return true;
+}
+
+static bool ref_get_last_segment(cfs_path_style style, const char* path, ref_path* segment) {
+	if(!ref_get_first_segment(style, path, segment)) {
+		return false;
+	}
+	while(ref_get_next_segment(style, segment)) {}
+	return true;
+}
+
+static bool ref_get_last_segment_without_root(cfs_path_style style, const char* path, ref_path* segment) {
+	if(!ref_get_first_segment_without_root(style, path, path, segment)) {
+		return false;
+	}
+	while(ref_get_next_segment(style, segment)) {}
+	return true;
+}
+
+static const char* ref_find_previous_stop(cfs_path_style style, const char* begin, const char* c) {
+	while(c > begin && !ref_is_sep(style, c)) {
+		--c;
+	}
+	return ref_is_sep(style, c) ? c + 1 : c;
+}
+
+static bool ref_get_previous_segment(cfs_path_style style, ref_path* segment) {
+	const char* c = segment->begin;
+
+	if(c <= segment->segments) {
+		return false;
+	}
+	do {
+		--c;
+		if(c < segment->segments) {
+			return false;
+		}
+	} while(ref_is_sep(style, c));
+	segment->end = c + 1;
+	segment->begin = ref_find_previous_stop(style, segment->segments, c);
+	segment->size = (size_t)(segment->end - segment->begin);
+	return true;
+}
+
+static bool ref_get_first_segment_joined(cfs_path_style style, const char** paths, ref_segment_joined* sj) {
+	bool result = false;
+
+	sj->path_index = 0;
+	sj->paths = paths;
+	while(paths[sj->path_index] != NULL &&
+	      (result = ref_get_first_segment(style, paths[sj->path_index], &sj->segment)) == false) {
+		++sj->path_index;
+	}
+	return result;
+}
+
+static bool ref_is_root_absolute(cfs_path_style style, const char* path, size_t length) {
+	return length > 0 && ref_is_sep(style, &path[length - 1]);
+}
+
+static enum cfs_path_segment_type ref_get_segment_type(const ref_path* segment) {
+	if(strncmp(segment->begin, ".", segment->size) == 0) {
+		return CFS_PATH_CURRENT;
+	} else if(strncmp(segment->begin, "..", segment->size) == 0) {
+		return CFS_PATH_BACK;
+	}
+	return CFS_PATH_NORMAL;
+}
+
+static bool ref_get_previous_segment_joined(cfs_path_style style, ref_segment_joined* sj) {
+	bool result = false;
+
+	if(*sj->paths == NULL) {
+		return false;
+	} else if(ref_get_previous_segment(style, &sj->segment)) {
+		return true;
+	}
+	do {
+		if(sj->path_index == 0) {
+			break;
+		}
+		--sj->path_index;
+		if(sj->path_index == 0) {
+			result = ref_get_last_segment(style, sj->paths[sj->path_index], &sj->segment);
+		} else {
+			result = ref_get_last_segment_without_root(style, sj->paths[sj->path_index], &sj->segment);
+		}
+	} while(!result);
+	return result;
+}
+
+static bool ref_get_next_segment_joined(cfs_path_style style, ref_segment_joined* sj) {
+	bool result = false;
+
+	if(sj->paths[sj->path_index] == NULL) {
+		return false;
+	} else if(ref_get_next_segment(style, &sj->segment)) {
+		return true;
+	}
+	do {
+		++sj->path_index;
+		if(sj->paths[sj->path_index] == NULL) {
+			break;
+		}
+		result = ref_get_first_segment_without_root(style, sj->paths[sj->path_index], sj->paths[sj->path_index], &sj->segment);
+	} while(!result);
+	return result;
+}
+
+static bool ref_segment_back_will_be_removed(cfs_path_style style, ref_segment_joined* sj) {
+	enum cfs_path_segment_type type;
+	int counter = 0;
+
+	while(ref_get_previous_segment_joined(style, sj)) {
+		type = ref_get_segment_type(&sj->segment);
+		if(type == CFS_PATH_NORMAL) {
+			if(++counter > 0) {
+				return true;
+			}
+		} else if(type == CFS_PATH_BACK) {
+			--counter;
+		}
+	}
+	return false;
+}
+
+static bool ref_segment_normal_will_be_removed(cfs_path_style style, ref_segment_joined* sj) {
+	enum cfs_path_segment_type type;
+	int counter = 0;
+
+	while(ref_get_next_segment_joined(style, sj)) {
+		type = ref_get_segment_type(&sj->segment);
+		if(type == CFS_PATH_NORMAL) {
+			++counter;
+		} else if(type == CFS_PATH_BACK) {
+			if(--counter < 0) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool ref_segment_will_be_removed(cfs_path_style style, const ref_segment_joined* sj, bool absolute) {
+	enum cfs_path_segment_type type = ref_get_segment_type(&sj->segment);
+	ref_segment_joined sjc = *sj;
+
+	if(type == CFS_PATH_CURRENT || (type == CFS_PATH_BACK && absolute)) {
+		return true;
+	} else if(type == CFS_PATH_BACK) {
+		return ref_segment_back_will_be_removed(style, &sjc);
+	}
+	return ref_segment_normal_will_be_removed(style, &sjc);
+}
+
+static size_t ref_output_sized(char* buffer, size_t buffer_size, size_t position, const char* str, size_t length) {
+	size_t amount_written;
+
+	if(buffer_size > position + length) {
+		amount_written = length;
+	} else if(buffer_size > position) {
+		amount_written = buffer_size - position;
+	} else {
+		amount_written = 0;
+	}
+	if(amount_written > 0) {
+		memmove(&buffer[position], str, amount_written);
+	}
+	return length;
+}
+
+static void ref_terminate_output(char* buffer, size_t buffer_size, size_t position) {
+	if(buffer_size > 0) {
+		if(position >= buffer_size) {
+			buffer[buffer_size - 1] = '\0';
+		} else {
+			buffer[position] = '\0';
+		}
+	}
+}
+
+static size_t ref_join_and_normalize_multiple(cfs_path_style style, const char** paths, char* buffer, size_t buffer_size) {
+	size_t pos;
+	bool absolute, has_segment_output = false;
+	ref_segment_joined sj;
+
+	ref_get_root(style, paths[0], &pos);
+	absolute = ref_is_root_absolute(style, paths[0], pos);
+	ref_output_sized(buffer, buffer_size, 0, paths[0], pos);
+	if(!ref_get_first_segment_joined(style, paths, &sj)) {
+		goto done;
+	}
+	do {
+		if(ref_segment_will_be_removed(style, &sj, absolute)) {
+			continue;
+		}
+		if(has_segment_output) {
+			pos += ref_output_sized(buffer, buffer_size, pos, ref_seperators[style], 1);
+		}
+		has_segment_output = true;
+		pos += ref_output_sized(buffer, buffer_size, pos, sj.segment.begin, sj.segment.size);
+	} while(ref_get_next_segment_joined(style, &sj));
+	if(!has_segment_output && pos == 0) {
+		pos += ref_output_sized(buffer, buffer_size, pos, ".", 1);
+	}
+done:
+	ref_terminate_output(buffer, buffer_size, pos);
+	return pos;
+}
+
+static size_t ref_normalize(cfs_path_style style, const char* path, char* buffer, size_t buffer_size) {
+	const char* paths[2] = {path, NULL};
+
+	return ref_join_and_normalize_multiple(style, paths, buffer, buffer_size);
+}
+
+static bool ref_is_absolute(cfs_path_style style, const char* path) {
+	size_t length;
+
+	ref_get_root(style, path, &length);
+	return ref_is_root_absolute(style, path, length);
+}
+
+static size_t ref_get_absolute(cfs_path_style style, const char* base, const char* path, char* buffer, size_t buffer_size) {
+	const char* paths[4];
+	size_t i = 0;
+
+	if(!ref_is_absolute(style, base)) {
+		paths[i++] = style == CFS_PATH_WINDOWS ? "\\" : "/";
+	}
+	if(ref_is_absolute(style, path)) {
+		paths[i++] = path;
+	} else {
+		paths[i++] = base;
+		paths[i++] = path;
+	}
+	paths[i] = NULL;
+	return ref_join_and_normalize_multiple(style, paths, buffer, buffer_size);
+}
+
+/*
+ * Comparison.
+ */
+
+enum {
+	TEST_NORMALIZE,
+	TEST_PLAT_NORMALIZE,
+	TEST_ABSOLUTE
+};
+
+static const char* test_names[] = {"cfs_path_normalize", "cfs_plat_path_normalize", "cfs_path_get_absolute"};
+static unsigned long test_cases;
+static unsigned long test_failures;
+
+static size_t test_run(int test, bool reference, const char* a, const char* b, char* buffer, size_t buffer_size) {
+	switch(test) {
+		case TEST_NORMALIZE:
+			return reference ? ref_normalize(CFS_PATH_UNIX, a, buffer, buffer_size) : cfs_path_normalize(a, buffer, buffer_size);
+		case TEST_PLAT_NORMALIZE:
+			return reference ? ref_normalize(CFS_PLAT_PATH_STYLE, a, buffer, buffer_size) : cfs_plat_path_normalize(a, buffer, buffer_size);
+		default:
+			return reference ? ref_get_absolute(CFS_PATH_UNIX, a, b, buffer, buffer_size) : cfs_path_get_absolute(a, b, buffer, buffer_size);
+	}
+}
+
+// Whether the bytes of buffer from offset on are all still 0x55.
+static bool test_untouched(const char* buffer, size_t offset, size_t size) {
+	for(; offset < size; offset++) {
+		if(buffer[offset] != 0x55) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_compare_at(int test, const char* a, const char* b, size_t size) {
+	char expected[REF_MAX + 8], actual[REF_MAX + 8];
+	size_t want, got, used;
+
+	memset(expected, 0x55, sizeof(expected));
+	memset(actual, 0x55, sizeof(actual));
+	want = test_run(test, true, a, b, expected, size);
+	got = test_run(test, false, a, b, actual, size);
+	used = size == 0 ? 0 : (want < size ? want : size - 1) + 1;
+	test_cases++;
+	if(want == got && memcmp(expected, actual, used) == 0 && test_untouched(actual, used, sizeof(actual))) {
+		return;
+	}
+	if(test_failures++ < 10) {
+		fprintf(stderr, "%s(\"%s\"%s%s%s, %zu): expected %zu \"%.*s\", got %zu \"%.*s\"\n",
+			test_names[test], a, b != NULL ? ", \"" : "", b != NULL ? b : "", b != NULL ? "\"" : "", size,
+			want, (int)(used > 0 ? used - 1 : 0), expected, got, (int)(used > 0 ? used - 1 : 0), actual);
+	}
+}
+
+// At every size up to two past the full result and with room to spare.
+static void test_compare(int test, const char* a, const char* b) {
+	char buffer[REF_MAX + 8];
+	size_t full, size;
+
+	full = test_run(test, true, a, b, buffer, sizeof(buffer));
+	for(size = 0; size <= full + 2 && size <= REF_MAX; size++) {
+		test_compare_at(test, a, b, size);
+	}
+	test_compare_at(test, a, b, sizeof(buffer));
+}
+
+// Calls visit with every string of up to length characters over alphabet.
+static void test_enumerate(const char* alphabet, size_t length, void (*visit)(const char*)) {
+	size_t count = strlen(alphabet), n, i;
+	size_t digits[16];
+	char path[16];
+
+	for(n = 0; n <= length; n++) {
+		memset(digits, 0, sizeof(digits));
+		for(;;) {
+			for(i = 0; i < n; i++) {
+				path[i] = alphabet[digits[i]];
+			}
+			path[n] = '\0';
+			visit(path);
+			for(i = 0; i < n && ++digits[i] == count; i++) {
+				digits[i] = 0;
+			}
+			if(i == n) {
+				break;
+			}
+		}
+	}
+}
+
+static const char* test_alphabet = CFS_PLAT_PATH_STYLE == CFS_PATH_WINDOWS ? "a./\\?:" : "ab./";
+
+static void test_visit_normalize(const char* path) {
+	test_compare(TEST_NORMALIZE, path, NULL);
+	test_compare(TEST_PLAT_NORMALIZE, path, NULL);
+}
+
+static char test_bases[512][8];
+static size_t test_base_count;
+
+static void test_visit_base(const char* path) {
+	strcpy(test_bases[test_base_count++], path);
+}
+
+static void test_visit_absolute(const char* path) {
+	size_t i;
+
+	for(i = 0; i < test_base_count; i++) {
+		test_compare(TEST_ABSOLUTE, test_bases[i], path);
+	}
+}
+
+static uint32_t test_seed = 12345;
+
+static uint32_t test_random(void) {
+	test_seed ^= test_seed << 13;
+	test_seed ^= test_seed >> 17;
+	test_seed ^= test_seed << 5;
+	return test_seed;
+}
+
+// A path of up to 40 segments biased towards '.', '..' and repeated separators.
+static void test_random_path(char* path, size_t size) {
+	static const char* segments[] = {"a", "bb", "ccc", ".", "..", "..", "...", ".a", "", "x.y"};
+	static const char* roots[] = {"", "", "/", "//", "\\", "\\\\srv\\share\\", "\\\\?\\", "c:"};
+	const char* seps = CFS_PLAT_PATH_STYLE == CFS_PATH_WINDOWS ? "/\\" : "/";
+	size_t n = test_random() % 41, i, length;
+
+	length = (size_t)snprintf(path, size, "%s", roots[test_random() % 8]);
+	for(i = 0; i < n && length + 8 < size; i++) {
+		const char* segment = segments[test_random() % 10];
+		memcpy(path + length, segment, strlen(segment));
+		length += strlen(segment);
+		do {
+			path[length++] = seps[test_random() % strlen(seps)];
+		} while(test_random() % 4 == 0 && length + 4 < size);
+	}
+	if(length > 0 && test_random() % 2 == 0) {
+		length--;
+	}
+	path[length] = '\0';
+}
+
+int main(void) {
+	char a[REF_MAX / 2], b[REF_MAX / 2];
+	int i;
+
+	test_enumerate(test_alphabet, CFS_PLAT_PATH_STYLE == CFS_PATH_WINDOWS ? 5 : 6, test_visit_normalize);
+	test_enumerate("a./", 4, test_visit_base);
+	test_enumerate("a./", 4, test_visit_absolute);
+	for(i = 0; i < 20000; i++) {
+		test_random_path(a, sizeof(a));
+		test_visit_normalize(a);
+		if(i % 10 == 0) {
+			test_random_path(b, sizeof(b));
+			test_compare(TEST_ABSOLUTE, a, b);
+		}
+	}
+	printf("%lu cases, %lu failures\n", test_cases, test_failures);
+	return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+/*
+ * The normalizer test with the platform style forced to windows, so
+ * cfs_plat_path_normalize is compared on drive, UNC and device roots.
+ */
+
+#define CFS_PLAT_PATH_STYLE CFS_PATH_WINDOWS
+#include "normalize.c"
@@ -0,0 +1,222 @@
+/*
+ * cfs_file_open allocates nothing. Every allocation of the library is counted
+ * while files are opened through overlay, deep and long-path mounts. The
+ * first round sets up the state of the thread and fills the pool the files
+ * come from, after that neither hits nor misses may allocate, and closing a
+ * file must give back to the pool whatever it took. Misses must report
+ * CFS_ERRNOENT.
+ */
+
+#include <stdlib.h>
+
+static unsigned long test_allocations;
+static long test_live;
+
+static void* test_malloc(size_t size) {
+	test_allocations++;
+	test_live++;
+	return malloc(size);
+}
+
+static void* test_realloc(void* ptr, size_t size) {
+	test_allocations++;
+	test_live += ptr == NULL;
+	return realloc(ptr, size);
+}
+
+static void test_free(void* ptr) {
+	test_live -= ptr != NULL;
+	free(ptr);
+}
+
+#define cfs_malloc(size) test_malloc(size)
+#define cfs_realloc(ptr, size) test_realloc(ptr, size)
+#define cfs_free(ptr) test_free(ptr)
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+#define TEST_LONG "a_directory_name_long_enough_to_push_paths_past_the_cache/another_one_of_about_the_same_length"
+
+static char test_root[] = "/tmp/cfs_open_alloc_XXXXXX";
+static int test_failures;
+
+static const char* test_hits[] = {
+	"/a.txt",
+	"/b.txt",
+	"/sub/u.txt",
+	"/x/../sub/./u.txt",
+	"/deep/mount/point/a.txt",
+	"/deep/mount/point/sub/u.txt",
+	"/" TEST_LONG "/f.txt",
+	NULL
+};
+
+static const char* test_misses[] = {
+	"/nope.txt",
+	"/sub/nope.txt",
+	"/nope/a.txt",
+	"/deep/mount/point/nope.txt",
+	"/deep/mount/nope.txt",
+	"/" TEST_LONG "/nope.txt",
+	// Directories are not files, not even the root of a mount.
+	"/",
+	"/sub",
+	"/deep/mount/point",
+	"/" TEST_LONG,
+	NULL
+};
+
+static void test_write(const char* name, const char* contents) {
+	char path[512];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void test_mkdir(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(mkdir(path, 0777) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void test_remove(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	remove(path);
+}
+
+static void test_round(const char* label, bool check) {
+	unsigned long before, allocations;
+	long live;
+	cfs_file* file;
+	size_t i;
+
+	for(i = 0; test_hits[i] != NULL; i++) {
+		before = test_allocations;
+		live = test_live;
+		file = cfs_file_open(test_hits[i], "rb");
+		allocations = test_allocations - before;
+		if(file == NULL) {
+			fprintf(stderr, "%s: %s not found (%d)\n", label, test_hits[i], cfs_geterr());
+			test_failures++;
+			continue;
+		}
+		cfs_file_close(file);
+		if(check && allocations != 0) {
+			fprintf(stderr, "%s: opening %s allocated %lu times\n", label, test_hits[i], allocations);
+			test_failures++;
+		}
+		if(check && test_live != live) {
+			fprintf(stderr, "%s: closing %s left %ld blocks allocated\n", label, test_hits[i], test_live - live);
+			test_failures++;
+		}
+	}
+	for(i = 0; test_misses[i] != NULL; i++) {
+		before = test_allocations;
+		file = cfs_file_open(test_misses[i], "rb");
+		allocations = test_allocations - before;
+		if(file != NULL) {
+			fprintf(stderr, "%s: %s found\n", label, test_misses[i]);
+			cfs_file_close(file);
+			test_failures++;
+			continue;
+		}
+		if(cfs_geterr() != CFS_ERRNOENT) {
+			fprintf(stderr, "%s: %s failed with %d\n", label, test_misses[i], cfs_geterr());
+			test_failures++;
+		}
+		if(check && allocations != 0) {
+			fprintf(stderr, "%s: missing %s allocated %lu times\n", label, test_misses[i], allocations);
+			test_failures++;
+		}
+	}
+}
+
+int main(void) {
+	char base[512], over[512], name[CFS_PATH_MAX + 16];
+	int round;
+
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	test_mkdir("base");
+	test_mkdir("base/sub");
+	test_mkdir("over");
+	test_mkdir("over/a_directory_name_long_enough_to_push_paths_past_the_cache");
+	test_mkdir("over/" TEST_LONG);
+	test_write("base/a.txt", "a");
+	test_write("base/b.txt", "b");
+	test_write("base/sub/u.txt", "u");
+	test_write("over/a.txt", "A");
+	test_write("over/" TEST_LONG "/f.txt", "f");
+	snprintf(base, sizeof(base), "%s/base", test_root);
+	snprintf(over, sizeof(over), "%s/over", test_root);
+
+	if(cfs_file_open("/a.txt", "rb") != NULL || cfs_geterr() != CFS_ERRNOENT) {
+		fprintf(stderr, "open without mounts did not fail with CFS_ERRNOENT\n");
+		test_failures++;
+	}
+
+	cfs_fs_posix_register();
+	cfs_fs_mount(base, "/");
+	cfs_fs_mount(over, "/");
+	cfs_fs_mount(base, "/deep/mount/point");
+
+	// The rounds below check that this error does not stick to their misses.
+	memset(name, 'n', sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	if(cfs_file_open(name, "rb") != NULL || cfs_geterr() != CFS_ERRNAMETOOLONG) {
+		fprintf(stderr, "long name did not fail with CFS_ERRNAMETOOLONG\n");
+		test_failures++;
+	}
+
+	// The first round sets up what the library keeps per thread.
+	test_round("warm up", false);
+	for(round = 0; round < 3; round++) {
+		test_round("overlay", true);
+	}
+	cfs_fs_set_indexed(true);
+	test_round("indexed warm up", false);
+	for(round = 0; round < 3; round++) {
+		test_round("indexed", true);
+	}
+
+	test_remove("over/" TEST_LONG "/f.txt");
+	test_remove("over/" TEST_LONG);
+	test_remove("over/a_directory_name_long_enough_to_push_paths_past_the_cache");
+	test_remove("over/a.txt");
+	test_remove("over");
+	test_remove("base/sub/u.txt");
+	test_remove("base/sub");
+	test_remove("base/a.txt");
+	test_remove("base/b.txt");
+	test_remove("base");
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "no allocations" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * cfs_file_read_many over overlapping mounts. Two directories are mounted
+ * at "/", a ZIP archive and an in-memory backend without locate_fn at
+ * "/sub", and one directory again at "/alias". Each file must come from the
+ * first mount holding it, as cfs_file_open would pick. Misses, directories
+ * and duplicates are mixed in, the batch is shuffled between rounds, and it
+ * runs with and without indexed mode.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static char test_root[] = "/tmp/cfs_read_many_XXXXXX";
+static char test_lines_data[16384];
+static int test_failures;
+
+typedef struct test_case {
+	const char* path;
+	// NULL for misses.
+	const char* expected;
+	size_t size;
+} test_case;
+
+static test_case test_cases[] = {
+	{"/a.txt", "upper a\n", 8},
+	{"/c.txt", "lower c\n", 8},
+	{"/sub/b.txt", "upper b\n", 8},
+	{"/sub/d.txt", "lower d\n", 8},
+	{"/sub/m.txt", "memory m\n", 9},
+	{"/sub/stored.txt", "stored contents\n", 16},
+	{"/sub/dynamic.txt", test_lines_data, 0},
+	{"/sub/twice.txt", "second\n", 7},
+	{"/alias/c.txt", "lower c\n", 8},
+	{"/alias/../a.txt", "upper a\n", 8},
+	{"sub//./d.txt", "lower d\n", 8},
+	{"/a.txt", "upper a\n", 8},
+	{"/nope.txt", NULL, 0},
+	{"/sub/nope.txt", NULL, 0},
+	{"/alias/nope.txt", NULL, 0},
+	{"/nope/a.txt", NULL, 0},
+	{"/sub", NULL, 0},
+	{"/", NULL, 0},
+	{"/sub/dir", NULL, 0}
+};
+
+#define TEST_COUNT (sizeof(test_cases) / sizeof(test_cases[0]))
+
+// The lines dynamic.txt was made of.
+static size_t test_lines(char* out) {
+	size_t length = 0;
+	int i;
+
+	for(i = 0; i < 200; i++) {
+		length += (size_t)sprintf(out + length, "line %d: the quick brown fox jumps over the lazy dog %d\n", i, i * i % 97);
+	}
+	return length;
+}
+
+/*
+ * An in-memory backend without locate_fn. Mounting "files.mem" gives it the
+ * single file m.txt, anything else is not found.
+ */
+
+typedef struct test_memory_file {
+	const char* data;
+	long int size;
+	long int position;
+} test_memory_file;
+
+static cfs_file_handle* test_memory_open(cfs_fs_handle* fs, const cfs_fs_path* path, const char* mode) {
+	test_memory_file* file;
+	cfs_file_handle* handle;
+
+	if(mode[0] != 'r' || strcmp(path->name, "m.txt") != 0) {
+		return NULL;
+	}
+	file = malloc(sizeof(test_memory_file));
+	handle = malloc(sizeof(cfs_file_handle));
+	file->data = "memory m\n";
+	file->size = 9;
+	file->position = 0;
+	handle->handle = file;
+	handle->fs_impl = fs;
+	return handle;
+}
+
+static long int test_memory_seek(cfs_fs_handle* fs, cfs_file_handle* handle, long int offset, int whence) {
+	test_memory_file* file = handle->handle;
+
+	(void)fs;
+	file->position = offset + (whence == CFS_SEEK_SET ? 0 : whence == CFS_SEEK_CUR ? file->position : file->size);
+	return file->position;
+}
+
+static long int test_memory_read(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	test_memory_file* file = handle->handle;
+
+	(void)fs;
+	if(sz > file->size - file->position) {
+		sz = file->position < file->size ? file->size - file->position : 0;
+	}
+	memcpy(buffer, file->data + file->position, (size_t)sz);
+	file->position += sz;
+	return sz;
+}
+
+static long int test_memory_write(cfs_fs_handle* fs, cfs_file_handle* handle, void* buffer, long int sz) {
+	(void)fs;
+	(void)handle;
+	(void)buffer;
+	(void)sz;
+	return -1;
+}
+
+static int test_memory_close(cfs_fs_handle* fs, cfs_file_handle* handle) {
+	(void)fs;
+	free(handle->handle);
+	free(handle);
+	return 0;
+}
+
+static cfs_fs_impl test_memory_impl = {
+	.open_fn = test_memory_open,
+	.seek_fn = test_memory_seek,
+	.read_fn = test_memory_read,
+	.write_fn = test_memory_write,
+	.close_fn = test_memory_close
+};
+
+static void test_write(const char* name, const char* contents) {
+	char path[512];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void test_mkdir(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(mkdir(path, 0777) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void test_remove(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	remove(path);
+}
+
+static void test_mount(const char* name, const char* mount) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(cfs_fs_mount(path, mount) < 0) {
+		fprintf(stderr, "mounting %s failed\n", path);
+		exit(1);
+	}
+}
+
+static void test_round(const char* label, const test_case** cases) {
+	const char* paths[TEST_COUNT];
+	cfs_read_output outputs[TEST_COUNT];
+	char buffer[16384];
+	cfs_file* file;
+	int loaded, hits = 0;
+	long int n;
+	size_t i;
+
+	for(i = 0; i < TEST_COUNT; i++) {
+		paths[i] = cases[i]->path;
+		hits += cases[i]->expected != NULL;
+	}
+	loaded = cfs_file_read_many(paths, outputs, TEST_COUNT);
+	if(loaded != hits) {
+		fprintf(stderr, "%s: %d of %d files loaded\n", label, loaded, hits);
+		test_failures++;
+	}
+	for(i = 0; i < TEST_COUNT; i++) {
+		const test_case* c = cases[i];
+
+		if(c->expected == NULL) {
+			if(outputs[i].error != CFS_ERRNOENT || outputs[i].data != NULL) {
+				fprintf(stderr, "%s: %s returned %d instead of a miss\n", label, c->path, outputs[i].error);
+				test_failures++;
+			}
+		} else if(outputs[i].error != 0 || outputs[i].size != c->size || memcmp(outputs[i].data, c->expected, c->size) != 0) {
+			fprintf(stderr, "%s: %s differs (%d)\n", label, c->path, outputs[i].error);
+			test_failures++;
+		}
+		cfs_free(outputs[i].data);
+
+		// The same as opening it one by one.
+		file = cfs_file_open(c->path, "rb");
+		n = file != NULL ? cfs_file_read(file, buffer, sizeof(buffer)) : -1;
+		if((file != NULL) != (c->expected != NULL) || (file != NULL && (n != (long int)c->size || memcmp(buffer, c->expected, c->size) != 0))) {
+			fprintf(stderr, "%s: %s opened differs\n", label, c->path);
+			test_failures++;
+		}
+		if(file != NULL) {
+			cfs_file_close(file);
+		}
+	}
+}
+
+static void test_rounds(const char* label) {
+	const test_case* cases[TEST_COUNT];
+	const test_case* swap;
+	uint32_t x = 1;
+	size_t i, j;
+	int round;
+
+	for(i = 0; i < TEST_COUNT; i++) {
+		cases[i] = &test_cases[i];
+	}
+	for(round = 0; round < 50; round++) {
+		test_round(label, cases);
+		for(i = TEST_COUNT - 1; i > 0; i--) {
+			x = (x * 1103515245u + 12345u) & 0x7fffffffu;
+			j = (x >> 8) % (i + 1);
+			swap = cases[i];
+			cases[i] = cases[j];
+			cases[j] = swap;
+		}
+	}
+}
+
+int main(void) {
+	static const char* memory_extensions[] = {"mem", NULL};
+	char path[512];
+
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	test_cases[6].size = test_lines(test_lines_data);
+	test_mkdir("upper");
+	test_mkdir("upper/sub");
+	test_mkdir("lower");
+	test_mkdir("lower/sub");
+	test_mkdir("lower/sub/dir");
+	test_write("upper/a.txt", "upper a\n");
+	test_write("upper/sub/b.txt", "upper b\n");
+	test_write("lower/a.txt", "lower a\n");
+	test_write("lower/c.txt", "lower c\n");
+	test_write("lower/sub/b.txt", "lower b\n");
+	test_write("lower/sub/d.txt", "lower d\n");
+	test_write("lower/sub/stored.txt", "lower stored\n");
+
+	cfs_fs_posix_register();
+	cfs_fs_zip_register();
+	cfs_fs_impl_register(&test_memory_impl, memory_extensions, NULL);
+	test_mount("upper", "/");
+	test_mount("lower", "/");
+	test_mount("lower", "/alias");
+	if(cfs_fs_mount("files.mem", "/sub") < 0) {
+		fprintf(stderr, "mounting files.mem failed\n");
+		return 1;
+	}
+	// Behind lower, which has a stored.txt of its own.
+	if(cfs_fs_mount("tests/data/basic.zip", "/sub") < 0) {
+		fprintf(stderr, "mounting tests/data/basic.zip failed\n");
+		return 1;
+	}
+	test_cases[5].expected = "lower stored\n";
+	test_cases[5].size = 13;
+
+	test_rounds("plain");
+	cfs_fs_set_indexed(true);
+	test_rounds("indexed");
+	cfs_fs_set_indexed(false);
+
+	test_remove("upper/sub/b.txt");
+	test_remove("upper/sub");
+	test_remove("upper/a.txt");
+	test_remove("upper");
+	test_remove("lower/sub/dir");
+	test_remove("lower/sub/b.txt");
+	test_remove("lower/sub/d.txt");
+	test_remove("lower/sub/stored.txt");
+	test_remove("lower/sub");
+	test_remove("lower/a.txt");
+	test_remove("lower/c.txt");
+	test_remove("lower");
+	snprintf(path, sizeof(path), "%s", test_root);
+	remove(path);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
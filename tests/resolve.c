@@ -0,0 +1,226 @@
+/*
+ * The resolution cache of cfs_file_open. Paths are opened until their mount,
+ * or their absence, is cached, then the mounts or the files change:
+ *
+ * - Mounting and unmounting void what was cached, also for mounts freed
+ *   meanwhile.
+ * - Files created behind cfs's back stay unseen until cfs_fs_invalidate,
+ *   files removed behind its back are resolved again right away.
+ * - Files created by opening them for writing through cfs are found at
+ *   once, also by another thread which cached that they were missing.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static char test_root[] = "/tmp/cfs_resolve_XXXXXX";
+static char test_upper[512];
+static char test_lower[512];
+static int test_failures;
+static pthread_barrier_t test_barrier;
+
+static void test_write(const char* name, const char* contents) {
+	char path[512];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void test_mkdir(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(mkdir(path, 0777) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void test_remove(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	remove(path);
+}
+
+// Opens path twice, so the second open goes through the cache, and checks
+// it holds expected or is missing if expected is NULL.
+static void test_expect(const char* label, const char* path, const char* expected) {
+	char buffer[64];
+	cfs_file* file;
+	long int n;
+	int i;
+
+	for(i = 0; i < 2; i++) {
+		file = cfs_file_open(path, "rb");
+		if(expected == NULL) {
+			if(file != NULL) {
+				fprintf(stderr, "%s: %s found\n", label, path);
+				test_failures++;
+				cfs_file_close(file);
+			} else if(cfs_geterr() != CFS_ERRNOENT) {
+				fprintf(stderr, "%s: %s failed with %d\n", label, path, cfs_geterr());
+				test_failures++;
+			}
+			continue;
+		}
+		if(file == NULL) {
+			fprintf(stderr, "%s: %s not found\n", label, path);
+			test_failures++;
+			continue;
+		}
+		n = cfs_file_read(file, buffer, sizeof(buffer));
+		if(n != (long int)strlen(expected) || memcmp(buffer, expected, (size_t)n) != 0) {
+			fprintf(stderr, "%s: %s read %.*s instead of %s", label, path, n > 0 ? (int)n : 0, buffer, expected);
+			test_failures++;
+		}
+		cfs_file_close(file);
+	}
+}
+
+static void test_create(const char* path, const char* contents) {
+	cfs_file* file = cfs_file_open(path, "wb");
+
+	if(file == NULL) {
+		fprintf(stderr, "%s could not be created\n", path);
+		test_failures++;
+		return;
+	}
+	cfs_file_write(file, (void*)contents, (long int)strlen(contents));
+	cfs_file_close(file);
+}
+
+static void test_mount_changes(void) {
+	cfs_fs_mount(test_lower, "/");
+	test_expect("mounted lower", "/a.txt", "lower a\n");
+	test_expect("mounted lower", "/u.txt", NULL);
+
+	// Behind lower, so only what lower lacks comes from it.
+	cfs_fs_mount(test_upper, "/");
+	test_expect("mounted upper", "/u.txt", "upper u\n");
+	test_expect("mounted upper", "/a.txt", "lower a\n");
+
+	// The cached mounts are gone.
+	cfs_fs_unmount(test_upper, "/");
+	test_expect("unmounted upper", "/u.txt", NULL);
+	cfs_fs_unmount(test_lower, "/");
+	cfs_fs_mount(test_upper, "/");
+	test_expect("only upper", "/a.txt", "upper a\n");
+	test_expect("only upper", "/u.txt", "upper u\n");
+
+	// Elsewhere the same path resolves on its own.
+	cfs_fs_mount(test_lower, "/lower");
+	test_expect("lower below", "/lower/a.txt", "lower a\n");
+	test_expect("lower below", "/lower/u.txt", NULL);
+	cfs_fs_unmount(test_lower, "/lower");
+	test_expect("lower gone", "/lower/a.txt", NULL);
+	cfs_fs_unmount(test_upper, "/");
+}
+
+static void test_behind_back(void) {
+	cfs_fs_mount(test_lower, "/");
+	cfs_fs_mount(test_upper, "/");
+	test_expect("cached", "/b.txt", NULL);
+	test_expect("cached", "/c.txt", "upper c\n");
+
+	// Created behind cfs's back, the cache still says otherwise.
+	test_write("lower/b.txt", "lower b\n");
+	test_write("lower/c.txt", "lower c\n");
+	test_expect("stale", "/b.txt", NULL);
+	test_expect("stale", "/c.txt", "upper c\n");
+	cfs_fs_invalidate();
+	test_expect("invalidated", "/b.txt", "lower b\n");
+	test_expect("invalidated", "/c.txt", "lower c\n");
+
+	// Removed behind its back, it is looked up again.
+	test_remove("lower/c.txt");
+	test_expect("removed", "/c.txt", "upper c\n");
+	test_remove("lower/b.txt");
+	test_expect("removed", "/b.txt", NULL);
+}
+
+static void* test_thread(void* arg) {
+	(void)arg;
+	test_expect("other thread", "/t.txt", NULL);
+	pthread_barrier_wait(&test_barrier);
+	// Created by the main thread meanwhile.
+	pthread_barrier_wait(&test_barrier);
+	test_expect("other thread", "/t.txt", "written t\n");
+	return NULL;
+}
+
+static void test_written(void) {
+	pthread_t thread;
+
+	// A cached miss, created through cfs in lower.
+	test_expect("not written", "/w.txt", NULL);
+	test_create("/w.txt", "written w\n");
+	test_expect("written", "/w.txt", "written w\n");
+
+	// Cached in upper, lower comes first once it has the file too.
+	test_expect("not written", "/d.txt", "upper d\n");
+	test_create("/d.txt", "written d\n");
+	test_expect("written", "/d.txt", "written d\n");
+
+	pthread_barrier_init(&test_barrier, NULL, 2);
+	pthread_create(&thread, NULL, test_thread, NULL);
+	pthread_barrier_wait(&test_barrier);
+	test_create("/t.txt", "written t\n");
+	pthread_barrier_wait(&test_barrier);
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&test_barrier);
+}
+
+int main(void) {
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	snprintf(test_upper, sizeof(test_upper), "%s/upper", test_root);
+	snprintf(test_lower, sizeof(test_lower), "%s/lower", test_root);
+	test_mkdir("upper");
+	test_mkdir("lower");
+	test_write("lower/a.txt", "lower a\n");
+	test_write("upper/a.txt", "upper a\n");
+	test_write("upper/u.txt", "upper u\n");
+	test_write("upper/c.txt", "upper c\n");
+	test_write("upper/d.txt", "upper d\n");
+
+	cfs_fs_posix_register();
+	test_mount_changes();
+	test_behind_back();
+	test_written();
+
+	test_remove("lower/a.txt");
+	test_remove("lower/w.txt");
+	test_remove("lower/d.txt");
+	test_remove("lower/t.txt");
+	test_remove("lower");
+	test_remove("upper/a.txt");
+	test_remove("upper/u.txt");
+	test_remove("upper/c.txt");
+	test_remove("upper/d.txt");
+	test_remove("upper");
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Mount snapshots. A directory and two copies of tests/data/basic.zip are
+ * mounted, saved and unmounted, and the snapshot is loaded back, without
+ * and with indexed mode:
+ *
+ * - Unchanged sources are restored from the snapshot. An entry renamed in
+ *   place, with size and modification time put back, proves it: it is still
+ *   found under its old name.
+ * - A source whose modification time changed, or whose size changed, is
+ *   mounted again and shows what it contains now.
+ * - Files open through the restored table and read back what was stored.
+ *
+ * The snapshot is then cut off at every length, which must be rejected, and
+ * loaded with each of its bytes flipped, which must either be rejected or
+ * give mounts that can be used without touching memory they do not own.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static char test_root[] = "/tmp/cfs_snapshot_XXXXXX";
+static char test_path[8][512];
+static int test_failures;
+
+enum {
+	TEST_DIR,
+	TEST_A,
+	TEST_B,
+	TEST_SNAPSHOT,
+	TEST_DAMAGED
+};
+
+static const char* test_names[] = {"dir", "a.zip", "b.zip", "snapshot", "damaged"};
+
+static void test_fail(const char* format, const char* path) {
+	fprintf(stderr, format, path);
+	fputc('\n', stderr);
+	test_failures++;
+}
+
+static size_t test_load(const char* path, unsigned char* data, size_t size) {
+	FILE* f = fopen(path, "rb");
+
+	if(f == NULL) {
+		perror(path);
+		exit(1);
+	}
+	size = fread(data, 1, size, f);
+	fclose(f);
+	return size;
+}
+
+static void test_store(const char* path, const unsigned char* data, size_t size) {
+	FILE* f = fopen(path, "wb");
+
+	if(f == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fwrite(data, 1, size, f);
+	fclose(f);
+}
+
+static void test_copy(const char* from, const char* to) {
+	static unsigned char data[65536];
+
+	test_store(to, data, test_load(from, data, sizeof(data)));
+}
+
+// Sets the modification time of path to that of st plus seconds.
+static void test_mtime(const char* path, const struct stat* st, time_t seconds) {
+	struct timespec times[2];
+
+	times[0] = st->st_atim;
+	times[1] = st->st_mtim;
+	times[1].tv_sec += seconds;
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+// Renames stored.txt to stowed.txt in both of its headers, which keeps the
+// size of the archive.
+static void test_rename(const char* path) {
+	static unsigned char data[65536];
+	size_t size = test_load(path, data, sizeof(data)), i;
+
+	for(i = 0; i + 10 <= size; i++) {
+		if(memcmp(data + i, "stored.txt", 10) == 0) {
+			memcpy(data + i, "stowed.txt", 10);
+		}
+	}
+	test_store(path, data, size);
+}
+
+static void test_unmount_all(void) {
+	const cfs_mount_table* table;
+	char src[CFS_PATH_MAX], mount[CFS_PATH_MAX];
+	const cfs_fs_handle* fs;
+
+	while((table = cfs_read_begin()) != NULL) {
+		if(table->mount_count == 0) {
+			cfs_read_end();
+			break;
+		}
+		fs = table->mounts[table->mount_count - 1];
+		snprintf(src, sizeof(src), "%s", fs->src);
+		snprintf(mount, sizeof(mount), "%s", fs->mount);
+		cfs_read_end();
+		if(cfs_fs_unmount(src, mount) < 0) {
+			test_fail("%s cannot be unmounted", mount);
+			exit(1);
+		}
+	}
+}
+
+static void test_read(const char* path, const char* expected) {
+	char buffer[64];
+	cfs_file* file = cfs_file_open(path, "rb");
+	long int n;
+
+	if(file == NULL) {
+		test_fail("%s not found", path);
+		return;
+	}
+	n = cfs_file_read(file, buffer, sizeof(buffer));
+	if(n != (long int)strlen(expected) || memcmp(buffer, expected, (size_t)n) != 0) {
+		test_fail("%s differs", path);
+	}
+	cfs_file_close(file);
+}
+
+static void test_missing(const char* path) {
+	cfs_file* file = cfs_file_open(path, "rb");
+
+	if(file != NULL) {
+		test_fail("%s found", path);
+		cfs_file_close(file);
+	}
+}
+
+static void test_load_snapshot(const char* label) {
+	int err = cfs_snapshot_load(test_path[TEST_SNAPSHOT]);
+
+	if(err < 0) {
+		fprintf(stderr, "%s: loading failed: %s\n", label, cfs_getstrerr(err));
+		test_failures++;
+	}
+	test_read("/x.txt", "in the directory\n");
+	test_read("/sub/y.txt", "further down\n");
+	test_read("/b/twice.txt", "second\n");
+}
+
+static void test_round(bool indexed) {
+	struct stat a, b;
+
+	test_copy("tests/data/basic.zip", test_path[TEST_A]);
+	test_copy("tests/data/basic.zip", test_path[TEST_B]);
+	stat(test_path[TEST_A], &a);
+	stat(test_path[TEST_B], &b);
+	cfs_fs_set_indexed(indexed);
+	cfs_fs_mount(test_path[TEST_DIR], "/");
+	cfs_fs_mount(test_path[TEST_A], "/a");
+	cfs_fs_mount(test_path[TEST_B], "/b");
+	if(cfs_snapshot_save(test_path[TEST_SNAPSHOT]) < 0) {
+		test_fail("saving %s failed", test_path[TEST_SNAPSHOT]);
+	}
+	test_unmount_all();
+
+	// Unchanged as far as size and modification time tell.
+	test_rename(test_path[TEST_A]);
+	test_mtime(test_path[TEST_A], &a, 0);
+	test_load_snapshot("restored");
+	test_read("/a/stored.txt", "stored contents\n");
+	test_missing("/a/stowed.txt");
+	test_unmount_all();
+
+	// Touched.
+	test_mtime(test_path[TEST_A], &a, 10);
+	test_load_snapshot("touched");
+	test_read("/a/stowed.txt", "stored contents\n");
+	test_missing("/a/stored.txt");
+	test_unmount_all();
+
+	// Resized, with its modification time put back.
+	test_copy("tests/data/zip64.zip", test_path[TEST_B]);
+	test_mtime(test_path[TEST_B], &b, 0);
+	if(cfs_snapshot_load(test_path[TEST_SNAPSHOT]) < 0) {
+		test_fail("loading %s over a resized source failed", test_path[TEST_SNAPSHOT]);
+	}
+	test_read("/b/small.txt", "zip64 stored\n");
+	test_missing("/b/twice.txt");
+	test_read("/a/stowed.txt", "stored contents\n");
+	test_unmount_all();
+}
+
+static bool test_mounted(void) {
+	const cfs_mount_table* table = cfs_read_begin();
+	bool mounted = table != NULL && table->mount_count > 0;
+
+	if(table != NULL) {
+		cfs_read_end();
+	}
+	return mounted;
+}
+
+// Opens and reads whatever the damaged snapshot left mounted.
+static void test_use(void) {
+	static const char* paths[] = {"/x.txt", "/sub/y.txt", "/a/stored.txt", "/a/dynamic.txt", "/b/fixed.txt", "/b/dir/sub/back.txt", NULL};
+	char buffer[16384];
+	cfs_dir* dir;
+	cfs_dirent entries[8];
+	cfs_file* file;
+	size_t i;
+
+	for(i = 0; paths[i] != NULL; i++) {
+		if((file = cfs_file_open(paths[i], "rb")) != NULL) {
+			while(cfs_file_read(file, buffer, sizeof(buffer)) > 0) {}
+			cfs_file_close(file);
+		}
+	}
+	if((dir = cfs_dir_open("/")) != NULL) {
+		while(cfs_dir_next(dir, entries, 8) > 0) {}
+		cfs_dir_close(dir);
+	}
+}
+
+static void test_damage(void) {
+	static unsigned char data[65536];
+	size_t size, i;
+
+	test_copy("tests/data/basic.zip", test_path[TEST_A]);
+	test_copy("tests/data/basic.zip", test_path[TEST_B]);
+	cfs_fs_mount(test_path[TEST_DIR], "/");
+	cfs_fs_mount(test_path[TEST_A], "/a");
+	cfs_fs_mount(test_path[TEST_B], "/b");
+	cfs_snapshot_save(test_path[TEST_SNAPSHOT]);
+	test_unmount_all();
+	size = test_load(test_path[TEST_SNAPSHOT], data, sizeof(data));
+
+	for(i = 0; i < size; i++) {
+		test_store(test_path[TEST_DAMAGED], data, i);
+		if(cfs_snapshot_load(test_path[TEST_DAMAGED]) == 0 || test_mounted()) {
+			fprintf(stderr, "snapshot cut off after %zu bytes loaded\n", i);
+			test_failures++;
+			test_unmount_all();
+		}
+	}
+	for(i = 0; i < size; i++) {
+		data[i] ^= 0x5a;
+		test_store(test_path[TEST_DAMAGED], data, size);
+		cfs_snapshot_load(test_path[TEST_DAMAGED]);
+		test_use();
+		test_unmount_all();
+		data[i] ^= 0x5a;
+	}
+}
+
+int main(void) {
+	char path[600];
+	size_t i;
+	FILE* f;
+
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	for(i = 0; i < sizeof(test_names) / sizeof(test_names[0]); i++) {
+		snprintf(test_path[i], sizeof(test_path[i]), "%s/%s", test_root, test_names[i]);
+	}
+	mkdir(test_path[TEST_DIR], 0777);
+	snprintf(path, sizeof(path), "%s/sub", test_path[TEST_DIR]);
+	mkdir(path, 0777);
+	snprintf(path, sizeof(path), "%s/x.txt", test_path[TEST_DIR]);
+	f = fopen(path, "w");
+	fputs("in the directory\n", f);
+	fclose(f);
+	snprintf(path, sizeof(path), "%s/sub/y.txt", test_path[TEST_DIR]);
+	f = fopen(path, "w");
+	fputs("further down\n", f);
+	fclose(f);
+
+	cfs_fs_posix_register();
+	cfs_fs_zip_register();
+	test_round(false);
+	test_round(true);
+	cfs_fs_set_indexed(false);
+	test_damage();
+	cfs_fs_set_indexed(true);
+	test_damage();
+
+	snprintf(path, sizeof(path), "%s/sub/y.txt", test_path[TEST_DIR]);
+	remove(path);
+	snprintf(path, sizeof(path), "%s/sub", test_path[TEST_DIR]);
+	remove(path);
+	snprintf(path, sizeof(path), "%s/x.txt", test_path[TEST_DIR]);
+	remove(path);
+	for(i = 0; i < sizeof(test_names) / sizeof(test_names[0]); i++) {
+		remove(test_path[i]);
+	}
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
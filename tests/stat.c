@@ -0,0 +1,224 @@
+/*
+ * The stat cache of cfs_file_stat. Paths are stated until their result is
+ * cached, then the mounts or the files change:
+ *
+ * - Mounting and unmounting void cached results and misses.
+ * - Files changed behind cfs's back keep their cached result until
+ *   cfs_fs_invalidate.
+ * - Data written through cfs, buffered, vectored or at an offset, voids
+ *   the cached results of every thread once it reaches the backend, even
+ *   when the file was opened before they were cached.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static char test_root[] = "/tmp/cfs_stat_XXXXXX";
+static char test_upper[512];
+static char test_lower[512];
+static int test_failures;
+static pthread_barrier_t test_barrier;
+
+static void test_write(const char* name, const char* contents) {
+	char path[512];
+	FILE* f;
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fputs(contents, f);
+	fclose(f);
+}
+
+static void test_mkdir(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	if(mkdir(path, 0777) < 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void test_remove(const char* name) {
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s/%s", test_root, name);
+	remove(path);
+}
+
+// Stats path twice, so the second one comes from the cache. A size of -1
+// expects it to be missing.
+static void test_stat(const char* label, const char* path, long int size, int type) {
+	cfs_stat info;
+	int i, err;
+
+	for(i = 0; i < 2; i++) {
+		memset(&info, 0xff, sizeof(info));
+		err = cfs_file_stat(path, &info);
+		if(size < 0) {
+			if(err != CFS_ERRNOENT) {
+				fprintf(stderr, "%s: %s returned %d instead of a miss\n", label, path, err);
+				test_failures++;
+			}
+		} else if(err != 0 || info.size != size || info.type != type) {
+			fprintf(stderr, "%s: %s returned %d, size %ld and type %d instead of %ld and %d\n", label, path, err, info.size, info.type, size, type);
+			test_failures++;
+		} else if(type == CFS_DIRENT_FILE && strncmp(path, "/zip/", 5) != 0 && info.mtime <= 0) {
+			fprintf(stderr, "%s: %s has no modification time\n", label, path);
+			test_failures++;
+		}
+	}
+}
+
+static void test_mounts(void) {
+	cfs_fs_mount(test_lower, "/");
+	cfs_fs_mount("tests/data/basic.zip", "/zip");
+	test_stat("mounted", "/a.txt", 8, CFS_DIRENT_FILE);
+	test_stat("mounted", "/sub", 0, CFS_DIRENT_DIRECTORY);
+	test_stat("mounted", "/zip", 0, CFS_DIRENT_DIRECTORY);
+	test_stat("mounted", "/zip/stored.txt", 16, CFS_DIRENT_FILE);
+	test_stat("mounted", "/zip/dir/sub", 0, CFS_DIRENT_DIRECTORY);
+	test_stat("mounted", "/zip/nope.txt", -1, 0);
+	test_stat("mounted", "/up/u.txt", -1, 0);
+	test_stat("mounted", "/up", -1, 0);
+
+	cfs_fs_mount(test_upper, "/up");
+	test_stat("mounted upper", "/up/u.txt", 13, CFS_DIRENT_FILE);
+	test_stat("mounted upper", "/up", 0, CFS_DIRENT_DIRECTORY);
+	cfs_fs_unmount(test_upper, "/up");
+	test_stat("unmounted upper", "/up/u.txt", -1, 0);
+	test_stat("unmounted upper", "/up", -1, 0);
+
+	// Behind lower, whose a.txt it does not change.
+	cfs_fs_mount(test_upper, "/");
+	test_stat("upper behind", "/a.txt", 8, CFS_DIRENT_FILE);
+	test_stat("upper behind", "/u.txt", 13, CFS_DIRENT_FILE);
+	cfs_fs_unmount(test_lower, "/");
+	test_stat("lower unmounted", "/a.txt", 19, CFS_DIRENT_FILE);
+	cfs_fs_mount(test_lower, "/");
+	test_stat("lower behind", "/a.txt", 19, CFS_DIRENT_FILE);
+	cfs_fs_unmount(test_upper, "/");
+	test_stat("upper unmounted", "/a.txt", 8, CFS_DIRENT_FILE);
+	test_stat("upper unmounted", "/u.txt", -1, 0);
+}
+
+static void test_behind_back(void) {
+	test_stat("cached", "/b.txt", -1, 0);
+	test_write("lower/b.txt", "lower b\n");
+	test_write("lower/a.txt", "lower a, grown\n");
+	test_stat("stale", "/b.txt", -1, 0);
+	test_stat("stale", "/a.txt", 8, CFS_DIRENT_FILE);
+	cfs_fs_invalidate();
+	test_stat("invalidated", "/b.txt", 8, CFS_DIRENT_FILE);
+	test_stat("invalidated", "/a.txt", 15, CFS_DIRENT_FILE);
+}
+
+static void* test_thread(void* arg) {
+	(void)arg;
+	test_stat("other thread", "/w.txt", 0, CFS_DIRENT_FILE);
+	pthread_barrier_wait(&test_barrier);
+	// Written by the main thread meanwhile.
+	pthread_barrier_wait(&test_barrier);
+	test_stat("other thread", "/w.txt", 4096, CFS_DIRENT_FILE);
+	return NULL;
+}
+
+static void test_written(void) {
+	static char data[4096];
+	cfs_iovec iov[2];
+	cfs_stat info;
+	cfs_file* file;
+	pthread_t thread;
+
+	// Created through cfs after the miss was cached.
+	test_stat("not written", "/w.txt", -1, 0);
+	file = cfs_file_open("/w.txt", "wb");
+	test_stat("created", "/w.txt", 0, CFS_DIRENT_FILE);
+
+	// Buffered, it only counts once flushed. fstat flushes.
+	cfs_file_setbuffer(file, NULL, 1024);
+	cfs_file_write(file, data, 10);
+	test_stat("buffered", "/w.txt", 0, CFS_DIRENT_FILE);
+	if(cfs_file_fstat(file, &info) != 0 || info.size != 10) {
+		fprintf(stderr, "fstat of /w.txt returned size %ld instead of 10\n", info.size);
+		test_failures++;
+	}
+	test_stat("flushed", "/w.txt", 10, CFS_DIRENT_FILE);
+
+	cfs_file_write_at(file, data, 100, 50);
+	test_stat("written at", "/w.txt", 150, CFS_DIRENT_FILE);
+
+	// Larger than the buffer, so it goes to the backend right away.
+	iov[0].base = data;
+	iov[0].size = 1000;
+	iov[1].base = data;
+	iov[1].size = 1000;
+	cfs_file_fseek(file, 0, CFS_SEEK_END);
+	cfs_file_writev(file, iov, 2);
+	test_stat("written vectored", "/w.txt", 2150, CFS_DIRENT_FILE);
+
+	cfs_file_setbuffer(file, NULL, 0);
+	cfs_file_write(file, data, 50);
+	test_stat("written unbuffered", "/w.txt", 2200, CFS_DIRENT_FILE);
+	cfs_file_close(file);
+
+	// Opened before the other thread caches the result.
+	file = cfs_file_open("/w.txt", "wb");
+	pthread_barrier_init(&test_barrier, NULL, 2);
+	pthread_create(&thread, NULL, test_thread, NULL);
+	pthread_barrier_wait(&test_barrier);
+	cfs_file_write_at(file, data, sizeof(data), 0);
+	pthread_barrier_wait(&test_barrier);
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&test_barrier);
+	cfs_file_close(file);
+}
+
+int main(void) {
+	if(mkdtemp(test_root) == NULL) {
+		perror(test_root);
+		return 1;
+	}
+	snprintf(test_upper, sizeof(test_upper), "%s/upper", test_root);
+	snprintf(test_lower, sizeof(test_lower), "%s/lower", test_root);
+	test_mkdir("upper");
+	test_mkdir("lower");
+	test_mkdir("lower/sub");
+	test_write("lower/a.txt", "lower a\n");
+	test_write("upper/a.txt", "upper a, much more\n");
+	test_write("upper/u.txt", "upper u file\n");
+
+	cfs_fs_posix_register();
+	cfs_fs_zip_register();
+	test_mounts();
+	test_behind_back();
+	test_written();
+
+	test_remove("lower/a.txt");
+	test_remove("lower/b.txt");
+	test_remove("lower/w.txt");
+	test_remove("lower/sub");
+	test_remove("lower");
+	test_remove("upper/a.txt");
+	test_remove("upper/u.txt");
+	test_remove("upper");
+	remove(test_root);
+
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
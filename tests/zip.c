@@ -0,0 +1,233 @@
+/*
+ * The ZIP backend against the archives in tests/data:
+ *
+ * basic.zip     stored, empty and deflated entries, the deflated ones with
+ *               fixed Huffman, dynamic Huffman and stored blocks, a directory,
+ *               '\' separated and unnormalized names, an encrypted entry, a
+ *               bzip2 one and a name stored twice, the later one deflated.
+ * zip64.zip     sizes and offsets only in ZIP64 extra fields, found through
+ *               the ZIP64 end record.
+ * cd_count.zip  an end record claiming more entries than there are.
+ * cd_offset.zip a central directory offset past the end of the archive.
+ * cd_short.zip  a central directory header cut short.
+ * damaged.zip   a good directory over a bad local header, a corrupt deflate
+ *               stream and one intact entry.
+ *
+ * Every entry is read whole, in small pieces and at every offset, and
+ * compared against what was put in. basic.zip is then mounted with each
+ * byte of its directory flipped and cut off at every length, which must be
+ * rejected or read without touching memory outside the archive.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+static int test_failures;
+
+static void test_fail(const char* format, const char* path) {
+	fprintf(stderr, format, path);
+	fputc('\n', stderr);
+	test_failures++;
+}
+
+// The lines dynamic.txt and big/deflated.txt were made of.
+static size_t test_lines(char* out) {
+	size_t length = 0;
+	int i;
+
+	for(i = 0; i < 200; i++) {
+		length += (size_t)sprintf(out + length, "line %d: the quick brown fox jumps over the lazy dog %d\n", i, i * i % 97);
+	}
+	return length;
+}
+
+static void test_read(const char* path, const char* expected, size_t size) {
+	char buffer[16384];
+	cfs_file* file;
+	size_t done, offset;
+	long int n;
+
+	if((file = cfs_file_open(path, "rb")) == NULL) {
+		test_fail("%s not found", path);
+		return;
+	}
+	cfs_file_setbuffer(file, NULL, 0);
+	for(done = 0; (n = cfs_file_read(file, buffer + done, 7)) > 0; done += (size_t)n) {
+		if(done + (size_t)n > size) {
+			break;
+		}
+	}
+	if(n != 0 || done != size || memcmp(buffer, expected, size) != 0) {
+		test_fail("%s read in pieces differs", path);
+	}
+	for(offset = 0; offset <= size; offset += 1 + offset / 8) {
+		n = cfs_file_read_at(file, buffer, (long int)sizeof(buffer), (long int)offset);
+		if(n != (long int)(size - offset) || memcmp(buffer, expected + offset, size - offset) != 0) {
+			test_fail("%s read at an offset differs", path);
+			break;
+		}
+	}
+	cfs_file_close(file);
+}
+
+static void test_missing(const char* path, int err) {
+	cfs_file* file = cfs_file_open(path, "rb");
+
+	if(file != NULL) {
+		test_fail("%s opened", path);
+		cfs_file_close(file);
+	} else if(cfs_geterr() != err) {
+		test_fail("%s failed with the wrong error", path);
+	}
+}
+
+static void test_corrupt(const char* path) {
+	cfs_file* file = cfs_file_open(path, "rb");
+	char c;
+
+	if(file == NULL) {
+		test_fail("%s not found", path);
+		return;
+	}
+	if(cfs_file_read(file, &c, 1) > 0 || !cfs_file_error(file)) {
+		test_fail("%s inflated", path);
+	}
+	cfs_file_close(file);
+}
+
+static void test_reject(const char* src) {
+	if(cfs_fs_mount(src, "/bad") != CFS_ERRIO) {
+		test_fail("%s mounted", src);
+		cfs_fs_unmount(src, "/bad");
+	}
+}
+
+// Mounts the archive and reads everything in it, only to have it checked
+// for reads out of bounds.
+static void test_survive(const char* src) {
+	static const char* paths[] = {"/f/stored.txt", "/f/fixed.txt", "/f/dynamic.txt", "/f/raw.txt", "/f/dir/sub/back.txt", "/f/twice.txt", NULL};
+	char buffer[16384];
+	cfs_file* file;
+	size_t i;
+
+	if(cfs_fs_mount(src, "/f") < 0) {
+		return;
+	}
+	for(i = 0; paths[i] != NULL; i++) {
+		if((file = cfs_file_open(paths[i], "rb")) != NULL) {
+			while(cfs_file_read(file, buffer, sizeof(buffer)) > 0) {}
+			cfs_file_close(file);
+		}
+	}
+	cfs_fs_unmount(src, "/f");
+}
+
+static void test_mutations(void) {
+	char dir[] = "/tmp/cfs_zip_XXXXXX";
+	char src[64];
+	unsigned char* data;
+	size_t size, start, i;
+	FILE* f;
+
+	if((f = fopen("tests/data/basic.zip", "rb")) == NULL) {
+		test_fail("%s missing", "tests/data/basic.zip");
+		return;
+	}
+	data = malloc(4096);
+	size = fread(data, 1, 4096, f);
+	fclose(f);
+	if(mkdtemp(dir) == NULL) {
+		perror(dir);
+		exit(1);
+	}
+	snprintf(src, sizeof(src), "%s/fuzz.zip", dir);
+
+	// The central directory starts where the end record says, which is
+	// followed by an 18 byte comment.
+	start = cfs_zip_u32(data + size - 18 - 22 + 16);
+	for(i = start; i < size; i++) {
+		data[i] ^= 0xff;
+		f = fopen(src, "wb");
+		fwrite(data, 1, size, f);
+		fclose(f);
+		test_survive(src);
+		data[i] ^= 0xff;
+	}
+	for(i = 0; i < size; i += 7) {
+		f = fopen(src, "wb");
+		fwrite(data, 1, i, f);
+		fclose(f);
+		test_survive(src);
+	}
+	remove(src);
+	remove(dir);
+	free(data);
+}
+
+int main(void) {
+	static const char fixed[] =
+		"The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog. "
+		"The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog. "
+		"The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog. "
+		"The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog. \n";
+	static char lines[16384];
+	size_t length = test_lines(lines);
+	int err;
+
+	cfs_fs_zip_register();
+	if((err = cfs_fs_mount("tests/data/basic.zip", "/basic")) < 0 || (err = cfs_fs_mount("tests/data/zip64.zip", "/zip64")) < 0 ||
+	   (err = cfs_fs_mount("tests/data/damaged.zip", "/damaged")) < 0) {
+		fprintf(stderr, "mounting the archives failed: %s\n", cfs_getstrerr(err));
+		return 1;
+	}
+
+	test_read("/basic/stored.txt", "stored contents\n", 16);
+	test_read("/basic/empty.txt", "", 0);
+	test_read("/basic/fixed.txt", fixed, sizeof(fixed) - 1);
+	test_read("/basic/dynamic.txt", lines, length);
+	test_read("/basic/raw.txt", "deflated into stored blocks\n", 28);
+	test_read("/basic/twice.txt", "second\n", 7);
+
+	// Names are normalized, both in the archive and when opened.
+	test_read("/basic/dir/sub/back.txt", "backslashes\n", 12);
+	test_read("/basic//dir/./sub/../sub/back.txt", "backslashes\n", 12);
+	test_read("/basic/rooted/name.txt", "normalized\n", 11);
+	test_missing("/basic/dir\\sub\\back.txt", CFS_ERRNOENT);
+	test_missing("/basic/rooted/a/name.txt", CFS_ERRNOENT);
+
+	test_missing("/basic/dir", CFS_ERRNOENT);
+	test_missing("/basic/secret.txt", CFS_ERRNOENT);
+	test_missing("/basic/bzip2.txt", CFS_ERRNOENT);
+	test_missing("/basic/stored.txt/x", CFS_ERRNOENT);
+
+	test_read("/zip64/small.txt", "zip64 stored\n", 13);
+	test_read("/zip64/big/deflated.txt", lines, length);
+
+	test_reject("tests/data/cd_count.zip");
+	test_reject("tests/data/cd_offset.zip");
+	test_reject("tests/data/cd_short.zip");
+
+	test_missing("/damaged/local.txt", CFS_ERRIO);
+	test_corrupt("/damaged/stream.txt");
+	test_read("/damaged/fine.txt", "fine\n", 5);
+
+	test_mutations();
+
+	cfs_fs_unmount("tests/data/damaged.zip", "/damaged");
+	cfs_fs_unmount("tests/data/zip64.zip", "/zip64");
+	cfs_fs_unmount("tests/data/basic.zip", "/basic");
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
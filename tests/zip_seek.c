@@ -0,0 +1,145 @@
+/*
+ * Seeking inside the 6.5 MiB deflated entry of tests/data/large.zip, which
+ * spans several checkpoints. The entry is read once front to back, then
+ * read again at offsets on, just before, just after and in between
+ * checkpoints, backwards, forwards and at random, through both read_at and
+ * seek and read. Everything must match the front to back read. The entry is
+ * made of records whose bytes are nearly all inside matches, so checkpoints
+ * are taken and resumed in the middle of them.
+ *
+ * tests/zip_seek_thin.c builds the same test with room for only four
+ * checkpoints per file, so their spacing doubles on the way through.
+ */
+
+#include "cfs.c"
+
+#include <stdio.h>
+
+#ifdef CFS_POSIX
+
+#define TEST_SIZE 6800000
+#define TEST_READ 4096
+
+static unsigned char test_expected[TEST_SIZE];
+static unsigned char test_sequential[TEST_SIZE];
+static int test_failures;
+
+// What large.txt was made of: 1000 byte records, an 8 digit record number
+// followed by the same 992 pseudo random letters.
+static void test_generate(void) {
+	unsigned char letters[992];
+	uint32_t x = 1;
+	size_t i;
+
+	for(i = 0; i < sizeof(letters); i++) {
+		x = (x * 1103515245u + 12345u) & 0x7fffffffu;
+		letters[i] = (unsigned char)('a' + (x >> 16) % 26);
+	}
+	for(i = 0; i < TEST_SIZE / 1000; i++) {
+		char number[9];
+
+		snprintf(number, sizeof(number), "%08d", (int)i);
+		memcpy(test_expected + i * 1000, number, 8);
+		memcpy(test_expected + i * 1000 + 8, letters, sizeof(letters));
+	}
+}
+
+static void test_at(cfs_file* file, long int offset) {
+	unsigned char buffer[TEST_READ];
+	long int want = offset + TEST_READ <= TEST_SIZE ? TEST_READ : TEST_SIZE - offset;
+	long int n;
+
+	n = cfs_file_read_at(file, buffer, TEST_READ, offset);
+	if(n != want || memcmp(buffer, test_sequential + offset, (size_t)want) != 0) {
+		fprintf(stderr, "read_at %ld differs\n", offset);
+		test_failures++;
+	}
+	if(cfs_file_fseek(file, offset, CFS_SEEK_SET) != 0) {
+		fprintf(stderr, "seek to %ld failed\n", offset);
+		test_failures++;
+		return;
+	}
+	n = cfs_file_read(file, buffer, TEST_READ);
+	if(n != want || memcmp(buffer, test_sequential + offset, (size_t)want) != 0) {
+		fprintf(stderr, "read after seeking to %ld differs\n", offset);
+		test_failures++;
+	}
+}
+
+// Offsets around every multiple of the spacing: on it, one byte to either
+// side, far enough before it to read across, and in between.
+static void test_around(cfs_file* file, long int k) {
+	long int at = k * CFS_ZIP_CHECKPOINT_SIZE;
+
+	if(at > 0) {
+		test_at(file, at - 1);
+		test_at(file, at - TEST_READ / 2);
+	}
+	if(at < TEST_SIZE) {
+		test_at(file, at);
+		test_at(file, at + 1);
+	}
+	if(at + CFS_ZIP_CHECKPOINT_SIZE / 2 + 517 < TEST_SIZE) {
+		test_at(file, at + CFS_ZIP_CHECKPOINT_SIZE / 2 + 517);
+	}
+}
+
+int main(void) {
+	long int count = TEST_SIZE / CFS_ZIP_CHECKPOINT_SIZE;
+	const cfs_zip_file* zip;
+	cfs_file* file;
+	uint32_t seed = 12345;
+	size_t done;
+	long int n, k;
+	int i;
+
+	test_generate();
+	cfs_fs_zip_register();
+	if(cfs_fs_mount("tests/data/large.zip", "/") < 0 || (file = cfs_file_open("/large.txt", "rb")) == NULL) {
+		fprintf(stderr, "opening tests/data/large.zip failed\n");
+		return 1;
+	}
+	for(done = 0; (n = cfs_file_read(file, test_sequential + done, 65536)) > 0; done += (size_t)n) {}
+	if(done != TEST_SIZE || memcmp(test_sequential, test_expected, TEST_SIZE) != 0) {
+		fprintf(stderr, "sequential read differs\n");
+		return 1;
+	}
+	zip = file->handle->handle;
+	if(zip->checkpoint_count > CFS_ZIP_CHECKPOINT_MAX || zip->checkpoint_count != TEST_SIZE / zip->checkpoint_spacing) {
+		fprintf(stderr, "%zu checkpoints %llu bytes apart\n", zip->checkpoint_count, (unsigned long long)zip->checkpoint_spacing);
+		test_failures++;
+	}
+
+	for(k = count; k >= 0; k--) {
+		test_around(file, k);
+	}
+	for(k = 0; k <= count; k++) {
+		test_around(file, k);
+	}
+	for(i = 0; i < 300; i++) {
+		seed = seed * 1103515245u + 12345u;
+		test_at(file, (long int)((seed >> 8) % TEST_SIZE));
+	}
+	cfs_file_close(file);
+
+	// A fresh file seeking far ahead first takes the checkpoints on its way.
+	file = cfs_file_open("/large.txt", "rb");
+	test_at(file, TEST_SIZE - 10);
+	for(k = count; k >= 0; k--) {
+		test_around(file, k);
+	}
+	cfs_file_close(file);
+
+	cfs_fs_unmount("tests/data/large.zip", "/");
+	printf("%s\n", test_failures == 0 ? "ok" : "failed");
+	return test_failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void) {
+	printf("skipped, needs the POSIX backend\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,7 @@
+/*
+ * The seek test with room for four checkpoints per file, so the 6.5 MiB
+ * entry drops every other one and doubles their spacing twice.
+ */
+
+#define CFS_ZIP_CHECKPOINT_MAX 4
+#include "zip_seek.c"